@@ -52,7 +52,7 @@
  *          setting also defines the system tick time unit.
  */
 #if !defined(CH_CFG_ST_FREQUENCY)
-#define CH_CFG_ST_FREQUENCY                 2000
+#define CH_CFG_ST_FREQUENCY                 2048
 #endif
 
 /**
@@ -80,7 +80,7 @@
  *          this value.
  */
 #if !defined(CH_CFG_ST_TIMEDELTA)
-#define CH_CFG_ST_TIMEDELTA                 0
+#define CH_CFG_ST_TIMEDELTA                 2
 #endif
 
 /** @} */
@@ -105,7 +105,7 @@
  *          must be set to zero in that case.
  */
 #if !defined(CH_CFG_TIME_QUANTUM)
-#define CH_CFG_TIME_QUANTUM                 2
+#define CH_CFG_TIME_QUANTUM                 0
 #endif
 
 /**
@@ -697,7 +697,7 @@
  * @note    This macro can be used to activate a power saving mode.
  */
 #define CH_CFG_IDLE_ENTER_HOOK() {                                          \
-  /* Idle-enter code here.*/                                                \
+  idle_enter();                                                             \
 }
 
 /**
@@ -715,7 +715,7 @@
  * @details This hook is continuously invoked by the idle thread loop.
  */
 #define CH_CFG_IDLE_LOOP_HOOK() {                                           \
-  /* Idle loop code here.*/                                                 \
+  idle_wait();                                                              \
 }
 
 /**
@@ -751,6 +751,14 @@
 /* Port-specific settings (override port settings defaulted in chcore.h).    */
 /*===========================================================================*/
 
+/* The idle hooks call functions, the default idle stack has no room for them.*/
+#define PORT_IDLE_THREAD_STACK_SIZE         128
+
+#if !defined(_FROM_ASM_)
+void idle_enter(void);
+void idle_wait(void);
+#endif
+
 #endif  /* CHCONF_H */
 
 /** @} */
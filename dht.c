@@ -7,6 +7,8 @@
 #include "ch.h"
 #include "hal.h"
 
+#include "profile.h"
+
 #define DHT_ICU				ICUD3
 #define DHT_GPIO0			DHT0		/* GPIO0 and GPIO1 need to be connected to DHT OUT */
 #define DHT_GPIO1			DHT1		/* GPIO0 and GPIO1 need to be connected to DHT OUT */
@@ -180,10 +182,13 @@ dht_error_t dht_read(int16_t *temperature, uint16_t *humidity) {
 
 	chBSemWait(&icusem); /* to be sure */
 
+	prof_begin(PROF_DHT_READ);
 	chMsgSend(DHTThread_p, (msg_t) rd_p);
 
 	/* wait for reply */
-	if(chBSemWaitTimeout(&icusem, TIME_MS2I(DHT_PKT_TIMEOUT_MS)) == MSG_TIMEOUT) {
+	msg_t msg = chBSemWaitTimeout(&icusem, TIME_MS2I(DHT_PKT_TIMEOUT_MS));
+	prof_end(PROF_DHT_READ);
+	if(msg == MSG_TIMEOUT) {
 		chBSemReset(&icusem, FALSE);
 		return DHT_RCV_TIMEOUT;
 	}
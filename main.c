@@ -17,8 +17,8 @@
 #include "nrf52_flash.h"
 #include "nrf52_pof.h"
 #include "nrf_secret.h"
-#include "si7021.h"
-#include "dht.h"
+#include "sensors.h"
+#include "profile.h"
 
 #define DEBUG			0
 #define UPDATE_CONFIG	0	// update config
@@ -29,6 +29,8 @@
 config_t config;
 bool write_config = false;
 event_source_t event_src;
+systime_t wake_time;		// system time of the wake up, 0 after the reset
+bool warm_start;			// woken up from the System ON sleep, RAM kept
 
 #if DEBUG
 static const SerialConfig serial_config = {
@@ -44,7 +46,8 @@ static WDGConfig WDGcfg = {
   .timeout_ms     = 1000,
 };
 
-static void dosleep(uint16_t time) {
+// sleep by the watchdog reset, every wake up is a cold boot
+static void sleep_reset(uint32_t time_ms) {
   for (uint32_t i=0; i<32; i++)
   {
 	  // Put all other pins into default configuration, minimum power consumption
@@ -63,7 +66,7 @@ static void dosleep(uint16_t time) {
   NRF_RTC1->TASKS_STOP  = 1;
   nvicDisableVector(RTC1_IRQn);
 
-  WDGcfg.timeout_ms = 1000 * time;
+  WDGcfg.timeout_ms = time_ms;
   wdgStart(&WDGD1, &WDGcfg);
 
   // waiting watchdog reset
@@ -74,11 +77,96 @@ static void dosleep(uint16_t time) {
   }
 }
 
+// sleep in System ON, RTC2 compare wakes the core up with RAM & peripherals kept,
+// the SysTick RTC is stopped & cleared, the system time starts over each wake cycle
+static void dosleep(uint32_t time_ms) {
+  uint32_t pin_cnf[32];
+  uint32_t ticks = (time_ms / 1000) * SLEEP_RTC_FREQ + (time_ms % 1000) * SLEEP_RTC_FREQ / 1000;
+  bool hfxo = (NRF_CLOCK->HFCLKSTAT & CLOCK_HFCLKSTAT_SRC_Msk) != 0;
+
+  // all pins disconnected for the sleep, minimum power consumption
+  for (uint32_t i=0; i<32; i++) {
+	  pin_cnf[i] = NRF_P0->PIN_CNF[i];
+	  NRF_P0->PIN_CNF[i] = GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos;
+  }
+
+  chSysLock();
+
+  // switch to HFINT clock source, stop the SysTick RTC, its 24 bit counter
+  // is the tickless system time and never wraps within a wake cycle
+  NRF_CLOCK->TASKS_HFCLKSTOP = 1;
+  NRF_RTC1->TASKS_STOP = 1;
+  NRF_RTC1->TASKS_CLEAR = 1;
+
+  // the RTC2 interrupt stays disabled in NVIC, its pending state wakes WFE up
+  NRF_RTC2->PRESCALER = 32768 / SLEEP_RTC_FREQ - 1;
+  NRF_RTC2->CC[0] = 0;
+  NRF_RTC2->INTENSET = RTC_INTENSET_COMPARE0_Msk;
+  NRF_RTC2->TASKS_CLEAR = 1;
+  NRF_RTC2->TASKS_START = 1;
+  SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+
+  // the compare steps over the 24 bit counter for the sleeps longer than its range,
+  // the counter runs on so no tick is lost between the steps
+  while (ticks > 0) {
+	  uint32_t step = ticks > RTC_COUNTER_COUNTER_Msk ? RTC_COUNTER_COUNTER_Msk : ticks;
+
+	  ticks -= step;
+	  NRF_RTC2->CC[0] = (NRF_RTC2->CC[0] + step) & RTC_COUNTER_COUNTER_Msk;
+	  NRF_RTC2->EVENTS_COMPARE[0] = 0;
+	  nvicClearPending(RTC2_IRQn);
+	  while (!NRF_RTC2->EVENTS_COMPARE[0])
+		  __WFE();
+  }
+  uint32_t cyc = DWT->CYCCNT;
+
+  NRF_RTC2->TASKS_STOP = 1;
+  NRF_RTC2->INTENCLR = RTC_INTENSET_COMPARE0_Msk;
+  NRF_RTC2->EVENTS_COMPARE[0] = 0;
+  nvicClearPending(RTC2_IRQn);
+  SCB->SCR &= ~SCB_SCR_SEVONPEND_Msk;
+
+  if (hfxo) {
+	  NRF_CLOCK->EVENTS_HFCLKSTARTED = 0;
+	  NRF_CLOCK->TASKS_HFCLKSTART = 1;
+	  while (!NRF_CLOCK->EVENTS_HFCLKSTARTED);
+  }
+  NRF_RTC1->TASKS_START = 1;
+
+  chSysUnlock();
+
+  for (uint32_t i=0; i<32; i++)
+	  NRF_P0->PIN_CNF[i] = pin_cnf[i];
+
+  wake_time = chVTGetSystemTimeX();
+  warm_start = true;
+  prof_cycle(wake_time, (DWT->CYCCNT - cyc) / PROF_CPU_MHZ);
+}
+
+// idle thread enter hook, kernel locked, the HFXO is released while the
+// RADIO is idle with no frames queued
+void idle_enter(void) {
+  radio_hfclk_release(&RFD1);
+}
+
+// idle thread loop hook, the core waits in WFE till the next interrupt
+void idle_wait(void) {
+#if PROF_POWER
+  systime_t now = chVTGetSystemTimeX();
+  bool hfxo = (NRF_CLOCK->HFCLKSTAT & CLOCK_HFCLKSTAT_SRC_Msk) != 0;
+
+  __WFE();
+  prof_wake(chVTTimeElapsedSinceX(now), hfxo);
+#else
+  __WFE();
+#endif
+}
+
 // called on kernel panic
 void halt(void){
     port_disable();
     while(true) {
-    	dosleep(SLEEP_TIME);
+    	sleep_reset(1000 * SLEEP_TIME);
     }
 }
 
@@ -91,6 +179,21 @@ static void default_config(void) {
     config.dht_en = true;
     config.sleep = SLEEP_TIME;
     config.heater = 0;
+    config.rfmode = 0;
+    config.tx_power = TX_POWER_LEVELS - 1;
+    config.hop_channels = HOP_OFF;
+    config.bitrate = RF_BITRATE_1M;
+    config.slot = SLOT_OFF;
+}
+
+// wake up time needed before the slot for the sensors readout
+static uint32_t slot_guard(void) {
+	uint32_t guard = 1000 * config.heater;
+
+	// the sensors are read together, the longest path counts
+	if (config.dht_en && guard < DHT_PWRUP)
+		guard = DHT_PWRUP;
+	return SLOT_GUARD + guard;
 }
 
 
@@ -101,6 +204,7 @@ int main(void) {
     
 	halInit();
 	chSysInit();
+	prof_cycle(0, 0);
 
 #if DEBUG
     sdStart(&SD1, &serial_config);
@@ -110,9 +214,11 @@ int main(void) {
     chprintf((BaseSequentialStream *) &SD1, "reset reason:%ld\r\n", p->RESETREAS);
 #endif
 
+    prof_begin(PROF_FLASH);
     if (!initFlash()) {
         halt();
     }
+    initLog();
 
     if (!readFlash((uint8_t *) &config) || config.magic != MAGIC) {
         default_config();
@@ -121,6 +227,8 @@ int main(void) {
         }
     }
 
+    prof_end(PROF_FLASH);
+
 #if UPDATE_CONFIG
     default_config();
     if (!writeFlash((uint8_t *) &config)) {
@@ -128,14 +236,10 @@ int main(void) {
     }
 #endif
 
-    pof_init(POF_V22);
-
-    int8_t si_rslt, dht_rslt;
-  	int16_t si_temp, dht_temp;
-  	uint16_t si_hum, dht_hum;
-
 	while (true) {
 
+	  pof_init(POF_V22);
+
 	  if (pof_warning) {
 #if DEBUG
 		  chprintf((BaseSequentialStream *) &SD1, "POF warn %d\r\n", pof_warning);
@@ -145,82 +249,84 @@ int main(void) {
 		  goto SLEEP;
 	  }
 
-	  palSetLineMode(LINE_PWR, PAL_MODE_OUTPUT_PUSHPULL);
-	  palSetLine(LINE_PWR);
-
-      si_rslt = si7021_init(SI7021_RES_RH10_T13);
-      if (si_rslt == SI7021_OK) {
-    	si_rslt = si7021_read(&si_hum, &si_temp);
-    	if (si_rslt == SI7021_OK && config.heater > 0 && si_hum >= 1000) {
-  		  if (si7021_heater_power(SI7021_HEATER_3MA) == SI7021_OK) {
-  			si7021_heater(1);
-  			chThdSleepSeconds(config.heater);
-  			si7021_heater(0);
-  		  }
-    	}
-      }
-      si7021_stop();
-
-	  if (config.dht_en) {
-    	chThdSleepMilliseconds(DHT_PWRUP);
-		dht_init();
-      	dht_rslt = dht_read(&dht_temp, &dht_hum);
-      	dht_stop();
-      }
-
-	  palSetLineMode(LINE_PWR, PAL_MODE_UNCONNECTED);
-
+	  // both sensors power up together, the RADIO is configured during their power up
+	  // waits, the HFXO stays off till the first reading is queued
+	  eventmask_t pending = sensors_start();
 	  radio_start();
 
-      if (si_rslt == SI7021_OK) {
+	  // the readings are queued as each sensor is done
+	  while (pending) {
+		  eventmask_t evt = chEvtWaitAny(pending);
+		  pending &= ~evt;
+
+		  if (evt & SENSORS_EVT_SI7021) {
+			  if (sensors.si_rslt == SI7021_OK) {
 #if DEBUG
-    	chprintf((BaseSequentialStream *) &SD1, "SI7021 temp: %d, hum: %d\r\n", si_temp, si_hum);
+				  chprintf((BaseSequentialStream *) &SD1, "SI7021 temp: %d, hum: %d\r\n", sensors.si_temp, sensors.si_hum);
 #endif
-		send_sensor_value(ADDR_SI7021_TEMP, si_temp, 1);
-		send_sensor_value(ADDR_SI7021_HUM, si_hum, 1);
-      } else {
-		send_sensor_error(ADDR_SI7021_TEMP, si_rslt);
-		send_sensor_error(ADDR_SI7021_HUM, si_rslt);
-      }
+				  send_sensor_value(ADDR_SI7021_TEMP, sensors.si_temp, 1);
+				  send_sensor_value(ADDR_SI7021_HUM, sensors.si_hum, 1);
+			  } else {
+				  send_sensor_error(ADDR_SI7021_TEMP, sensors.si_rslt);
+				  send_sensor_error(ADDR_SI7021_HUM, sensors.si_rslt);
+			  }
+		  }
 
-	  if (config.dht_en) {
-		  if (dht_rslt == DHT_OK) {
+		  if (evt & SENSORS_EVT_DHT) {
+			  if (sensors.dht_rslt == DHT_OK) {
 #if DEBUG
-			  chprintf((BaseSequentialStream *) &SD1, "DHT %d, %d\r\n", dht_temp, dht_hum);
+				  chprintf((BaseSequentialStream *) &SD1, "DHT %d, %d\r\n", sensors.dht_temp, sensors.dht_hum);
 #endif
-			  send_sensor_value(ADDR_DHT_TEMP, dht_temp, 1);
-			  send_sensor_value(ADDR_DHT_HUM, dht_hum, 1);
-		  } else {
-			  send_sensor_error(ADDR_DHT_TEMP, dht_rslt);
-			  send_sensor_error(ADDR_DHT_HUM, dht_rslt);
+				  send_sensor_value(ADDR_DHT_TEMP, sensors.dht_temp, 1);
+				  send_sensor_value(ADDR_DHT_HUM, sensors.dht_hum, 1);
+			  } else {
+				  send_sensor_error(ADDR_DHT_TEMP, sensors.dht_rslt);
+				  send_sensor_error(ADDR_DHT_HUM, sensors.dht_rslt);
+			  }
 		  }
 	  }
+	  sensors_stop();
 
 	  if (pof_warning)
 		send_vbat(ADDR_DEVICE, ERR_VBAT_LOW);
 	  else
 		send_vbat(ADDR_DEVICE, ERR_NO_ERROR);
 
-      do {
+      if (config.rfmode & RF_MODE_ACKPL) {
+    	  // commands & replies go on until the gateway answers with an empty ACK
     	  send_msg_wait();
-    	  chThdSleepMilliseconds(WAIT_TIME);
-      } while (msg_received);
+    	  send_flush();
+      } else {
+    	  do {
+    		  send_msg_wait();
+    		  send_flush();
+    		  prof_begin(PROF_LISTEN);
+    		  chThdSleepMilliseconds(WAIT_TIME);
+    		  prof_end(PROF_LISTEN);
+    	  } while (msg_received);
+      }
 
       if (write_config) {
+          prof_begin(PROF_CFG_WRITE);
           if (!writeFlash((uint8_t *) &config)) {
         	  send_cmd_error(ADDR_DEVICE, ERR_CFG_WRITE);
           }
+          prof_end(PROF_CFG_WRITE);
           write_config = false;
       }
 
 SLEEP:
 	  pof_stop();
 	  radio_stop();
+	  prof_done();
 
-	  if (config.sleep > 0)
-		  dosleep(config.sleep);
+	  uint32_t sleep = slot_sleep(slot_guard());
+	  if (sleep > 0)
+		  dosleep(sleep);
+	  else if (config.sleep > 0)
+		  dosleep(1000 * config.sleep);
 	  else
-		  dosleep(SLEEP_TIME);
+		  dosleep(1000 * SLEEP_TIME);
     }
 }
 
@@ -10,8 +10,8 @@
 
 #include "ch.h"
 
-#define FIRMWARE        101     // fw version
-#define MAGIC           0xAE68  // eeprom magic data
+#define FIRMWARE        114     // fw version
+#define MAGIC           0xAE6D  // eeprom magic data
 #define DEVICEID        6		// default device id
 
 #define NRF_ADDR_LEN	5
@@ -20,9 +20,11 @@
 #define NRF_TX_PIPE		1		// tx pipe
 #define NRF_SEND_MS		3		// timeout packet send, mS
 
+#define SLEEP_RTC_FREQ	1024	// sleep RTC2 clock, Hz
+
 #include "packet.h"
 
-#define ADDRNUM			9
+#define ADDRNUM			17
 typedef enum {
 	ADDR_DEVICE,		// VBAT critical & device status
 	ADDR_SI7021_TEMP,	// SI7021 temperature
@@ -33,8 +35,84 @@ typedef enum {
 	ADDR_CFG_CHANNEL,	// RF channel
 	ADDR_CFG_DHT,		// DHT sensor enable
 	ADDR_CFG_HEATER,	// SI7021 heater enable time
+	ADDR_CFG_RFMODE,	// RF mode flags, firmware >= 102
+	ADDR_INFO_RSSI,		// uplink RSSI dBm measured by the gateway, MSG_INFO, firmware >= 103
+	ADDR_CFG_HOP,		// hop channels list, 4 packed bytes, 0xFF unused, firmware >= 104
+	ADDR_INFO_HOPBL,	// blacklisted hop list entries mask, MSG_INFO to the gateway
+	ADDR_INFO_STATS,	// link counter read, index in data, CMD_CFGWRITE clears, firmware >= 106
+	ADDR_CFG_SLOT,		// TDMA slot, period S << 16 | offset in SLOT_UNIT mS, 0 no slots, firmware >= 107
+	ADDR_INFO_TIME,		// gateway time within the slot period mS, MSG_INFO from the gateway
+	ADDR_INFO_PROFILE,	// last wake cycle profile, 4 byte chunks with the offset in cmdparam, firmware >= 112
 } address_t;
 
+// adaptive TX power
+#define TX_POWER_LEVELS	8		// -30, -20, -16, -12, -8, -4, 0, +4 dBm
+#define RSSI_TARGET		-75		// uplink RSSI target at the gateway, dBm
+#define RSSI_MARGIN		6		// RSSI hysteresis around the target, dB
+
+// channel hopping
+#define HOP_CHANNELS		4		// hop list length
+#define HOP_UNUSED			0xFF	// unused hop list entry
+#define HOP_OFF				0xFFFFFFFF
+#define HOP_FAILS			2		// failed bursts in a row to blacklist the channel
+#define HOP_BLACKLIST		32		// blacklist time, wake cycles
+
+// TDMA slots
+#define SLOT_OFF			0
+#define SLOT_UNIT			10		// slot offset unit, mS
+#define SLOT_GUARD			100		// wake up before the slot besides the sensors time, mS
+#define SLOT_SYNC_CYCLES	16		// wake cycles the slot stays aligned without the gateway time
+#define SLOT_MIN_SLEEP		1000	// shortest sleep to the next slot, mS
+#define SLOT_TIMER_MS		20		// last part of the wait for the slot start timed by TIMER/PPI, mS
+
+// link counters, ADDR_INFO_STATS index, MSG_INFO reply carries it in cmdparam
+#define STATS_RSSI_BUCKETS	8		// RSSI histogram, 8 dB buckets from -48 dBm down
+#define STATS_SEND_CLASSES	3		// send queue drops, one counter per send class
+
+typedef enum {
+	STATS_TX_FRAMES,		// frames sent
+	STATS_TX_RETRANSMITS,	// hardware retransmits
+	STATS_TX_FAILED,		// hardware retransmits expended
+	STATS_SEND_RETRIES,		// retransmit rounds restarted within the frame deadline
+	STATS_SEND_DROPPED,		// frames dropped at the deadline
+	STATS_RX_CRC_ERRORS,	// RX CRC errors
+	STATS_RX_OVERFLOWS,		// RX FIFO full drops
+	STATS_RX_DUPLICATES,	// duplicate PID drops
+	STATS_RSSI_HIST,		// first RSSI histogram bucket
+	STATS_CCA_BUSY = STATS_RSSI_HIST + STATS_RSSI_BUCKETS,	// busy channel assessments
+	STATS_CCA_FORCED,		// frames sent on a busy channel
+	STATS_CCA_BACKOFF,		// backoff time, uS
+	STATS_LOG_STORED,		// dropped readings stored in the flash log, firmware >= 110
+	STATS_LOG_REPLAYED,		// logged readings queued again
+	STATS_BOOT_TX_COLD,		// last reset to first TX time, mS from the kernel start, firmware >= 111
+	STATS_BOOT_TX_WARM,		// last System ON wake up to first TX time, mS
+	STATS_QUEUE_DROPPED,	// send queue drops & evictions, critical class first, firmware >= 109
+	STATS_COUNT = STATS_QUEUE_DROPPED + STATS_SEND_CLASSES,
+} stats_index_t;
+
+// flash log of the readings dropped at the deadline, replayed after a good burst
+#define LOG_REPLAY_BURST	4		// replayed readings per burst
+#define LOG_REPLAY_WAKE		12		// replayed readings per wake cycle
+
+// RF mode flags
+#define RF_MODE_AGGR	0x01	// readings in one MSG_AGGR frame, ESB dynamic payload length
+#define RF_MODE_ACKPL	0x02	// PTX only, commands in the gateway ACK payloads
+#define RF_MODE_2MBPS	0x04	// gateway accepts 2 Mbps, used when the link allows
+#define RF_MODE_CCA		0x08	// listen before talk, firmware >= 108
+#define RF_MODE_MASK	(RF_MODE_AGGR | RF_MODE_ACKPL | RF_MODE_2MBPS | RF_MODE_CCA)
+
+// clear channel assessment
+#define CCA_THRESHOLD	80		// channel busy above -80 dBm
+#define CCA_WINDOW		128		// listen time, uS
+#define CCA_BACKOFFS	4		// random backoffs before sending on a busy channel
+#define CCA_MAX_MS		9		// longest backoffs & listen windows time of a frame, mS
+
+// bitrate selection
+#define RF_BITRATE_1M		0
+#define RF_BITRATE_2M		1
+#define BITRATE_FAILS		2		// failed bursts in a row at 2 Mbps to fall back
+#define BITRATE_HOLDOFF		64		// wake cycles at 1 Mbps before 2 Mbps is tried again
+
 typedef enum {
 	ERR_NO_ERROR,
 	ERR_VBAT_LOW,
@@ -55,9 +133,16 @@ struct config {
 	uint16_t sleep;					// time, sec for device sleep
 	bool dht_en;					// DHT enable flag
 	uint8_t heater;					// enable SI7021 heater time
+	uint8_t rfmode;					// RF mode flags
+	uint8_t tx_power;				// TX power level, 0..TX_POWER_LEVELS-1
+	uint32_t hop_channels;			// hop channels list, HOP_OFF no hopping
+	uint8_t bitrate;				// RF_BITRATE_1M, RF_BITRATE_2M
+	uint32_t slot;					// TDMA slot, period S << 16 | offset, SLOT_OFF random wake
 };
 
 extern config_t config;
 extern bool write_config;
+extern systime_t wake_time;
+extern bool warm_start;
 
 #endif /* MAIN_H_ */
@@ -6,6 +6,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "ch.h"
@@ -15,8 +16,12 @@
 #include "crc8.h"
 
 #define FLASHMAGIC		0x192068AE	// eeprom magic data
+#define LOGMAGIC		0x4C4F4731	// telemetry log record
+#define LOGPROGLEN		offsetof(log_record_t, sent)
+#define LOGSENT			0xFFFFFFFF	// sent word of a record not read back
 
 static flash_info_t flashInfo;
+static log_info_t logInfo;
 
 // erase flash page
 static bool pageErase(uint16_t pageno) {
@@ -219,3 +224,116 @@ bool writeFlash(uint8_t *data) {
   }
   return result;
 }
+
+// flash offset of the log record slot
+static uint32_t logOffset(uint32_t seq) {
+  const flash_descriptor_t *descriptor = flashGetDescriptor(getBaseFlash(&EFLD1));
+  uint32_t slot = seq % logInfo.records;
+
+  return (logInfo.first_page + slot / logInfo.records_on_page) * descriptor->page_size +
+		 (slot % logInfo.records_on_page) * sizeof(log_record_t);
+}
+
+// read the log record, false if the slot does not hold a valid record
+static bool logRecord(uint32_t seq, log_record_t *rec) {
+  BaseFlash *fp = getBaseFlash(&EFLD1);
+
+  if (flashRead(fp, logOffset(seq), sizeof(log_record_t), (uint8_t *) rec) != FLASH_NO_ERROR)
+	return false;
+  return rec->magic == LOGMAGIC && rec->crc == CRC8((uint8_t *) rec, offsetof(log_record_t, crc));
+}
+
+// init log info structure, the head & tail are found by the sequence numbers
+bool initLog(void) {
+  BaseFlash *fp = getBaseFlash(&EFLD1);
+  const flash_descriptor_t *descriptor = flashGetDescriptor(fp);
+  log_record_t rec;
+  uint32_t head = 0, tail = UINT32_MAX;
+
+  logInfo.first_page = descriptor->sectors_count - NUMPAGES - LOGPAGES;
+  logInfo.records_on_page = descriptor->page_size / sizeof(log_record_t);
+  logInfo.records = LOGPAGES * logInfo.records_on_page;
+
+  for (uint32_t i=0; i < logInfo.records; i++) {
+	if (!logRecord(i, &rec))
+	  continue;
+	if (head < rec.seq)
+	  head = rec.seq;
+	if (rec.sent == LOGSENT && tail > rec.seq)
+	  tail = rec.seq;
+  }
+
+  // sequence numbers start from 1, the slots of a full ring are reused from the oldest page
+  logInfo.next_seq = head + 1;
+  logInfo.tail_seq = (tail == UINT32_MAX) ? logInfo.next_seq : tail;
+  return true;
+}
+
+// append the record, a used page is erased first and its unsent records are lost
+bool writeLog(const uint8_t *data, uint8_t length) {
+  BaseFlash *fp = getBaseFlash(&EFLD1);
+  const flash_descriptor_t *descriptor = flashGetDescriptor(fp);
+  uint32_t seq = logInfo.next_seq;
+  uint32_t offset = logOffset(seq);
+  log_record_t rec;
+
+  if (length > LOGDATALEN || logInfo.records == 0)
+	return false;
+
+  if (flashRead(fp, offset, sizeof(log_record_t), (uint8_t *) &rec) != FLASH_NO_ERROR)
+	return false;
+  for (uint16_t i=0; i < sizeof(log_record_t); i++) {
+	if (((uint8_t *) &rec)[i] != 0xFF) {
+	  if (!pageErase(offset / descriptor->page_size))
+		return false;
+	  // the records of the erased page, one ring lap back, are gone
+	  uint32_t lost = seq - (seq % logInfo.records) % logInfo.records_on_page + logInfo.records_on_page;
+	  if (lost > logInfo.records && logInfo.tail_seq < lost - logInfo.records)
+		logInfo.tail_seq = lost - logInfo.records;
+	  break;
+	}
+  }
+
+  memset(&rec, 0xFF, sizeof(rec));
+  rec.magic = LOGMAGIC;
+  rec.seq = seq;
+  rec.length = length;
+  memcpy(rec.data, data, length);
+  rec.crc = CRC8((uint8_t *) &rec, offsetof(log_record_t, crc));
+
+  bool result = false;
+  chSysLock();
+  result = flashProgram(fp, offset, LOGPROGLEN, (uint8_t *) &rec) == FLASH_NO_ERROR;
+  chSysUnlock();
+  if (result)
+	logInfo.next_seq = seq + 1;
+  return result;
+}
+
+// read back the oldest record not read yet and mark it sent
+bool readLog(uint8_t *data, uint8_t *length) {
+  BaseFlash *fp = getBaseFlash(&EFLD1);
+  log_record_t rec;
+
+  while (logInfo.tail_seq < logInfo.next_seq) {
+	uint32_t seq = logInfo.tail_seq++;
+
+	if (!logRecord(seq, &rec) || rec.seq != seq || rec.sent != LOGSENT || rec.length > LOGDATALEN)
+	  continue;
+
+	uint32_t sent = 0;
+	chSysLock();
+	flashProgram(fp, logOffset(seq) + LOGPROGLEN, sizeof(sent), (uint8_t *) &sent);
+	chSysUnlock();
+
+	memcpy(data, rec.data, rec.length);
+	*length = rec.length;
+	return true;
+  }
+  return false;
+}
+
+// records not read back yet
+uint32_t pendingLog(void) {
+  return logInfo.next_seq - logInfo.tail_seq;
+}
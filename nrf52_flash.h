@@ -38,6 +38,30 @@ struct _flash_record_t {
   uint8_t crc;
 };
 
+// telemetry log ring on the pages below the config pages,
+// the record of sequence number seq is kept in the slot seq % (LOGPAGES * records_on_page)
+#define LOGPAGES	4
+#define LOGDATALEN	MSGLEN_AGGR
+
+typedef struct _log_record_t log_record_t;
+struct _log_record_t {
+  uint32_t magic;
+  uint32_t seq;
+  uint8_t length;
+  uint8_t data[LOGDATALEN];
+  uint8_t crc;
+  uint32_t sent;		// programmed to zero when the record is read back, not in crc
+};
+
+typedef struct _log_info_t log_info_t;
+struct _log_info_t {
+  uint16_t first_page;
+  uint16_t records_on_page;
+  uint32_t records;
+  uint32_t next_seq;		// sequence number of the next record written
+  uint32_t tail_seq;		// oldest record not read back yet
+};
+
 typedef struct _flash_info_t flash_info_t;
 struct _flash_info_t {
   uint16_t active_page;
@@ -47,6 +71,10 @@ struct _flash_info_t {
 };
 
 bool initFlash(void);
+bool initLog(void);
+bool writeLog(const uint8_t *data, uint8_t length);
+bool readLog(uint8_t *data, uint8_t *length);
+uint32_t pendingLog(void);
 bool eraseFlash(void);
 bool readFlash(uint8_t *data);
 bool writeFlash(uint8_t *data);
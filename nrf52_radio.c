@@ -24,7 +24,6 @@
 
 
 #define BIT_MASK_UINT_8(x) 					  (0xFF >> (8 - (x)))
-#define NRF52_PIPE_COUNT 					  9
 
 #define RADIO_SHORTS_COMMON ( RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_END_DISABLE_Msk | \
             RADIO_SHORTS_ADDRESS_RSSISTART_Msk | RADIO_SHORTS_DISABLED_RSSISTOP_Msk )
@@ -87,12 +86,13 @@
 #error "At least one hardware TIMER must be defined"
 #endif
 
-#ifndef NRF52_RADIO_INTTHD_PRIORITY
-#error "Interrupt handle thread priority need to be defined"
+#if (NRF52_TX_FIFO_SIZE & (NRF52_TX_FIFO_SIZE - 1)) != 0 || \
+    (NRF52_RX_FIFO_SIZE & (NRF52_RX_FIFO_SIZE - 1)) != 0
+#error "TX and RX FIFO sizes must be a power of two"
 #endif
 
-#ifndef NRF52_RADIO_EVTTHD_PRIORITY
-#error "Event thread priority need to be defined"
+#if !NRF52_RADIO_USE_ISR_HANDLER && !defined(NRF52_RADIO_INTTHD_PRIORITY)
+#error "Interrupt handle thread priority need to be defined"
 #endif
 
 #define VERIFY_PAYLOAD_LENGTH(p)                            \
@@ -100,71 +100,30 @@ do                                                          \
 {                                                           \
     if(p->length == 0 ||                                    \
        p->length > NRF52_MAX_PAYLOAD_LENGTH ||              \
-       (RFD1.config.protocol == NRF52_PROTOCOL_ESB &&       \
-        p->length > RFD1.config.payload_length))            \
+       (rfp->config.protocol == NRF52_PROTOCOL_ESB &&       \
+        p->length > rfp->config.payload_length))            \
     {                                                       \
         return NRF52_ERROR_INVALID_LENGTH;                  \
     }                                                       \
 }while(0)
 
-//Structure holding pipe info PID and CRC and ack payload.
-typedef struct
-{
-    uint16_t            m_crc;
-    uint8_t             m_pid;
-    uint8_t             m_ack_payload;
-} pipe_info_t;
-
-// First in first out queue of payloads to be transmitted.
-typedef struct
-{
-    nrf52_payload_t *   p_payload[NRF52_TX_FIFO_SIZE];      /**< Pointer to the actual queue. */
-    uint32_t            entry_point;                        /**< Current start of queue. */
-    uint32_t            exit_point;                         /**< Current end of queue. */
-    uint32_t            count;                              /**< Current number of elements in the queue. */
-} nrf52_payload_tx_fifo_t;
-
-// First in first out queue of received payloads.
-typedef struct
-{
-    nrf52_payload_t *   p_payload[NRF52_RX_FIFO_SIZE];      /**< Pointer to the actual queue. */
-    uint32_t            entry_point;                        /**< Current start of queue. */
-    uint32_t            exit_point;                         /**< Current end of queue. */
-    uint32_t            count;                              /**< Current number of elements in the queue. */
-} nrf52_payload_rx_fifo_t;
-
-// These function pointers are changed dynamically, depending on protocol configuration and state.
-//static void (*on_radio_end)(RFDriver *rfp) = NULL;
-static void (*set_rf_payload_format)(RFDriver *rfp, uint32_t payload_length) = NULL;
-
-// The following functions are assigned to the function pointers above.
+/* A data memory barrier orders the FIFO slot access against the index update. */
+#define FIFO_COUNT(f)                         ((uint32_t)((f).entry_point - (f).exit_point))
+#define TX_FIFO_ENTRY(rfp)                    (rfp)->tx_fifo.p_frame[(rfp)->tx_fifo.entry_point & (NRF52_TX_FIFO_SIZE - 1)]
+#define TX_FIFO_EXIT(rfp)                     (rfp)->tx_fifo.p_frame[(rfp)->tx_fifo.exit_point & (NRF52_TX_FIFO_SIZE - 1)]
+#define RX_FIFO_ENTRY(rfp)                    (rfp)->rx_fifo.p_frame[(rfp)->rx_fifo.entry_point & (NRF52_RX_FIFO_SIZE - 1)]
+#define RX_FIFO_EXIT(rfp)                     (rfp)->rx_fifo.p_frame[(rfp)->rx_fifo.exit_point & (NRF52_RX_FIFO_SIZE - 1)]
+
+// State machine transitions on the DISABLED event.
 static void on_radio_disabled_tx_noack(RFDriver *rfp);
 static void on_radio_disabled_tx(RFDriver *rfp);
 static void on_radio_disabled_tx_wait_for_ack(RFDriver *rfp);
 static void on_radio_disabled_rx(RFDriver *rfp);
 static void on_radio_disabled_rx_ack(RFDriver *rfp);
-
-static volatile uint16_t wait_for_ack_timeout_us;
-static nrf52_payload_t * p_current_payload;
-
-// TX FIFO
-static nrf52_payload_t            tx_fifo_payload[NRF52_TX_FIFO_SIZE];
-static nrf52_payload_tx_fifo_t    tx_fifo;
-
-// RX FIFO
-static nrf52_payload_t            rx_fifo_payload[NRF52_RX_FIFO_SIZE];
-static nrf52_payload_rx_fifo_t    rx_fifo;
-
-// Payload buffers
-static uint8_t                    tx_payload_buffer[NRF52_MAX_PAYLOAD_LENGTH + 2];
-static uint8_t                    rx_payload_buffer[NRF52_MAX_PAYLOAD_LENGTH + 2];
-
-static uint8_t                    pids[NRF52_PIPE_COUNT];
-static pipe_info_t                rx_pipe_info[NRF52_PIPE_COUNT];
-
- // disable and events semaphores.
-static binary_semaphore_t disable_sem;
-static binary_semaphore_t events_sem;
+static void on_radio_disabled_cca(RFDriver *rfp);
+static void on_radio_disabled_rx_restart(RFDriver *rfp);
+static void on_radio_disabled_rx_stop(RFDriver *rfp);
+static void on_radio_ready_cca(RFDriver *rfp);
 
 RFDriver RFD1;
 
@@ -180,76 +139,119 @@ static uint32_t addr_conv(uint8_t const* p_addr) {
     return __REV(bytewise_bit_swap(p_addr)); //lint -esym(628, __rev) -esym(526, __rev) */
 }
 
-static thread_t *rfEvtThread_p;
-static THD_WORKING_AREA(waRFEvtThread, 128);
-static THD_FUNCTION(rfEvtThread, arg) {
-    (void)arg;
+// Broadcast the flags collected by the state machine to the radio listeners.
+static void signal_events(RFDriver *rfp) {
+    eventflags_t flags = 0;
+
+    if (rfp->flags & NRF52_INT_TX_SUCCESS_MSK)
+        flags |= (eventflags_t) NRF52_EVENT_TX_SUCCESS;
+    if (rfp->flags & NRF52_INT_TX_FAILED_MSK)
+        flags |= (eventflags_t) NRF52_EVENT_TX_FAILED;
+    if (rfp->flags & NRF52_INT_RX_DR_MSK)
+        flags |= (eventflags_t) NRF52_EVENT_RX_RECEIVED;
+    rfp->flags = 0;
+
+#if NRF52_RADIO_USE_ISR_HANDLER
+    chSysLockFromISR();
+    chEvtBroadcastFlagsI(&rfp->eventsrc, flags);
+    chSysUnlockFromISR();
+#else
+    chEvtBroadcastFlags(&rfp->eventsrc, flags);
+#endif
+}
 
-    chRegSetThreadName("rfevent");
+// Count the RSSI of the last received packet or ACK.
+static void rssi_hist_add(RFDriver *rfp) {
+    uint32_t bucket = 0;
+    uint32_t rssi = rfp->radio->RSSISAMPLE;
 
-    while (!chThdShouldTerminateX()) {
-    	chBSemWait(&events_sem);
+    if (rssi >= NRF52_RSSI_HIST_BASE)
+        bucket = (rssi - NRF52_RSSI_HIST_BASE) / NRF52_RSSI_HIST_STEP + 1;
+    if (bucket >= NRF52_RSSI_HIST_SIZE)
+        bucket = NRF52_RSSI_HIST_SIZE - 1;
 
-    	nrf52_int_flags_t interrupts = RFD1.flags;
-        RFD1.flags = 0;
+    rfp->stats.rssi_hist[bucket]++;
+}
 
-        if (interrupts & NRF52_INT_TX_SUCCESS_MSK) {
-            chEvtBroadcastFlags(&RFD1.eventsrc, (eventflags_t) NRF52_EVENT_TX_SUCCESS);
-        }
-        if (interrupts & NRF52_INT_TX_FAILED_MSK) {
-        	chEvtBroadcastFlags(&RFD1.eventsrc, (eventflags_t) NRF52_EVENT_TX_FAILED);
-        }
-        if (interrupts & NRF52_INT_RX_DR_MSK) {
-        	chEvtBroadcastFlags(&RFD1.eventsrc, (eventflags_t) NRF52_EVENT_RX_RECEIVED);
-        }
-    }
-    chThdExit((msg_t) 0);
+// Run the state machine transition for the DISABLED event.
+static void on_radio_disabled(RFDriver *rfp) {
+	switch (rfp->state) {
+	  case NRF52_STATE_PTX_TX:
+		  on_radio_disabled_tx_noack(rfp);
+		  break;
+	  case NRF52_STATE_PTX_TX_ACK:
+		  on_radio_disabled_tx(rfp);
+		  break;
+	  case NRF52_STATE_PTX_RX_ACK:
+		  on_radio_disabled_tx_wait_for_ack(rfp);
+		  break;
+	  case NRF52_STATE_PRX:
+		  on_radio_disabled_rx(rfp);
+		  break;
+	  case NRF52_STATE_PRX_SEND_ACK:
+		  on_radio_disabled_rx_ack(rfp);
+		  break;
+	  case NRF52_STATE_PTX_CCA:
+		  on_radio_disabled_cca(rfp);
+		  break;
+	  case NRF52_STATE_PRX_RESTART:
+		  on_radio_disabled_rx_restart(rfp);
+		  break;
+	  case NRF52_STATE_PRX_STOP:
+	  case NRF52_STATE_STOP:
+		  on_radio_disabled_rx_stop(rfp);
+		  break;
+	  default:
+		  break;
+	}
+
+#if NRF52_RADIO_MEASURE_LATENCY
+	// The RADIO has been reprogrammed for the next step
+	rfp->latency_last = DWT->CYCCNT - rfp->disabled_stamp;
+	if (rfp->latency_last > rfp->latency_max)
+		rfp->latency_max = rfp->latency_last;
+#endif
 }
 
-static thread_t *rfIntThread_p;
-static THD_WORKING_AREA(waRFIntThread, 128);
+#if !NRF52_RADIO_USE_ISR_HANDLER
 static THD_FUNCTION(rfIntThread, arg) {
-    (void)arg;
+    RFDriver *rfp = arg;
 
     chRegSetThreadName("rfint");
 
     while (!chThdShouldTerminateX()) {
-    	chBSemWait(&disable_sem);
-    	switch (RFD1.state) {
-    	  case NRF52_STATE_PTX_TX:
-    		  on_radio_disabled_tx_noack(&RFD1);
-    		  break;
-    	  case NRF52_STATE_PTX_TX_ACK:
-    		  on_radio_disabled_tx(&RFD1);
-    		  break;
-    	  case NRF52_STATE_PTX_RX_ACK:
-    		  on_radio_disabled_tx_wait_for_ack(&RFD1);
-    		  break;
-    	  case NRF52_STATE_PRX:
-    		  on_radio_disabled_rx(&RFD1);
-    		  break;
-    	  case NRF52_STATE_PRX_SEND_ACK:
-    		  on_radio_disabled_rx_ack(&RFD1);
-    		  break;
-    	  default:
-    		  break;
-    	}
+    	chBSemWait(&rfp->disable_sem);
+    	on_radio_disabled(rfp);
     }
 	chThdExit((msg_t) 0);
 }
+#endif
 
-static void serve_radio_interrupt(RFDriver *rfp) {
-	(void)rfp;
-    if ((NRF_RADIO->INTENSET & RADIO_INTENSET_READY_Msk) && NRF_RADIO->EVENTS_READY) {
-        NRF_RADIO->EVENTS_READY = 0;
-        (void) NRF_RADIO->EVENTS_READY;
+/**@brief RADIO interrupt service of the instance, called from its RADIO vector. */
+void radio_serve_interrupt(RFDriver *rfp) {
+    if ((rfp->radio->INTENSET & RADIO_INTENSET_READY_Msk) && rfp->radio->EVENTS_READY) {
+        rfp->radio->EVENTS_READY = 0;
+        (void) rfp->radio->EVENTS_READY;
+        // The listen window is timed here in both handler modes
+        if (rfp->state == NRF52_STATE_PTX_CCA)
+            on_radio_ready_cca(rfp);
     }
-    if ((NRF_RADIO->INTENSET & RADIO_INTENSET_DISABLED_Msk) && NRF_RADIO->EVENTS_DISABLED) {
-        NRF_RADIO->EVENTS_DISABLED = 0;
-        (void) NRF_RADIO->EVENTS_DISABLED;
+    if ((rfp->radio->INTENSET & RADIO_INTENSET_DISABLED_Msk) && rfp->radio->EVENTS_DISABLED) {
+        rfp->radio->EVENTS_DISABLED = 0;
+        (void) rfp->radio->EVENTS_DISABLED;
+#if NRF52_RADIO_MEASURE_LATENCY
+        rfp->disabled_stamp = DWT->CYCCNT;
+#endif
+#if NRF52_RADIO_USE_ISR_HANDLER
+        // Reprogram SHORTS/PACKETPTR without a context switch, the events
+        // are broadcast from the ISR as well.
+        on_radio_disabled(rfp);
+#else
+        (void)rfp;
         chSysLockFromISR();
-       	chBSemSignalI(&disable_sem);
+       	chBSemSignalI(&rfp->disable_sem);
        	chSysUnlockFromISR();
+#endif
     }
 }
 
@@ -262,7 +264,7 @@ OSAL_IRQ_HANDLER(Vector44) {
 
   OSAL_IRQ_PROLOGUE();
 
-  serve_radio_interrupt(&RFD1);
+  radio_serve_interrupt(&RFD1);
 
   OSAL_IRQ_EPILOGUE();
 }
@@ -271,16 +273,16 @@ static void set_rf_payload_format_esb_dpl(RFDriver *rfp, uint32_t payload_length
 	(void)payload_length;
 #if (NRF52_MAX_PAYLOAD_LENGTH <= 32)
     // Using 6 bits for length
-    NRF_RADIO->PCNF0 = (0 << RADIO_PCNF0_S0LEN_Pos) |
+    rfp->radio->PCNF0 = (0 << RADIO_PCNF0_S0LEN_Pos) |
                        (6 << RADIO_PCNF0_LFLEN_Pos) |
                        (3 << RADIO_PCNF0_S1LEN_Pos) ;
 #else
     // Using 8 bits for length
-    NRF_RADIO->PCNF0 = (0 << RADIO_PCNF0_S0LEN_Pos) |
+    rfp->radio->PCNF0 = (0 << RADIO_PCNF0_S0LEN_Pos) |
                        (8 << RADIO_PCNF0_LFLEN_Pos) |
                        (3 << RADIO_PCNF0_S1LEN_Pos) ;
 #endif
-    NRF_RADIO->PCNF1 = (RADIO_PCNF1_WHITEEN_Disabled    << RADIO_PCNF1_WHITEEN_Pos) |
+    rfp->radio->PCNF1 = (RADIO_PCNF1_WHITEEN_Disabled    << RADIO_PCNF1_WHITEEN_Pos) |
                        (RADIO_PCNF1_ENDIAN_Big          << RADIO_PCNF1_ENDIAN_Pos)  |
                        ((rfp->config.address.addr_length - 1)  << RADIO_PCNF1_BALEN_Pos)   |
                        (0                               << RADIO_PCNF1_STATLEN_Pos) |
@@ -288,11 +290,11 @@ static void set_rf_payload_format_esb_dpl(RFDriver *rfp, uint32_t payload_length
 }
 
 static void set_rf_payload_format_esb(RFDriver *rfp, uint32_t payload_length) {
-    NRF_RADIO->PCNF0 = (1 << RADIO_PCNF0_S0LEN_Pos) |
+    rfp->radio->PCNF0 = (1 << RADIO_PCNF0_S0LEN_Pos) |
                        (0 << RADIO_PCNF0_LFLEN_Pos) |
                        (1 << RADIO_PCNF0_S1LEN_Pos);
 
-    NRF_RADIO->PCNF1 = (RADIO_PCNF1_WHITEEN_Disabled    << RADIO_PCNF1_WHITEEN_Pos) |
+    rfp->radio->PCNF1 = (RADIO_PCNF1_WHITEEN_Disabled    << RADIO_PCNF1_WHITEEN_Pos) |
                        (RADIO_PCNF1_ENDIAN_Big          << RADIO_PCNF1_ENDIAN_Pos)  |
                        ((rfp->config.address.addr_length - 1)  << RADIO_PCNF1_BALEN_Pos)   |
                        (payload_length                  << RADIO_PCNF1_STATLEN_Pos) |
@@ -305,36 +307,36 @@ static void set_rf_payload_format_esb(RFDriver *rfp, uint32_t payload_length) {
  */
 static void set_addresses(RFDriver *rfp, uint8_t update_mask) {
     if (update_mask & NRF52_ADDR_UPDATE_MASK_BASE0) {
-        NRF_RADIO->BASE0 = addr_conv(rfp->config.address.base_addr_p0);
-        NRF_RADIO->DAB[0] = addr_conv(rfp->config.address.base_addr_p0);
+        rfp->radio->BASE0 = addr_conv(rfp->config.address.base_addr_p0);
+        rfp->radio->DAB[0] = addr_conv(rfp->config.address.base_addr_p0);
     }
 
     if (update_mask & NRF52_ADDR_UPDATE_MASK_BASE1) {
-        NRF_RADIO->BASE1 = addr_conv(rfp->config.address.base_addr_p1);
-        NRF_RADIO->DAB[1] = addr_conv(rfp->config.address.base_addr_p1);
+        rfp->radio->BASE1 = addr_conv(rfp->config.address.base_addr_p1);
+        rfp->radio->DAB[1] = addr_conv(rfp->config.address.base_addr_p1);
     }
 
     if (update_mask & NRF52_ADDR_UPDATE_MASK_PREFIX) {
-        NRF_RADIO->PREFIX0 = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[0]);
-        NRF_RADIO->DAP[0] = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[0]);
-        NRF_RADIO->PREFIX1 = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[4]);
-        NRF_RADIO->DAP[1] = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[4]);
+        rfp->radio->PREFIX0 = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[0]);
+        rfp->radio->DAP[0] = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[0]);
+        rfp->radio->PREFIX1 = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[4]);
+        rfp->radio->DAP[1] = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[4]);
     }
 }
 
 static void set_tx_power(RFDriver *rfp) {
-    NRF_RADIO->TXPOWER = rfp->config.tx_power << RADIO_TXPOWER_TXPOWER_Pos;
+    rfp->radio->TXPOWER = rfp->config.tx_power << RADIO_TXPOWER_TXPOWER_Pos;
 }
 
 static void set_bitrate(RFDriver *rfp) {
-    NRF_RADIO->MODE = rfp->config.bitrate << RADIO_MODE_MODE_Pos;
+    rfp->radio->MODE = rfp->config.bitrate << RADIO_MODE_MODE_Pos;
 
     switch (rfp->config.bitrate) {
         case NRF52_BITRATE_2MBPS:
-            wait_for_ack_timeout_us = RX_WAIT_FOR_ACK_TIMEOUT_US_2MBPS;
+            rfp->wait_for_ack_timeout_us = RX_WAIT_FOR_ACK_TIMEOUT_US_2MBPS;
             break;
         case NRF52_BITRATE_1MBPS:
-            wait_for_ack_timeout_us = RX_WAIT_FOR_ACK_TIMEOUT_US_1MBPS;
+            rfp->wait_for_ack_timeout_us = RX_WAIT_FOR_ACK_TIMEOUT_US_1MBPS;
             break;
     }
 }
@@ -342,41 +344,44 @@ static void set_bitrate(RFDriver *rfp) {
 static void set_protocol(RFDriver *rfp) {
     switch (rfp->config.protocol) {
         case NRF52_PROTOCOL_ESB_DPL:
-            set_rf_payload_format = set_rf_payload_format_esb_dpl;
+            rfp->set_rf_payload_format = set_rf_payload_format_esb_dpl;
             break;
         case NRF52_PROTOCOL_ESB:
-            set_rf_payload_format = set_rf_payload_format_esb;
+            rfp->set_rf_payload_format = set_rf_payload_format_esb;
             break;
     }
 }
 
 static void set_crc(RFDriver *rfp) {
-    NRF_RADIO->CRCCNF = rfp->config.crc << RADIO_CRCCNF_LEN_Pos;
+    rfp->radio->CRCCNF = rfp->config.crc << RADIO_CRCCNF_LEN_Pos;
 
     if (rfp->config.crc == RADIO_CRCCNF_LEN_Two)
     {
-        NRF_RADIO->CRCINIT = 0xFFFFUL;      // Initial value
-        NRF_RADIO->CRCPOLY = 0x11021UL;     // CRC poly: x^16+x^12^x^5+1
+        rfp->radio->CRCINIT = 0xFFFFUL;      // Initial value
+        rfp->radio->CRCPOLY = 0x11021UL;     // CRC poly: x^16+x^12^x^5+1
     }
     else if (rfp->config.crc == RADIO_CRCCNF_LEN_One)
     {
-        NRF_RADIO->CRCINIT = 0xFFUL;        // Initial value
-        NRF_RADIO->CRCPOLY = 0x107UL;       // CRC poly: x^8+x^2^x^1+1
+        rfp->radio->CRCINIT = 0xFFUL;        // Initial value
+        rfp->radio->CRCPOLY = 0x107UL;       // CRC poly: x^8+x^2^x^1+1
     }
 }
 
 static void ppi_init(RFDriver *rfp) {
-    NRF_PPI->CH[NRF52_RADIO_PPI_TIMER_START].EEP = (uint32_t)&NRF_RADIO->EVENTS_READY;
-    NRF_PPI->CH[NRF52_RADIO_PPI_TIMER_START].TEP = (uint32_t)&rfp->timer->TASKS_START;
+    rfp->ppi->CH[NRF52_RADIO_PPI_TIMER_START].EEP = (uint32_t)&rfp->radio->EVENTS_READY;
+    rfp->ppi->CH[NRF52_RADIO_PPI_TIMER_START].TEP = (uint32_t)&rfp->timer->TASKS_START;
 
-    NRF_PPI->CH[NRF52_RADIO_PPI_TIMER_STOP].EEP  = (uint32_t)&NRF_RADIO->EVENTS_ADDRESS;
-    NRF_PPI->CH[NRF52_RADIO_PPI_TIMER_STOP].TEP  = (uint32_t)&rfp->timer->TASKS_STOP;
+    rfp->ppi->CH[NRF52_RADIO_PPI_TIMER_STOP].EEP  = (uint32_t)&rfp->radio->EVENTS_ADDRESS;
+    rfp->ppi->CH[NRF52_RADIO_PPI_TIMER_STOP].TEP  = (uint32_t)&rfp->timer->TASKS_STOP;
 
-    NRF_PPI->CH[NRF52_RADIO_PPI_RX_TIMEOUT].EEP  = (uint32_t)&rfp->timer->EVENTS_COMPARE[0];
-    NRF_PPI->CH[NRF52_RADIO_PPI_RX_TIMEOUT].TEP  = (uint32_t)&NRF_RADIO->TASKS_DISABLE;
+    rfp->ppi->CH[NRF52_RADIO_PPI_RX_TIMEOUT].EEP  = (uint32_t)&rfp->timer->EVENTS_COMPARE[0];
+    rfp->ppi->CH[NRF52_RADIO_PPI_RX_TIMEOUT].TEP  = (uint32_t)&rfp->radio->TASKS_DISABLE;
 
-    NRF_PPI->CH[NRF52_RADIO_PPI_TX_START].EEP    = (uint32_t)&rfp->timer->EVENTS_COMPARE[1];
-    NRF_PPI->CH[NRF52_RADIO_PPI_TX_START].TEP    = (uint32_t)&NRF_RADIO->TASKS_TXEN;
+    rfp->ppi->CH[NRF52_RADIO_PPI_TX_START].EEP    = (uint32_t)&rfp->timer->EVENTS_COMPARE[1];
+    rfp->ppi->CH[NRF52_RADIO_PPI_TX_START].TEP    = (uint32_t)&rfp->radio->TASKS_TXEN;
+
+    rfp->ppi->CH[NRF52_RADIO_PPI_CCA_START].EEP   = (uint32_t)&rfp->timer->EVENTS_COMPARE[1];
+    rfp->ppi->CH[NRF52_RADIO_PPI_CCA_START].TEP   = (uint32_t)&rfp->radio->TASKS_RXEN;
 }
 
 static void set_parameters(RFDriver *rfp) {
@@ -384,49 +389,87 @@ static void set_parameters(RFDriver *rfp) {
     set_bitrate(rfp);
     set_protocol(rfp);
     set_crc(rfp);
-    set_rf_payload_format(rfp, rfp->config.payload_length);
+    rfp->set_rf_payload_format(rfp, rfp->config.payload_length);
 }
 
-static void reset_fifo(void) {
-    tx_fifo.entry_point = 0;
-    tx_fifo.exit_point  = 0;
-    tx_fifo.count       = 0;
+static void reset_fifo(RFDriver *rfp) {
+    rfp->tx_fifo.entry_point = 0;
+    rfp->tx_fifo.exit_point  = 0;
 
-    rx_fifo.entry_point = 0;
-    rx_fifo.exit_point  = 0;
-    rx_fifo.count       = 0;
+    rfp->rx_fifo.entry_point = 0;
+    rfp->rx_fifo.exit_point  = 0;
 }
 
-static void init_fifo(void) {
-    reset_fifo();
+static void init_fifo(RFDriver *rfp) {
+    reset_fifo(rfp);
 
     for (int i = 0; i < NRF52_TX_FIFO_SIZE; i++) {
-        tx_fifo.p_payload[i] = &tx_fifo_payload[i];
+        rfp->tx_fifo.p_frame[i] = &rfp->tx_fifo_frame[i];
     }
 
     for (int i = 0; i < NRF52_RX_FIFO_SIZE; i++) {
-        rx_fifo.p_payload[i] = &rx_fifo_payload[i];
+        rfp->rx_fifo.p_frame[i] = &rfp->rx_fifo_frame[i];
+    }
+
+    rfp->p_rx_buffer = rfp->rx_payload_buffer;
+}
+
+static void tx_fifo_remove_last(RFDriver *rfp) {
+    if (FIFO_COUNT(rfp->tx_fifo) > 0) {
+        // The slot is done with before it is passed back to the writer
+        __DMB();
+        rfp->tx_fifo.exit_point++;
     }
 }
 
-static void tx_fifo_remove_last(void) {
-    if (tx_fifo.count > 0) {
-        nvicDisableVector(RADIO_IRQn);
+// Report the result of the frame leaving the TX FIFO, system locked.
+static void tx_frame_result_i(nrf52_frame_t * p_frame, nrf52_send_status_t status, int8_t rssi) {
+    nrf52_send_result_t result;
 
-        tx_fifo.count--;
-        if (++tx_fifo.exit_point >= NRF52_TX_FIFO_SIZE) {
-            tx_fifo.exit_point = 0;
-        }
+    if (p_frame->cb == NULL)
+        return;
 
-        nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
+    result.status   = status;
+    result.attempts = p_frame->attempts;
+    result.rssi     = rssi;
+    p_frame->cb(p_frame->arg, &result);
+}
+
+// Report the frame result from the state machine.
+static void tx_frame_result(nrf52_frame_t * p_frame, nrf52_send_status_t status, int8_t rssi) {
+#if NRF52_RADIO_USE_ISR_HANDLER
+    chSysLockFromISR();
+    tx_frame_result_i(p_frame, status, rssi);
+    chSysUnlockFromISR();
+#else
+    chSysLock();
+    tx_frame_result_i(p_frame, status, rssi);
+    chSysUnlock();
+#endif
+}
+
+/** @brief  Function to point the RADIO receive DMA to the next free RX FIFO slot.
+ *
+ *  The module receives packets straight into the RX FIFO. If the FIFO is full the
+ *  RADIO receives into rx_payload_buffer and the packet is dropped.
+ */
+static void set_rx_packetptr(RFDriver *rfp) {
+    if (FIFO_COUNT(rfp->rx_fifo) < NRF52_RX_FIFO_SIZE) {
+        // The reader is done with the slot before it advances exit_point
+        __DMB();
+        rfp->p_rx_buffer = RX_FIFO_ENTRY(rfp)->header;
     }
+    else {
+        rfp->p_rx_buffer = rfp->rx_payload_buffer;
+    }
+
+    rfp->radio->PACKETPTR = (uint32_t)rfp->p_rx_buffer;
 }
 
-/** @brief  Function to push the content of the rx_buffer to the RX FIFO.
+/** @brief  Function to commit the received RX FIFO slot.
  *
- *  The module will point the register NRF_RADIO->PACKETPTR to a buffer for receiving packets.
- *  After receiving a packet the module will call this function to copy the received data to
- *  the RX FIFO.
+ *  After receiving a packet into the RX FIFO slot the module will call this function
+ *  to fill the frame info and to pass the slot to the reader.
  *
  *  @param  pipe Pipe number to set for the packet.
  *  @param  pid  Packet ID.
@@ -434,38 +477,41 @@ static void tx_fifo_remove_last(void) {
  *  @retval true   Operation successful.
  *  @retval false  Operation failed.
  */
-static bool rx_fifo_push_rfbuf(RFDriver *rfp, uint8_t pipe, uint8_t pid) {
-    if (rx_fifo.count < NRF52_RX_FIFO_SIZE) {
-        if (rfp->config.protocol == NRF52_PROTOCOL_ESB_DPL) {
-            if (rx_payload_buffer[0] > NRF52_MAX_PAYLOAD_LENGTH) {
-                return false;
-            }
+static bool rx_fifo_commit(RFDriver *rfp, uint8_t pipe, uint8_t pid) {
+    nrf52_frame_t * p_frame;
 
-            rx_fifo.p_payload[rx_fifo.entry_point]->length = rx_payload_buffer[0];
-        }
-        else if (rfp->state == NRF52_STATE_PTX_RX_ACK) {
-            // Received packet is an acknowledgment
-            rx_fifo.p_payload[rx_fifo.entry_point]->length = 0;
-        }
-        else {
-            rx_fifo.p_payload[rx_fifo.entry_point]->length = rfp->config.payload_length;
-        }
+    if (rfp->p_rx_buffer == rfp->rx_payload_buffer) {
+        // Packet was received while the RX FIFO was full
+        rfp->stats.rx_overflows++;
+        return false;
+    }
 
-        memcpy(rx_fifo.p_payload[rx_fifo.entry_point]->data, &rx_payload_buffer[2],
-               rx_fifo.p_payload[rx_fifo.entry_point]->length);
+    p_frame = RX_FIFO_ENTRY(rfp);
 
-        rx_fifo.p_payload[rx_fifo.entry_point]->pipe = pipe;
-        rx_fifo.p_payload[rx_fifo.entry_point]->rssi = NRF_RADIO->RSSISAMPLE;
-        rx_fifo.p_payload[rx_fifo.entry_point]->pid = pid;
-        if (++rx_fifo.entry_point >= NRF52_RX_FIFO_SIZE) {
-            rx_fifo.entry_point = 0;
+    if (rfp->config.protocol == NRF52_PROTOCOL_ESB_DPL) {
+        if (p_frame->header[0] > NRF52_MAX_PAYLOAD_LENGTH) {
+            return false;
         }
-        rx_fifo.count++;
 
-        return true;
+        p_frame->length = p_frame->header[0];
     }
+    else if (rfp->state == NRF52_STATE_PTX_RX_ACK) {
+        // Received packet is an acknowledgment
+        p_frame->length = 0;
+    }
+    else {
+        p_frame->length = rfp->config.payload_length;
+    }
+
+    p_frame->pipe = pipe;
+    p_frame->rssi = rfp->radio->RSSISAMPLE;
+    p_frame->pid = pid;
+
+    // Publish the frame to the reader
+    __DMB();
+    rfp->rx_fifo.entry_point++;
 
-    return false;
+    return true;
 }
 
 static void timer_init(RFDriver *rfp) {
@@ -475,27 +521,28 @@ static void timer_init(RFDriver *rfp) {
     rfp->timer->SHORTS    = TIMER_SHORTS_COMPARE1_CLEAR_Msk | TIMER_SHORTS_COMPARE1_STOP_Msk;
 }
 
-static void start_tx_transaction(RFDriver *rfp) {
-    bool ack;
-
-    rfp->tx_attempt = 1;
-    rfp->tx_remaining = rfp->config.retransmit.count;
+// Start a RADIO task from the timer compare 1 event through the PPI channel.
+static void timer_start_task(RFDriver *rfp, uint16_t delay_us, uint8_t ppi_ch) {
+    rfp->timer->CC[1] = delay_us;
+    rfp->timer->TASKS_CLEAR = 1;
+    rfp->timer->EVENTS_COMPARE[1] = 0;
+    (void)rfp->timer->EVENTS_COMPARE[1];
+    rfp->ppi->CHENSET = (1 << ppi_ch);
+    rfp->timer->TASKS_START = 1;
+}
 
-    // Prepare the payload
-    p_current_payload = tx_fifo.p_payload[tx_fifo.exit_point];
+static void start_tx_frame(RFDriver *rfp, uint16_t delay_us) {
+    bool ack;
 
     // Handling ack if noack is set to false or if selctive auto ack is turned turned off
-    ack = !p_current_payload->noack || !rfp->config.selective_auto_ack;
+    ack = !rfp->p_current_frame->noack || !rfp->config.selective_auto_ack;
 
     switch (rfp->config.protocol) {
         case NRF52_PROTOCOL_ESB:
-            set_rf_payload_format(rfp, p_current_payload->length);
-            tx_payload_buffer[0] = p_current_payload->pid;
-            tx_payload_buffer[1] = 0;
-            memcpy(&tx_payload_buffer[2], p_current_payload->data, p_current_payload->length);
+            rfp->set_rf_payload_format(rfp, rfp->p_current_frame->length);
 
-            NRF_RADIO->SHORTS   = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
-            NRF_RADIO->INTENSET = RADIO_INTENSET_DISABLED_Msk | RADIO_INTENSET_READY_Msk;
+            rfp->radio->SHORTS   = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
+            rfp->radio->INTENSET = RADIO_INTENSET_DISABLED_Msk | RADIO_INTENSET_READY_Msk;
 
             // Configure the retransmit counter
             rfp->tx_remaining = rfp->config.retransmit.count;
@@ -503,51 +550,196 @@ static void start_tx_transaction(RFDriver *rfp) {
             break;
 
         case NRF52_PROTOCOL_ESB_DPL:
-            tx_payload_buffer[0] = p_current_payload->length;
-            tx_payload_buffer[1] = p_current_payload->pid << 1;
-            tx_payload_buffer[1] |= ack ? 0x00 : 0x01;
-            memcpy(&tx_payload_buffer[2], p_current_payload->data, p_current_payload->length);
-
             if (ack) {
-                NRF_RADIO->SHORTS   = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
-                NRF_RADIO->INTENSET = RADIO_INTENSET_DISABLED_Msk | RADIO_INTENSET_READY_Msk;
+                rfp->radio->SHORTS   = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
+                rfp->radio->INTENSET = RADIO_INTENSET_DISABLED_Msk | RADIO_INTENSET_READY_Msk;
 
                 // Configure the retransmit counter
                 rfp->tx_remaining = rfp->config.retransmit.count;
                 rfp->state = NRF52_STATE_PTX_TX_ACK;
             }
             else {
-                NRF_RADIO->SHORTS   = RADIO_SHORTS_COMMON;
-                NRF_RADIO->INTENSET = RADIO_INTENSET_DISABLED_Msk;
+                rfp->radio->SHORTS   = RADIO_SHORTS_COMMON;
+                rfp->radio->INTENSET = RADIO_INTENSET_DISABLED_Msk;
                 rfp->state = NRF52_STATE_PTX_TX;
             }
             break;
     }
 
-    NRF_RADIO->TXADDRESS    = p_current_payload->pipe;
-    NRF_RADIO->RXADDRESSES  = 1 << p_current_payload->pipe;
+    rfp->radio->TXADDRESS    = rfp->p_current_frame->pipe;
+    rfp->radio->RXADDRESSES  = 1 << rfp->p_current_frame->pipe;
+
+    rfp->radio->FREQUENCY    = rfp->config.address.rf_channel;
+    rfp->radio->PACKETPTR    = (uint32_t)rfp->p_current_frame->header;
+
+    rfp->radio->EVENTS_READY = 0;
+    rfp->radio->EVENTS_DISABLED = 0;
+    (void)rfp->radio->EVENTS_READY;
+    (void)rfp->radio->EVENTS_DISABLED;
+
+    if (delay_us > 0) {
+        // The timer starts the TX through the same PPI channel as a retransmit
+        timer_start_task(rfp, delay_us, NRF52_RADIO_PPI_TX_START);
+    }
+    else {
+        rfp->radio->TASKS_TXEN  = 1;
+    }
+}
+
+/** @brief  Function to start the clear channel assessment of the current frame.
+ *
+ *  The RADIO is enabled in RX mode at once or after the delay by the timer. The RSSI
+ *  is sampled for the listen window after READY, the DISABLED event gives the result.
+ *
+ *  @param  delay_us Delay of the RX enable, 0 to enable at once.
+ */
+static void start_cca(RFDriver *rfp, uint16_t delay_us) {
+    rfp->radio->SHORTS   = RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_DISABLED_RSSISTOP_Msk;
+    rfp->radio->INTENCLR = 0xFFFFFFFF;
+    rfp->radio->INTENSET = RADIO_INTENSET_DISABLED_Msk | RADIO_INTENSET_READY_Msk;
+    rfp->state = NRF52_STATE_PTX_CCA;
+
+    // Frames of the other nodes to the same address mark the channel busy as well
+    rfp->radio->RXADDRESSES  = 1 << rfp->p_current_frame->pipe;
+    rfp->radio->FREQUENCY    = rfp->config.address.rf_channel;
+    rfp->radio->PACKETPTR    = (uint32_t)rfp->rx_payload_buffer;
+
+    rfp->radio->EVENTS_READY = 0;
+    rfp->radio->EVENTS_ADDRESS = 0;
+    rfp->radio->EVENTS_DISABLED = 0;
+    (void)rfp->radio->EVENTS_READY;
+    (void)rfp->radio->EVENTS_ADDRESS;
+    (void)rfp->radio->EVENTS_DISABLED;
+
+    if (delay_us > 0) {
+        timer_start_task(rfp, delay_us, NRF52_RADIO_PPI_CCA_START);
+    }
+    else {
+        rfp->radio->TASKS_RXEN  = 1;
+    }
+}
+
+/** @brief  Function to start the HFXO the RADIO runs from.
+ *
+ *  The idle hook releases the HFXO while the module is idle with an empty TX
+ *  FIFO. Queueing a frame starts it again without waiting, it starts up while
+ *  the caller goes on with the next frames.
+ */
+static void hfclk_request(RFDriver *rfp) {
+    if (rfp->clock->HFCLKRUN & CLOCK_HFCLKRUN_STATUS_Msk)
+        return;
+
+    rfp->clock->EVENTS_HFCLKSTARTED = 0;
+    rfp->clock->TASKS_HFCLKSTART = 1;
+}
 
-    NRF_RADIO->FREQUENCY    = rfp->config.address.rf_channel;
-    NRF_RADIO->PACKETPTR    = (uint32_t)tx_payload_buffer;
+/** @brief  Function to wait for the HFXO before a transaction is started.
+ *
+ *  Called from the thread API only, the transactions started by the ISR follow
+ *  one that holds the HFXO already.
+ */
+static void hfclk_wait(RFDriver *rfp) {
+    hfclk_request(rfp);
+    while (!(rfp->clock->HFCLKSTAT & CLOCK_HFCLKSTAT_SRC_Msk));
+}
 
-    NRF_RADIO->EVENTS_READY = 0;
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    (void)NRF_RADIO->EVENTS_READY;
-    (void)NRF_RADIO->EVENTS_DISABLED;
+// Start a round of the current frame transmission and its retransmits.
+static void start_tx_round(RFDriver *rfp) {
+    rfp->tx_attempt = 1;
+    rfp->tx_remaining = rfp->config.retransmit.count;
+    rfp->tx_count++;
 
     nvicClearPending(RADIO_IRQn);
     nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
 
-    NRF_RADIO->TASKS_TXEN  = 1;
+    if (rfp->config.cca.threshold > 0) {
+        rfp->cca_backoffs = 0;
+        start_cca(rfp, rfp->tx_start_delay_us);
+    }
+    else {
+        start_tx_frame(rfp, rfp->tx_start_delay_us);
+    }
+    rfp->tx_start_delay_us = 0;
+}
+
+static void start_tx_transaction(RFDriver *rfp) {
+    rfp->stats.tx_frames++;
+
+    // The frame is transmitted straight from the TX FIFO slot, the barrier
+    // pairs with the one in radio_tx_commit()
+    __DMB();
+    rfp->p_current_frame = TX_FIFO_EXIT(rfp);
+    rfp->p_current_frame->attempts = 0;
+
+    start_tx_round(rfp);
+}
+
+// The receiver is started, sample the RSSI till the timer disables the RADIO
+static void on_radio_ready_cca(RFDriver *rfp) {
+    rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_CCA_START);
+    rfp->radio->TASKS_RSSISTART = 1;
+
+    // The RSSI settles in 15 uS, compare 1 stops the timer after the window
+    rfp->timer->TASKS_STOP = 1;
+    rfp->timer->CC[0] = 16 + rfp->config.cca.window;
+    rfp->timer->CC[1] = 17 + rfp->config.cca.window;
+    rfp->timer->TASKS_CLEAR = 1;
+    rfp->timer->EVENTS_COMPARE[0] = 0;
+    rfp->timer->EVENTS_COMPARE[1] = 0;
+    (void)rfp->timer->EVENTS_COMPARE[0];
+    (void)rfp->timer->EVENTS_COMPARE[1];
+    rfp->ppi->CHENSET = (1 << NRF52_RADIO_PPI_RX_TIMEOUT);
+    rfp->timer->TASKS_START = 1;
+}
+
+static uint32_t cca_random(RFDriver *rfp) {
+    rfp->cca_seed ^= rfp->cca_seed << 13;
+    rfp->cca_seed ^= rfp->cca_seed >> 17;
+    rfp->cca_seed ^= rfp->cca_seed << 5;
+    return rfp->cca_seed;
+}
+
+// The listen window is over, back off while the channel is busy
+static void on_radio_disabled_cca(RFDriver *rfp) {
+    bool busy;
+
+    rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_RX_TIMEOUT);
+    rfp->timer->TASKS_STOP = 1;
+
+    // RSSISAMPLE is -dBm
+    busy = rfp->radio->RSSISAMPLE < rfp->config.cca.threshold || rfp->radio->EVENTS_ADDRESS;
+
+    if (busy) {
+        rfp->stats.cca_busy++;
+
+        if (rfp->cca_backoffs < rfp->config.cca.backoffs) {
+            // Random backoff in a window doubled with each busy channel
+            uint8_t backoff_exp = rfp->cca_backoffs + 1;
+            if (backoff_exp > NRF52_CCA_BACKOFF_EXP_MAX)
+                backoff_exp = NRF52_CCA_BACKOFF_EXP_MAX;
+            uint16_t backoff_us = (1 + (cca_random(rfp) & ((1 << backoff_exp) - 1))) * NRF52_CCA_BACKOFF_US;
+
+            rfp->cca_backoffs++;
+            rfp->stats.cca_backoff_us += backoff_us;
+            start_cca(rfp, backoff_us);
+            return;
+        }
+        rfp->stats.cca_forced++;
+    }
+
+    rfp->radio->INTENCLR = RADIO_INTENCLR_READY_Msk;
+    start_tx_frame(rfp, 0);
 }
 
 static void on_radio_disabled_tx_noack(RFDriver *rfp) {
     rfp->flags |= NRF52_INT_TX_SUCCESS_MSK;
-    tx_fifo_remove_last();
+    rfp->p_current_frame->attempts = 1;
+    tx_frame_result(rfp->p_current_frame, NRF52_SEND_OK, 0);
+    tx_fifo_remove_last(rfp);
 
-	chBSemSignal(&events_sem);
+	signal_events(rfp);
 
-	if (tx_fifo.count == 0) {
+	if (FIFO_COUNT(rfp->tx_fifo) == 0) {
         rfp->state = NRF52_STATE_IDLE;
     }
     else {
@@ -558,12 +750,12 @@ static void on_radio_disabled_tx_noack(RFDriver *rfp) {
 static void on_radio_disabled_tx(RFDriver *rfp) {
     // Remove the DISABLED -> RXEN shortcut, to make sure the radio stays
     // disabled after the RX window
-    NRF_RADIO->SHORTS = RADIO_SHORTS_COMMON;
+    rfp->radio->SHORTS = RADIO_SHORTS_COMMON;
 
     // Make sure the timer is started the next time the radio is ready,
     // and that it will disable the radio automatically if no packet is
     // received by the time defined in m_wait_for_ack_timeout_us
-    rfp->timer->CC[0]    = wait_for_ack_timeout_us + 130;
+    rfp->timer->CC[0]    = rfp->wait_for_ack_timeout_us + 130;
     rfp->timer->CC[1]    = rfp->config.retransmit.delay - 130;
     rfp->timer->TASKS_CLEAR = 1;
     rfp->timer->EVENTS_COMPARE[0] = 0;
@@ -571,19 +763,19 @@ static void on_radio_disabled_tx(RFDriver *rfp) {
     (void)rfp->timer->EVENTS_COMPARE[0];
     (void)rfp->timer->EVENTS_COMPARE[1];
 
-    NRF_PPI->CHENSET = (1 << NRF52_RADIO_PPI_TIMER_START) |
+    rfp->ppi->CHENSET = (1 << NRF52_RADIO_PPI_TIMER_START) |
                        (1 << NRF52_RADIO_PPI_RX_TIMEOUT) |
                        (1 << NRF52_RADIO_PPI_TIMER_STOP);
-    NRF_PPI->CHENCLR = (1 << NRF52_RADIO_PPI_TX_START);
+    rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_TX_START);
 
-    NRF_RADIO->EVENTS_END = 0;
-    (void)NRF_RADIO->EVENTS_END;
+    rfp->radio->EVENTS_END = 0;
+    (void)rfp->radio->EVENTS_END;
 
     if (rfp->config.protocol == NRF52_PROTOCOL_ESB) {
-        set_rf_payload_format(rfp, 0);
+        rfp->set_rf_payload_format(rfp, 0);
     }
 
-    NRF_RADIO->PACKETPTR = (uint32_t)rx_payload_buffer;
+    set_rx_packetptr(rfp);
     rfp->state = NRF52_STATE_PTX_RX_ACK;
 }
 
@@ -591,28 +783,31 @@ static void on_radio_disabled_tx_wait_for_ack(RFDriver *rfp) {
     // This marks the completion of a TX_RX sequence (TX with ACK)
 
     // Make sure the timer will not deactivate the radio if a packet is received
-    NRF_PPI->CHENCLR = (1 << NRF52_RADIO_PPI_TIMER_START) |
+    rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_TIMER_START) |
                        (1 << NRF52_RADIO_PPI_RX_TIMEOUT)  |
                        (1 << NRF52_RADIO_PPI_TIMER_STOP);
 
     // If the radio has received a packet and the CRC status is OK
-    if (NRF_RADIO->EVENTS_END && NRF_RADIO->CRCSTATUS != 0) {
+    if (rfp->radio->EVENTS_END && rfp->radio->CRCSTATUS != 0) {
         rfp->timer->TASKS_STOP = 1;
-        NRF_PPI->CHENCLR = (1 << NRF52_RADIO_PPI_TX_START);
+        rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_TX_START);
         rfp->flags |= NRF52_INT_TX_SUCCESS_MSK;
         rfp->tx_attempt++;// = rfp->config.retransmit.count - rfp->tx_remaining + 1;
+        rssi_hist_add(rfp);
 
-        tx_fifo_remove_last();
+        rfp->p_current_frame->attempts += rfp->config.retransmit.count - rfp->tx_remaining + 1;
+        tx_frame_result(rfp->p_current_frame, NRF52_SEND_OK, rfp->radio->RSSISAMPLE);
+        tx_fifo_remove_last(rfp);
 
-        if (rfp->config.protocol != NRF52_PROTOCOL_ESB && rx_payload_buffer[0] > 0) {
-            if (rx_fifo_push_rfbuf(rfp, (uint8_t)NRF_RADIO->TXADDRESS, 0)) {
+        if (rfp->config.protocol != NRF52_PROTOCOL_ESB && rfp->p_rx_buffer[0] > 0) {
+            if (rx_fifo_commit(rfp, (uint8_t)rfp->radio->TXADDRESS, 0)) {
                 rfp->flags |= NRF52_INT_RX_DR_MSK;
             }
         }
 
-    	chBSemSignal(&events_sem);
+    	signal_events(rfp);
 
-        if ((tx_fifo.count == 0) || (rfp->config.tx_mode == NRF52_TXMODE_MANUAL)) {
+        if ((FIFO_COUNT(rfp->tx_fifo) == 0) || (rfp->config.tx_mode == NRF52_TXMODE_MANUAL)) {
             rfp->state = NRF52_STATE_IDLE;
         }
         else {
@@ -622,96 +817,159 @@ static void on_radio_disabled_tx_wait_for_ack(RFDriver *rfp) {
     else {
         if (rfp->tx_remaining-- == 0) {
             rfp->timer->TASKS_STOP = 1;
-            NRF_PPI->CHENCLR = (1 << NRF52_RADIO_PPI_TX_START);
-            // All retransmits are expended, and the TX operation is suspended
+            rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_TX_START);
             rfp->tx_attempt = rfp->config.retransmit.count + 1;
+            rfp->p_current_frame->attempts += rfp->config.retransmit.count + 1;
+
+            if (rfp->p_current_frame->cb != NULL &&
+                chTimeIsInRangeX(chVTGetSystemTimeX(), rfp->p_current_frame->queued, rfp->p_current_frame->deadline)) {
+                // Another round after the retransmit delay, the deadline is not passed
+                rfp->stats.tx_retries++;
+                rfp->tx_start_delay_us = rfp->config.retransmit.delay;
+                start_tx_round(rfp);
+                return;
+            }
+
             rfp->flags |= NRF52_INT_TX_FAILED_MSK;
+            rfp->stats.tx_failed++;
+
+            if (rfp->p_current_frame->cb != NULL) {
+                // The frame is dropped and the next one goes on
+                tx_frame_result(rfp->p_current_frame, NRF52_SEND_TIMEOUT, 0);
+                tx_fifo_remove_last(rfp);
 
-            chBSemSignal(&events_sem);
+                signal_events(rfp);
+
+                if ((FIFO_COUNT(rfp->tx_fifo) == 0) || (rfp->config.tx_mode == NRF52_TXMODE_MANUAL)) {
+                    rfp->state = NRF52_STATE_IDLE;
+                }
+                else {
+                    start_tx_transaction(rfp);
+                }
+                return;
+            }
+
+            // All retransmits are expended, and the TX operation is suspended
+            signal_events(rfp);
 
             rfp->state = NRF52_STATE_IDLE;
         }
         else {
             // There are still have more retransmits left, TX mode should be
             // entered again as soon as the system timer reaches CC[1].
-            NRF_RADIO->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
-            set_rf_payload_format(rfp, p_current_payload->length);
-            NRF_RADIO->PACKETPTR = (uint32_t)tx_payload_buffer;
+            rfp->radio->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
+            rfp->set_rf_payload_format(rfp, rfp->p_current_frame->length);
+            rfp->radio->PACKETPTR = (uint32_t)rfp->p_current_frame->header;
             rfp->state = NRF52_STATE_PTX_TX_ACK;
+            rfp->tx_count++;
+            rfp->stats.tx_retransmits++;
             rfp->timer->TASKS_START = 1;
-            NRF_PPI->CHENSET = (1 << NRF52_RADIO_PPI_TX_START);
+            rfp->ppi->CHENSET = (1 << NRF52_RADIO_PPI_TX_START);
             if (rfp->timer->EVENTS_COMPARE[1])
-                NRF_RADIO->TASKS_TXEN = 1;
+                rfp->radio->TASKS_TXEN = 1;
         }
     }
 }
 
 static void clear_events_restart_rx(RFDriver *rfp) {
-    NRF_RADIO->SHORTS = RADIO_SHORTS_COMMON;
-    set_rf_payload_format(rfp, rfp->config.payload_length);
-    NRF_RADIO->PACKETPTR = (uint32_t)rx_payload_buffer;
+    // Cancel the ACK ramp up, the short enables RX again on the DISABLED event
+    rfp->radio->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
+    rfp->set_rf_payload_format(rfp, rfp->config.payload_length);
+    set_rx_packetptr(rfp);
 
-    NRF_RADIO->INTENCLR = RADIO_INTENCLR_DISABLED_Msk;
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    (void) NRF_RADIO->EVENTS_DISABLED;
+    rfp->state = NRF52_STATE_PRX_RESTART;
+    rfp->radio->TASKS_DISABLE = 1;
+}
 
-    NRF_RADIO->TASKS_DISABLE = 1;
-    while (NRF_RADIO->EVENTS_DISABLED == 0);
+static void on_radio_disabled_rx_restart(RFDriver *rfp) {
+    // The RADIO is ramping up for RX, the next packet is acknowledged again
+    rfp->radio->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_TXEN_Msk;
+    rfp->state = NRF52_STATE_PRX;
+}
 
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    (void) NRF_RADIO->EVENTS_DISABLED;
-    NRF_RADIO->INTENSET = RADIO_INTENSET_DISABLED_Msk;
+// RX stopped or a transaction cancelled, radio_wait_idle() goes on
+static void on_radio_disabled_rx_stop(RFDriver *rfp) {
+    rfp->radio->INTENCLR = 0xFFFFFFFF;
+    rfp->state = NRF52_STATE_IDLE;
 
-    NRF_RADIO->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_TXEN_Msk;
-    NRF_RADIO->TASKS_RXEN = 1;
+#if NRF52_RADIO_USE_ISR_HANDLER
+    chSysLockFromISR();
+    chBSemSignalI(&rfp->idle_sem);
+    chSysUnlockFromISR();
+#else
+    chBSemSignal(&rfp->idle_sem);
+#endif
 }
 
 static void on_radio_disabled_rx(RFDriver *rfp) {
     bool            ack                = false;
     bool            retransmit_payload = false;
     bool            send_rx_event      = true;
-    pipe_info_t *   p_pipe_info;
+    nrf52_pipe_info_t * p_pipe_info;
+    uint8_t *       p_buf              = rfp->p_rx_buffer;
 
-    if (NRF_RADIO->CRCSTATUS == 0) {
+    if (rfp->radio->CRCSTATUS == 0) {
+        rfp->stats.rx_crc_errors++;
         clear_events_restart_rx(rfp);
         return;
     }
 
-    if(rx_fifo.count >= NRF52_RX_FIFO_SIZE) {
+    rssi_hist_add(rfp);
+
+    if (p_buf == rfp->rx_payload_buffer) {
+        // RX FIFO is full
+        rfp->stats.rx_overflows++;
         clear_events_restart_rx(rfp);
         return;
     }
 
-    p_pipe_info = &rx_pipe_info[NRF_RADIO->RXMATCH];
-    if (NRF_RADIO->RXCRC           == p_pipe_info->m_crc &&
-       (rx_payload_buffer[1] >> 1) == p_pipe_info->m_pid  ) {
+    p_pipe_info = &rfp->rx_pipe_info[rfp->radio->RXMATCH];
+    if (rfp->radio->RXCRC  == p_pipe_info->m_crc &&
+       (p_buf[1] >> 1)    == p_pipe_info->m_pid  ) {
         retransmit_payload = true;
         send_rx_event = false;
+        rfp->stats.rx_duplicates++;
     }
 
-    p_pipe_info->m_pid = rx_payload_buffer[1] >> 1;
-    p_pipe_info->m_crc = NRF_RADIO->RXCRC;
+    p_pipe_info->m_pid = p_buf[1] >> 1;
+    p_pipe_info->m_crc = rfp->radio->RXCRC;
+
+    if (send_rx_event) {
+        // Commit the new packet to the RX FIFO before the RADIO gets the next
+        // slot and trigger a received event if the operation was successful.
+        if (rx_fifo_commit(rfp, rfp->radio->RXMATCH, p_pipe_info->m_pid)) {
+            rfp->flags |= NRF52_INT_RX_DR_MSK;
+        }
+        else {
+            send_rx_event = false;
+        }
+    }
 
-    if(rfp->config.selective_auto_ack == false || ((rx_payload_buffer[1] & 0x01) == 0))
+    if(rfp->config.selective_auto_ack == false || ((p_buf[1] & 0x01) == 0))
         ack = true;
 
     if(ack) {
-        NRF_RADIO->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
+        rfp->radio->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_RXEN_Msk;
 
         switch(rfp->config.protocol) {
             case NRF52_PROTOCOL_ESB_DPL:
                 {
-                    if (tx_fifo.count > 0 &&
-                        (tx_fifo.p_payload[tx_fifo.exit_point]->pipe == NRF_RADIO->RXMATCH))
+                    nrf52_frame_t * p_ack_frame = NULL;
+
+                    if (FIFO_COUNT(rfp->tx_fifo) > 0) {
+                        __DMB();
+                        p_ack_frame = TX_FIFO_EXIT(rfp);
+                    }
+
+                    if (p_ack_frame != NULL &&
+                        (p_ack_frame->pipe == rfp->radio->RXMATCH))
                     {
                         // Pipe stays in ACK with payload until TX fifo is empty
                         // Do not report TX success on first ack payload or retransmit
                         if (p_pipe_info->m_ack_payload != 0 && !retransmit_payload) {
-                            if(++tx_fifo.exit_point >= NRF52_TX_FIFO_SIZE) {
-                                tx_fifo.exit_point = 0;
-                            }
-
-                            tx_fifo.count--;
+                            TX_FIFO_EXIT(rfp)->attempts = 1;
+                            tx_frame_result(TX_FIFO_EXIT(rfp), NRF52_SEND_OK, 0);
+                            tx_fifo_remove_last(rfp);
 
                             // ACK payloads also require TX_DS
                             // (page 40 of the 'nRF24LE1_Product_Specification_rev1_6.pdf').
@@ -720,99 +978,95 @@ static void on_radio_disabled_rx(RFDriver *rfp) {
 
                         p_pipe_info->m_ack_payload = 1;
 
-                        p_current_payload = tx_fifo.p_payload[tx_fifo.exit_point];
+                        // The ACK payload is sent straight from the TX FIFO slot
+                        rfp->p_current_frame = TX_FIFO_EXIT(rfp);
 
-                        set_rf_payload_format(rfp, p_current_payload->length);
-                        tx_payload_buffer[0] = p_current_payload->length;
-                        memcpy(&tx_payload_buffer[2],
-                               p_current_payload->data,
-                               p_current_payload->length);
+                        rfp->set_rf_payload_format(rfp, rfp->p_current_frame->length);
+                        rfp->p_current_frame->header[1] = p_buf[1];
+                        rfp->radio->PACKETPTR = (uint32_t)rfp->p_current_frame->header;
                     }
                     else {
                         p_pipe_info->m_ack_payload = 0;
-                        set_rf_payload_format(rfp, 0);
-                        tx_payload_buffer[0] = 0;
+                        rfp->set_rf_payload_format(rfp, 0);
+                        rfp->tx_payload_buffer[0] = 0;
+                        rfp->tx_payload_buffer[1] = p_buf[1];
+                        rfp->radio->PACKETPTR = (uint32_t)rfp->tx_payload_buffer;
                     }
-
-                    tx_payload_buffer[1] = rx_payload_buffer[1];
                 }
                 break;
 
             case NRF52_PROTOCOL_ESB:
                 {
-                    set_rf_payload_format(rfp, 0);
-                    tx_payload_buffer[0] = rx_payload_buffer[0];
-                    tx_payload_buffer[1] = 0;
+                    rfp->set_rf_payload_format(rfp, 0);
+                    rfp->tx_payload_buffer[0] = p_buf[0];
+                    rfp->tx_payload_buffer[1] = 0;
+                    rfp->radio->PACKETPTR = (uint32_t)rfp->tx_payload_buffer;
                 }
                 break;
         }
 
         rfp->state = NRF52_STATE_PRX_SEND_ACK;
-        NRF_RADIO->TXADDRESS = NRF_RADIO->RXMATCH;
-        NRF_RADIO->PACKETPTR = (uint32_t)tx_payload_buffer;
+        rfp->radio->TXADDRESS = rfp->radio->RXMATCH;
     }
     else {
         clear_events_restart_rx(rfp);
     }
 
     if (send_rx_event) {
-        // Push the new packet to the RX buffer and trigger a received event if the operation was
-        // successful.
-        if (rx_fifo_push_rfbuf(rfp, NRF_RADIO->RXMATCH, p_pipe_info->m_pid)) {
-            rfp->flags |= NRF52_INT_RX_DR_MSK;
-            chBSemSignal(&events_sem);
-        }
+        signal_events(rfp);
     }
 }
 
 static void on_radio_disabled_rx_ack(RFDriver *rfp) {
-    NRF_RADIO->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_TXEN_Msk;
-    set_rf_payload_format(rfp, rfp->config.payload_length);
+    rfp->radio->SHORTS = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_TXEN_Msk;
+    rfp->set_rf_payload_format(rfp, rfp->config.payload_length);
 
-    NRF_RADIO->PACKETPTR = (uint32_t)rx_payload_buffer;
+    set_rx_packetptr(rfp);
 
     rfp->state = NRF52_STATE_PRX;
 }
 
-nrf52_error_t radio_disable(void) {
+nrf52_error_t radio_disable(RFDriver *rfp) {
     // Clear PPI
-    NRF_PPI->CHENCLR = (1 << NRF52_RADIO_PPI_TIMER_START) |
+    rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_TIMER_START) |
                        (1 << NRF52_RADIO_PPI_TIMER_STOP)  |
                        (1 << NRF52_RADIO_PPI_RX_TIMEOUT)  |
-					   (1 << NRF52_RADIO_PPI_TX_START);
+					   (1 << NRF52_RADIO_PPI_TX_START)    |
+					   (1 << NRF52_RADIO_PPI_CCA_START);
 
-	NRF_RADIO->SHORTS = 0;
-	NRF_RADIO->INTENCLR = 0xFFFFFFFF;
+	rfp->radio->SHORTS = 0;
+	rfp->radio->INTENCLR = 0xFFFFFFFF;
 
     nvicDisableVector(RADIO_IRQn);
 
-    RFD1.timer->TASKS_SHUTDOWN = 1;
+    rfp->timer->TASKS_SHUTDOWN = 1;
+
+	rfp->radio->TASKS_DISABLE = 1;
 
-	NRF_RADIO->TASKS_DISABLE = 1;
+	rfp->radio->POWER = 0;
+	(void)rfp->radio->POWER;
 
-	NRF_RADIO->POWER = 0;
-	(void)NRF_RADIO->POWER;
+    // The peripherals run from HFINT till the next transaction
+    rfp->clock->TASKS_HFCLKSTOP = 1;
 
-	RFD1.state = NRF52_STATE_IDLE;
+	rfp->state = NRF52_STATE_IDLE;
 
+#if !NRF52_RADIO_USE_ISR_HANDLER
     // Terminate interrupts handle thread
-    chThdTerminate(rfIntThread_p);
-    chBSemSignal(&disable_sem);
-    chThdWait(rfIntThread_p);
+    chThdTerminate(rfp->int_thread);
+    chBSemSignal(&rfp->disable_sem);
+    chThdWait(rfp->int_thread);
+#endif
 
-    // Terminate events handle thread
-    chThdTerminate(rfEvtThread_p);
-    RFD1.flags = 0;
-    chBSemSignal(&events_sem);
-    chThdWait(rfEvtThread_p);
+    rfp->flags = 0;
 
-    RFD1.state = NRF52_STATE_UNINIT;
+    rfp->state = NRF52_STATE_UNINIT;
 
     return NRF52_SUCCESS;
 }
 
 //
-nrf52_error_t radio_init(nrf52_config_t const *config) {
+nrf52_error_t radio_init(RFDriver *rfp, nrf52_config_t const *config) {
 	osalDbgAssert(config != NULL,
 		"config must be defined");
 	osalDbgAssert(&config->address != NULL,
@@ -820,293 +1074,633 @@ nrf52_error_t radio_init(nrf52_config_t const *config) {
 	osalDbgAssert(NRF52_RADIO_IRQ_PRIORITY <= 7,
 		"wrong radio irq priority");
 
-    if (RFD1.state != NRF52_STATE_UNINIT) {
-    	nrf52_error_t err = radio_disable();
+    if (rfp->state != NRF52_STATE_UNINIT) {
+    	nrf52_error_t err = radio_disable(rfp);
         if (err != NRF52_SUCCESS)
             return err;
     }
 
-    RFD1.radio = NRF_RADIO;
-	RFD1.config = *config;
-    RFD1.flags    = 0;
-
-    init_fifo();
-
+    // RFD1 runs on the chip peripherals, the other instances get theirs from
+    // the caller before the first radio_init()
+    if (rfp->radio == NULL) {
+        rfp->radio = NRF_RADIO;
+        rfp->ppi   = NRF_PPI;
+        rfp->clock = NRF_CLOCK;
+        rfp->ficr  = NRF_FICR;
 #if NRF52_RADIO_USE_TIMER0
-    RFD1.timer = NRF_TIMER0;
+        rfp->timer = NRF_TIMER0;
 #endif
 #if NRF52_RADIO_USE_TIMER1
-    RFD1.timer = NRF_TIMER1;
+        rfp->timer = NRF_TIMER1;
 #endif
 #if NRF52_RADIO_USE_TIMER2
-    RFD1.timer = NRF_TIMER2;
+        rfp->timer = NRF_TIMER2;
 #endif
 #if NRF52_RADIO_USE_TIMER3
-    RFD1.timer = NRF_TIMER3;
+        rfp->timer = NRF_TIMER3;
 #endif
 #if NRF52_RADIO_USE_TIMER4
-    RFD1.timer = NRF_TIMER4;
+        rfp->timer = NRF_TIMER4;
 #endif
+    }
 
-    set_parameters(&RFD1);
+	rfp->config = *config;
 
-    set_addresses(&RFD1, NRF52_ADDR_UPDATE_MASK_BASE0);
-    set_addresses(&RFD1, NRF52_ADDR_UPDATE_MASK_BASE1);
-    set_addresses(&RFD1, NRF52_ADDR_UPDATE_MASK_PREFIX);
+    // Powered off by radio_disable()
+    rfp->radio->POWER = 1;
+    rfp->flags    = 0;
+    rfp->tx_count = 0;
+    rfp->tx_start_delay_us = 0;
+    rfp->cca_seed = rfp->ficr->DEVICEID[0] | 1;
+    memset(&rfp->stats, 0, sizeof(rfp->stats));
+    memset(rfp->pids, 0, sizeof(rfp->pids));
+    memset(rfp->rx_pipe_info, 0, sizeof(rfp->rx_pipe_info));
 
-    ppi_init(&RFD1);
-    timer_init(&RFD1);
+    init_fifo(rfp);
 
-    chBSemObjectInit(&disable_sem, TRUE);
-    chBSemObjectInit(&events_sem, TRUE);
+    set_parameters(rfp);
 
-    chEvtObjectInit(&RFD1.eventsrc);
+    set_addresses(rfp, NRF52_ADDR_UPDATE_MASK_BASE0);
+    set_addresses(rfp, NRF52_ADDR_UPDATE_MASK_BASE1);
+    set_addresses(rfp, NRF52_ADDR_UPDATE_MASK_PREFIX);
 
-    // interrupt handle thread
-    rfIntThread_p = chThdCreateStatic(waRFIntThread, sizeof(waRFIntThread),
-    		NRF52_RADIO_INTTHD_PRIORITY, rfIntThread, NULL);
+    ppi_init(rfp);
+    timer_init(rfp);
 
-    // events handle thread
-    rfEvtThread_p = chThdCreateStatic(waRFEvtThread, sizeof(waRFEvtThread),
-    		NRF52_RADIO_EVTTHD_PRIORITY, rfEvtThread, NULL);
+#if NRF52_RADIO_MEASURE_LATENCY
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    rfp->latency_last = 0;
+    rfp->latency_max  = 0;
+#endif
+
+    chEvtObjectInit(&rfp->eventsrc);
+    chBSemObjectInit(&rfp->idle_sem, TRUE);
+
+#if !NRF52_RADIO_USE_ISR_HANDLER
+    chBSemObjectInit(&rfp->disable_sem, TRUE);
+
+    // interrupt handle thread
+    rfp->int_thread = chThdCreateStatic(rfp->wa_int_thread, sizeof(rfp->wa_int_thread),
+    		NRF52_RADIO_INTTHD_PRIORITY, rfIntThread, rfp);
+#endif
 
     nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
 
-    RFD1.state = NRF52_STATE_IDLE;
+    rfp->state = NRF52_STATE_IDLE;
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_write_payload(nrf52_payload_t const * p_payload) {
-    if (RFD1.state == NRF52_STATE_UNINIT)
-    	return NRF52_INVALID_STATE;
+nrf52_error_t radio_write_payload(RFDriver *rfp, nrf52_payload_t const * p_payload) {
+    nrf52_frame_t * p_frame;
+    nrf52_error_t   err;
+
     if(p_payload == NULL)
     	return NRF52_ERROR_NULL;
     VERIFY_PAYLOAD_LENGTH(p_payload);
-    if (tx_fifo.count >= NRF52_TX_FIFO_SIZE)
+
+    err = radio_tx_reserve(rfp, &p_frame);
+    if (err != NRF52_SUCCESS)
+        return err;
+
+    p_frame->pipe   = p_payload->pipe;
+    p_frame->length = p_payload->length;
+    p_frame->noack  = p_payload->noack;
+    memcpy(p_frame->data, p_payload->data, p_payload->length);
+
+    return radio_tx_commit(rfp);
+}
+
+/**@brief Queue a frame with a completion callback.
+ *
+ * @details The frame is retransmitted in rounds of retransmit.count retransmits
+ *          till it is acknowledged or a round fails after the deadline, then the
+ *          callback gets the result. Frames are queued without waiting for the
+ *          results of the previous ones.
+ *
+ * @param[in]   p_payload   Frame to send.
+ * @param[in]   deadline    System time after which no new round is started.
+ * @param[in]   cb          Result callback.
+ * @param[in]   arg         Result callback argument.
+ */
+nrf52_error_t radio_send(RFDriver *rfp, nrf52_payload_t const * p_payload, systime_t deadline, nrf52_send_cb_t cb, void * arg) {
+    nrf52_frame_t * p_frame;
+    nrf52_error_t   err;
+
+    if (p_payload == NULL || cb == NULL)
+    	return NRF52_ERROR_NULL;
+    VERIFY_PAYLOAD_LENGTH(p_payload);
+
+    err = radio_tx_reserve(rfp, &p_frame);
+    if (err != NRF52_SUCCESS)
+        return err;
+
+    p_frame->pipe     = p_payload->pipe;
+    p_frame->length   = p_payload->length;
+    p_frame->noack    = p_payload->noack;
+    p_frame->deadline = deadline;
+    p_frame->cb       = cb;
+    p_frame->arg      = arg;
+    memcpy(p_frame->data, p_payload->data, p_payload->length);
+
+    return radio_tx_commit(rfp);
+}
+
+/**@brief Get the next free TX FIFO slot to build a frame in place.
+ *
+ * @details The caller fills pipe, length, noack and data, the frame is queued
+ *          by radio_tx_commit(). The RADIO transmits straight from the slot.
+ *          Setting deadline, cb and arg gives the frame the radio_send() retransmit
+ *          rounds and result.
+ */
+nrf52_error_t radio_tx_reserve(RFDriver *rfp, nrf52_frame_t ** pp_frame) {
+    if (rfp->state == NRF52_STATE_UNINIT)
+    	return NRF52_INVALID_STATE;
+    if (pp_frame == NULL)
+    	return NRF52_ERROR_NULL;
+    if (FIFO_COUNT(rfp->tx_fifo) >= NRF52_TX_FIFO_SIZE)
     	return NRF52_ERROR_INVALID_LENGTH;
 
-    if (RFD1.config.mode == NRF52_MODE_PTX &&
-        p_payload->noack && !RFD1.config.selective_auto_ack )
+    // The state machine is done with the slot before it advances exit_point,
+    // the slot may still point to a frame queued by radio_tx_queue()
+    __DMB();
+    TX_FIFO_ENTRY(rfp) = &rfp->tx_fifo_frame[rfp->tx_fifo.entry_point & (NRF52_TX_FIFO_SIZE - 1)];
+    *pp_frame = TX_FIFO_ENTRY(rfp);
+    (*pp_frame)->cb = NULL;
+
+    return NRF52_SUCCESS;
+}
+
+/**@brief Queue a frame owned by the caller.
+ *
+ * @details The TX FIFO keeps the pointer only, the RADIO transmits straight from
+ *          the frame. The frame is left untouched till the result callback, which
+ *          hands it back to the caller.
+ */
+nrf52_error_t radio_tx_queue(RFDriver *rfp, nrf52_frame_t * p_frame) {
+    if (rfp->state == NRF52_STATE_UNINIT)
+    	return NRF52_INVALID_STATE;
+    if (p_frame == NULL || p_frame->cb == NULL)
+    	return NRF52_ERROR_NULL;
+    if (FIFO_COUNT(rfp->tx_fifo) >= NRF52_TX_FIFO_SIZE)
+    	return NRF52_ERROR_INVALID_LENGTH;
+
+    __DMB();
+    TX_FIFO_ENTRY(rfp) = p_frame;
+
+    return radio_tx_commit(rfp);
+}
+
+/**@brief Queue the frame built in the slot given by radio_tx_reserve(). */
+nrf52_error_t radio_tx_commit(RFDriver *rfp) {
+    nrf52_frame_t * p_frame;
+    bool            ack;
+
+    if (rfp->state == NRF52_STATE_UNINIT)
+    	return NRF52_INVALID_STATE;
+    if (FIFO_COUNT(rfp->tx_fifo) >= NRF52_TX_FIFO_SIZE)
+    	return NRF52_ERROR_INVALID_LENGTH;
+
+    p_frame = TX_FIFO_ENTRY(rfp);
+    VERIFY_PAYLOAD_LENGTH(p_frame);
+
+    if (rfp->config.mode == NRF52_MODE_PTX &&
+        p_frame->noack && !rfp->config.selective_auto_ack )
     {
         return NRF52_ERROR_NOT_SUPPORTED;
     }
 
-    nvicDisableVector(RADIO_IRQn);
-
-    memcpy(tx_fifo.p_payload[tx_fifo.entry_point], p_payload, sizeof(nrf52_payload_t));
+    rfp->pids[p_frame->pipe] = (rfp->pids[p_frame->pipe] + 1) % (NRF52_PID_MAX + 1);
+    p_frame->pid = rfp->pids[p_frame->pipe];
+    p_frame->queued = chVTGetSystemTimeX();
 
-    pids[p_payload->pipe] = (pids[p_payload->pipe] + 1) % (NRF52_PID_MAX + 1);
-    tx_fifo.p_payload[tx_fifo.entry_point]->pid = pids[p_payload->pipe];
+    // Prepare the on-air header
+    switch (rfp->config.protocol) {
+        case NRF52_PROTOCOL_ESB:
+            p_frame->header[0] = p_frame->pid;
+            p_frame->header[1] = 0;
+            break;
 
-    if (++tx_fifo.entry_point >= NRF52_TX_FIFO_SIZE) {
-        tx_fifo.entry_point = 0;
+        case NRF52_PROTOCOL_ESB_DPL:
+            ack = !p_frame->noack || !rfp->config.selective_auto_ack;
+            p_frame->header[0] = p_frame->length;
+            p_frame->header[1] = p_frame->pid << 1;
+            p_frame->header[1] |= ack ? 0x00 : 0x01;
+            break;
     }
 
-    tx_fifo.count++;
-
-    nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
+    // Publish the frame to the state machine
+    __DMB();
+    rfp->tx_fifo.entry_point++;
+    hfclk_request(rfp);
 
-    if (RFD1.config.mode == NRF52_MODE_PTX &&
-        RFD1.config.tx_mode == NRF52_TXMODE_AUTO &&
-        RFD1.state == NRF52_STATE_IDLE)
+    if (rfp->config.mode == NRF52_MODE_PTX &&
+        rfp->config.tx_mode == NRF52_TXMODE_AUTO &&
+        rfp->state == NRF52_STATE_IDLE)
     {
-        start_tx_transaction(&RFD1);
+        hfclk_wait(rfp);
+        start_tx_transaction(rfp);
     }
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_read_rx_payload(nrf52_payload_t * p_payload) {
-    if (RFD1.state == NRF52_STATE_UNINIT)
-    	return NRF52_INVALID_STATE;
+nrf52_error_t radio_read_rx_payload(RFDriver *rfp, nrf52_payload_t * p_payload) {
+    nrf52_frame_t * p_frame;
+    nrf52_error_t   err;
+
     if (p_payload == NULL)
     	return NRF52_ERROR_NULL;
 
-    if (rx_fifo.count == 0) {
+    err = radio_rx_acquire(rfp, &p_frame);
+    if (err != NRF52_SUCCESS)
+        return err;
+
+    p_payload->length = p_frame->length;
+    p_payload->pipe   = p_frame->pipe;
+    p_payload->rssi   = p_frame->rssi;
+    p_payload->pid    = p_frame->pid;
+    memcpy(p_payload->data, p_frame->data, p_payload->length);
+
+    return radio_rx_release(rfp);
+}
+
+/**@brief Borrow the oldest received frame without copying it.
+ *
+ * @details The frame stays in the RX FIFO and can be parsed in place until
+ *          radio_rx_release() is called.
+ */
+nrf52_error_t radio_rx_acquire(RFDriver *rfp, nrf52_frame_t ** pp_frame) {
+    if (rfp->state == NRF52_STATE_UNINIT)
+    	return NRF52_INVALID_STATE;
+    if (pp_frame == NULL)
+    	return NRF52_ERROR_NULL;
+
+    if (FIFO_COUNT(rfp->rx_fifo) == 0) {
         return NRF52_ERROR_INVALID_LENGTH;
     }
 
-    nvicDisableVector(RADIO_IRQn);
+    // Pairs with the barrier in rx_fifo_commit()
+    __DMB();
+    *pp_frame = RX_FIFO_EXIT(rfp);
 
-    p_payload->length = rx_fifo.p_payload[rx_fifo.exit_point]->length;
-    p_payload->pipe   = rx_fifo.p_payload[rx_fifo.exit_point]->pipe;
-    p_payload->rssi   = rx_fifo.p_payload[rx_fifo.exit_point]->rssi;
-    p_payload->pid    = rx_fifo.p_payload[rx_fifo.exit_point]->pid;
-    memcpy(p_payload->data, rx_fifo.p_payload[rx_fifo.exit_point]->data, p_payload->length);
+    return NRF52_SUCCESS;
+}
+
+/**@brief Return the frame borrowed by radio_rx_acquire() to the RX FIFO. */
+nrf52_error_t radio_rx_release(RFDriver *rfp) {
+    if (rfp->state == NRF52_STATE_UNINIT)
+    	return NRF52_INVALID_STATE;
 
-    if (++rx_fifo.exit_point >= NRF52_RX_FIFO_SIZE) {
-        rx_fifo.exit_point = 0;
+    if (FIFO_COUNT(rfp->rx_fifo) == 0) {
+        return NRF52_ERROR_INVALID_LENGTH;
     }
 
-    rx_fifo.count--;
+    // The frame is done with before the slot is passed back to the state machine
+    __DMB();
+    rfp->rx_fifo.exit_point++;
 
-    nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
+    return NRF52_SUCCESS;
+}
+
+/**@brief Number of frames waiting in the TX FIFO. */
+uint32_t radio_tx_pending(RFDriver *rfp) {
+    return FIFO_COUNT(rfp->tx_fifo);
+}
+
+/**@brief Copy the link statistics counters and start them over. */
+void radio_take_stats(RFDriver *rfp, nrf52_stats_t *stats) {
+    chSysLock();
+    *stats = rfp->stats;
+    memset(&rfp->stats, 0, sizeof(rfp->stats));
+    chSysUnlock();
+}
+
+nrf52_error_t radio_start_tx(RFDriver *rfp) {
+    if (rfp->state != NRF52_STATE_IDLE)
+    	return NRF52_ERROR_BUSY;
+
+    if (FIFO_COUNT(rfp->tx_fifo) == 0) {
+        return NRF52_ERROR_INVALID_LENGTH;
+    }
+
+    hfclk_wait(rfp);
+    start_tx_transaction(rfp);
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_start_tx(void) {
-    if (RFD1.state != NRF52_STATE_IDLE)
+/**@brief Release the HFXO while the module is idle.
+ *
+ * @details Called by the idle thread enter hook with the kernel locked. The
+ *          HFXO is kept while frames are queued, the peripherals run from
+ *          HFINT otherwise till the next transaction starts it again. Out of
+ *          radio_init() to radio_disable() the HFXO the HAL started at boot
+ *          is released as well.
+ */
+void radio_hfclk_release(RFDriver *rfp) {
+    NRF_CLOCK_Type *clock = rfp->clock != NULL ? rfp->clock : NRF_CLOCK;
+
+    if (rfp->state != NRF52_STATE_UNINIT &&
+        (rfp->state != NRF52_STATE_IDLE || FIFO_COUNT(rfp->tx_fifo) > 0))
+        return;
+
+    if (clock->HFCLKRUN & CLOCK_HFCLKRUN_STATUS_Msk)
+        clock->TASKS_HFCLKSTOP = 1;
+}
+
+/**@brief Start the TX FIFO transmission after a delay.
+ *
+ * @details The first frame is started by the timer compare event through PPI,
+ *          independent of the interrupt and thread latency.
+ *
+ * @param[in]   delay_us    Delay from the call, uS.
+ */
+nrf52_error_t radio_start_tx_at(RFDriver *rfp, uint16_t delay_us) {
+    if (rfp->state != NRF52_STATE_IDLE)
     	return NRF52_ERROR_BUSY;
 
-    if (tx_fifo.count == 0) {
+    if (FIFO_COUNT(rfp->tx_fifo) == 0) {
         return NRF52_ERROR_INVALID_LENGTH;
     }
 
-    start_tx_transaction(&RFD1);
+    hfclk_wait(rfp);
+    rfp->tx_start_delay_us = delay_us;
+    start_tx_transaction(rfp);
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_start_rx(void) {
-    if (RFD1.state != NRF52_STATE_IDLE)
+nrf52_error_t radio_start_rx(RFDriver *rfp) {
+    if (rfp->state != NRF52_STATE_IDLE)
     	return NRF52_ERROR_BUSY;
 
-    NRF_RADIO->INTENCLR = 0xFFFFFFFF;
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    (void) NRF_RADIO->EVENTS_DISABLED;
+    hfclk_wait(rfp);
+
+    rfp->radio->INTENCLR = 0xFFFFFFFF;
+    rfp->radio->EVENTS_DISABLED = 0;
+    (void) rfp->radio->EVENTS_DISABLED;
 
-    NRF_RADIO->SHORTS      = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_TXEN_Msk;
-    NRF_RADIO->INTENSET    = RADIO_INTENSET_DISABLED_Msk;
-    RFD1.state             = NRF52_STATE_PRX;
+    rfp->radio->SHORTS      = RADIO_SHORTS_COMMON | RADIO_SHORTS_DISABLED_TXEN_Msk;
+    rfp->radio->INTENSET    = RADIO_INTENSET_DISABLED_Msk;
+    rfp->state             = NRF52_STATE_PRX;
 
-    NRF_RADIO->RXADDRESSES  = RFD1.config.address.rx_pipes;
-    NRF_RADIO->FREQUENCY    = RFD1.config.address.rf_channel;
-    NRF_RADIO->PACKETPTR    = (uint32_t)rx_payload_buffer;
+    rfp->radio->RXADDRESSES  = rfp->config.address.rx_pipes;
+    rfp->radio->FREQUENCY    = rfp->config.address.rf_channel;
+    set_rx_packetptr(rfp);
 
     nvicClearPending(RADIO_IRQn);
     nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
 
-    NRF_RADIO->EVENTS_ADDRESS = 0;
-    NRF_RADIO->EVENTS_PAYLOAD = 0;
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    (void) NRF_RADIO->EVENTS_ADDRESS;
-    (void) NRF_RADIO->EVENTS_PAYLOAD;
-    (void) NRF_RADIO->EVENTS_DISABLED;
+    rfp->radio->EVENTS_ADDRESS = 0;
+    rfp->radio->EVENTS_PAYLOAD = 0;
+    rfp->radio->EVENTS_DISABLED = 0;
+    (void) rfp->radio->EVENTS_ADDRESS;
+    (void) rfp->radio->EVENTS_PAYLOAD;
+    (void) rfp->radio->EVENTS_DISABLED;
 
-    NRF_RADIO->TASKS_RXEN  = 1;
+    rfp->radio->TASKS_RXEN  = 1;
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_stop_rx(void) {
-    if (RFD1.state != NRF52_STATE_PRX) {
+/**@brief Start disabling RX.
+ *
+ * @details The module is idle on the DISABLED event, radio_wait_idle() blocks
+ *          until then so the caller can go on with other work meanwhile.
+ */
+nrf52_error_t radio_stop_rx(RFDriver *rfp) {
+    chSysLock();
+    if (rfp->state != NRF52_STATE_PRX && rfp->state != NRF52_STATE_PRX_RESTART) {
+        chSysUnlock();
         return NRF52_INVALID_STATE;
     }
 
-    NRF_RADIO->SHORTS = 0;
-    NRF_RADIO->INTENCLR = 0xFFFFFFFF;
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    (void) NRF_RADIO->EVENTS_DISABLED;
-    NRF_RADIO->TASKS_DISABLE = 1;
-    while (NRF_RADIO->EVENTS_DISABLED == 0);
-    RFD1.state = NRF52_STATE_IDLE;
+    rfp->radio->INTENCLR = 0xFFFFFFFF;
+    rfp->radio->SHORTS = 0;
+    rfp->radio->EVENTS_DISABLED = 0;
+    (void) rfp->radio->EVENTS_DISABLED;
+    chBSemResetI(&rfp->idle_sem, TRUE);
+    rfp->state = NRF52_STATE_PRX_STOP;
+    rfp->radio->INTENSET = RADIO_INTENSET_DISABLED_Msk;
+    rfp->radio->TASKS_DISABLE = 1;
+    chSysUnlock();
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_flush_tx(void) {
-    if (RFD1.state == NRF52_STATE_UNINIT)
-    	return NRF52_INVALID_STATE;
+/**@brief Wait until the RADIO disable started by radio_stop_rx() is done. */
+nrf52_error_t radio_wait_idle(RFDriver *rfp) {
+    msg_t msg = MSG_OK;
 
-    nvicDisableVector(RADIO_IRQn);
+    chSysLock();
+    while ((rfp->state == NRF52_STATE_PRX_STOP || rfp->state == NRF52_STATE_STOP) && msg == MSG_OK)
+        msg = chBSemWaitTimeoutS(&rfp->idle_sem, TIME_MS2I(NRF52_RADIO_STOP_TIMEOUT));
 
-    tx_fifo.count = 0;
-    tx_fifo.entry_point = 0;
-    tx_fifo.exit_point = 0;
+    // No DISABLED event when the RADIO was already disabled
+    if (msg != MSG_OK && rfp->radio->STATE == RADIO_STATE_STATE_Disabled) {
+        rfp->radio->INTENCLR = 0xFFFFFFFF;
+        rfp->state = NRF52_STATE_IDLE;
+        msg = MSG_OK;
+    }
+    chSysUnlock();
 
-    nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
+    return msg == MSG_OK ? NRF52_SUCCESS : NRF52_ERROR_BUSY;
+}
 
-    return NRF52_SUCCESS;
+/** @brief  Function to cancel the transaction in progress.
+ *
+ *  The PPI and the timer are stopped first so no new TX or RX is started, then the
+ *  RADIO is disabled. The state machine does not touch the current frame again and
+ *  gives it no result, the caller drops it with the TX FIFO.
+ */
+static nrf52_error_t stop_transaction(RFDriver *rfp) {
+    chSysLock();
+    if (rfp->state == NRF52_STATE_IDLE) {
+        chSysUnlock();
+        return NRF52_SUCCESS;
+    }
+
+    rfp->ppi->CHENCLR = (1 << NRF52_RADIO_PPI_TIMER_START) |
+                       (1 << NRF52_RADIO_PPI_TIMER_STOP)  |
+                       (1 << NRF52_RADIO_PPI_RX_TIMEOUT)  |
+                       (1 << NRF52_RADIO_PPI_TX_START)    |
+                       (1 << NRF52_RADIO_PPI_CCA_START);
+    rfp->timer->TASKS_STOP = 1;
+
+    rfp->radio->INTENCLR = 0xFFFFFFFF;
+    rfp->radio->SHORTS = 0;
+    rfp->radio->EVENTS_DISABLED = 0;
+    (void) rfp->radio->EVENTS_DISABLED;
+    nvicClearPending(RADIO_IRQn);
+
+    if (rfp->radio->STATE == RADIO_STATE_STATE_Disabled) {
+        // Waiting for the timer between retransmits or backoffs
+        rfp->state = NRF52_STATE_IDLE;
+    }
+    else {
+        chBSemResetI(&rfp->idle_sem, TRUE);
+        rfp->state = NRF52_STATE_STOP;
+        rfp->radio->INTENSET = RADIO_INTENSET_DISABLED_Msk;
+        rfp->radio->TASKS_DISABLE = 1;
+    }
+    chSysUnlock();
+
+    return radio_wait_idle(rfp);
 }
 
-nrf52_error_t radio_pop_tx(void) {
-    if (RFD1.state == NRF52_STATE_UNINIT)
-    	return NRF52_INVALID_STATE;
-    if (tx_fifo.count == 0)
-    	return NRF52_ERROR_INVALID_LENGTH;
+/**@brief Drop all the frames of the TX FIFO.
+ *
+ * @details The transaction in progress is cancelled first, so every frame gets
+ *          exactly one result. RX is started again when it was on.
+ */
+nrf52_error_t radio_flush_tx(RFDriver *rfp) {
+    nrf52_error_t err;
+    bool          rx;
 
-    nvicDisableVector(RADIO_IRQn);
+    if (rfp->state == NRF52_STATE_UNINIT)
+    	return NRF52_INVALID_STATE;
 
-    if (++tx_fifo.entry_point >= NRF52_TX_FIFO_SIZE) {
-        tx_fifo.entry_point = 0;
+    rx = rfp->state == NRF52_STATE_PRX || rfp->state == NRF52_STATE_PRX_SEND_ACK ||
+         rfp->state == NRF52_STATE_PRX_RESTART;
+    err = stop_transaction(rfp);
+    if (err != NRF52_SUCCESS)
+        return err;
+
+    // Drops everything queued by moving the read index frame by frame, so each
+    // gets its result, the write index stays owned by the writer
+    chSysLock();
+    while (FIFO_COUNT(rfp->tx_fifo) > 0) {
+        tx_frame_result_i(TX_FIFO_EXIT(rfp), NRF52_SEND_FLUSHED, 0);
+        tx_fifo_remove_last(rfp);
     }
-    tx_fifo.count--;
+    chSysUnlock();
 
-    nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
+    if (rx)
+        return radio_start_rx(rfp);
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_flush_rx(void) {
-    if (RFD1.state == NRF52_STATE_UNINIT)
+nrf52_error_t radio_pop_tx(RFDriver *rfp) {
+    if (rfp->state == NRF52_STATE_UNINIT)
     	return NRF52_INVALID_STATE;
+    // The state machine may own the oldest frame
+    if (rfp->state != NRF52_STATE_IDLE)
+    	return NRF52_ERROR_BUSY;
+    if (FIFO_COUNT(rfp->tx_fifo) == 0)
+    	return NRF52_ERROR_INVALID_LENGTH;
 
-    nvicDisableVector(RADIO_IRQn);
+    // Drops the oldest frame
+    chSysLock();
+    tx_frame_result_i(TX_FIFO_EXIT(rfp), NRF52_SEND_FLUSHED, 0);
+    tx_fifo_remove_last(rfp);
+    chSysUnlock();
 
-    rx_fifo.count = 0;
-    rx_fifo.entry_point = 0;
-    rx_fifo.exit_point = 0;
+    return NRF52_SUCCESS;
+}
 
-    memset(rx_pipe_info, 0, sizeof(rx_pipe_info));
+nrf52_error_t radio_flush_rx(RFDriver *rfp) {
+    if (rfp->state == NRF52_STATE_UNINIT)
+    	return NRF52_INVALID_STATE;
 
-    nvicEnableVector(RADIO_IRQn, NRF52_RADIO_IRQ_PRIORITY);
+    chSysLock();
+    rfp->rx_fifo.exit_point = rfp->rx_fifo.entry_point;
+    memset(rfp->rx_pipe_info, 0, sizeof(rfp->rx_pipe_info));
+    chSysUnlock();
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_set_base_address_0(uint8_t const * p_addr) {
-    if (RFD1.state != NRF52_STATE_IDLE)
+nrf52_error_t radio_set_base_address_0(RFDriver *rfp, uint8_t const * p_addr) {
+    if (rfp->state != NRF52_STATE_IDLE)
     	return NRF52_ERROR_BUSY;
     if (p_addr == NULL)
         return NRF52_ERROR_NULL;
 
-    memcpy(RFD1.config.address.base_addr_p0, p_addr, 4);
-    set_addresses(&RFD1, NRF52_ADDR_UPDATE_MASK_BASE0);
+    memcpy(rfp->config.address.base_addr_p0, p_addr, 4);
+    set_addresses(rfp, NRF52_ADDR_UPDATE_MASK_BASE0);
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_set_base_address_1(uint8_t const * p_addr) {
-    if (RFD1.state != NRF52_STATE_IDLE)
+nrf52_error_t radio_set_base_address_1(RFDriver *rfp, uint8_t const * p_addr) {
+    if (rfp->state != NRF52_STATE_IDLE)
     	return NRF52_ERROR_BUSY;
     if (p_addr == NULL)
         return NRF52_ERROR_NULL;
 
-    memcpy(RFD1.config.address.base_addr_p1, p_addr, 4);
-    set_addresses(&RFD1, NRF52_ADDR_UPDATE_MASK_BASE1);
+    memcpy(rfp->config.address.base_addr_p1, p_addr, 4);
+    set_addresses(rfp, NRF52_ADDR_UPDATE_MASK_BASE1);
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_set_prefixes(uint8_t const * p_prefixes, uint8_t num_pipes) {
-    if (RFD1.state != NRF52_STATE_IDLE)
+nrf52_error_t radio_set_prefixes(RFDriver *rfp, uint8_t const * p_prefixes, uint8_t num_pipes) {
+    if (rfp->state != NRF52_STATE_IDLE)
     	return NRF52_ERROR_BUSY;
     if (p_prefixes == NULL)
         return NRF52_ERROR_NULL;
     if (num_pipes > 8)
     	return NRF52_ERROR_INVALID_PARAM;
 
-    memcpy(RFD1.config.address.pipe_prefixes, p_prefixes, num_pipes);
-    RFD1.config.address.num_pipes = num_pipes;
-    RFD1.config.address.rx_pipes = BIT_MASK_UINT_8(num_pipes);
+    memcpy(rfp->config.address.pipe_prefixes, p_prefixes, num_pipes);
+    rfp->config.address.num_pipes = num_pipes;
+    rfp->config.address.rx_pipes = BIT_MASK_UINT_8(num_pipes);
+
+    set_addresses(rfp, NRF52_ADDR_UPDATE_MASK_PREFIX);
+
+    return NRF52_SUCCESS;
+}
+
+nrf52_error_t radio_set_tx_power(RFDriver *rfp, nrf52_tx_power_t tx_power) {
+    if (rfp->state != NRF52_STATE_IDLE)
+    	return NRF52_ERROR_BUSY;
+
+    if (rfp->config.tx_power != tx_power) {
+        rfp->config.tx_power = tx_power;
+        set_tx_power(rfp);
+    }
+
+    return NRF52_SUCCESS;
+}
+
+nrf52_error_t radio_set_bitrate(RFDriver *rfp, nrf52_bitrate_t bitrate) {
+    if (rfp->state != NRF52_STATE_IDLE)
+    	return NRF52_ERROR_BUSY;
+
+    if (rfp->config.bitrate != bitrate) {
+        rfp->config.bitrate = bitrate;
+        set_bitrate(rfp);
+    }
+
+    return NRF52_SUCCESS;
+}
+
+nrf52_error_t radio_set_channel(RFDriver *rfp, uint8_t channel) {
+    if (rfp->state != NRF52_STATE_IDLE)
+    	return NRF52_ERROR_BUSY;
+    if (channel > 100)
+    	return NRF52_ERROR_INVALID_PARAM;
 
-    set_addresses(&RFD1, NRF52_ADDR_UPDATE_MASK_PREFIX);
+    // Used by the next TX transaction or RX start
+    rfp->config.address.rf_channel = channel;
+    rfp->radio->FREQUENCY = channel;
 
     return NRF52_SUCCESS;
 }
 
-nrf52_error_t radio_set_prefix(uint8_t pipe, uint8_t prefix) {
-    if (RFD1.state != NRF52_STATE_IDLE)
+nrf52_error_t radio_set_prefix(RFDriver *rfp, uint8_t pipe, uint8_t prefix) {
+    if (rfp->state != NRF52_STATE_IDLE)
     	return NRF52_ERROR_BUSY;
     if (pipe > 8)
     	return NRF52_ERROR_INVALID_PARAM;
 
-    RFD1.config.address.pipe_prefixes[pipe] = prefix;
+    rfp->config.address.pipe_prefixes[pipe] = prefix;
 
-    NRF_RADIO->PREFIX0 = bytewise_bit_swap(&RFD1.config.address.pipe_prefixes[0]);
-    NRF_RADIO->PREFIX1 = bytewise_bit_swap(&RFD1.config.address.pipe_prefixes[4]);
+    rfp->radio->PREFIX0 = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[0]);
+    rfp->radio->PREFIX1 = bytewise_bit_swap(&rfp->config.address.pipe_prefixes[4]);
 
     return NRF52_SUCCESS;
 }
@@ -26,8 +26,9 @@
 
 #define NRF52_CRC_RESET_VALUE             	0xFFFF              /**< CRC reset value*/
 
-#define NRF52_TX_FIFO_SIZE                  8                   /**< The size of the transmission first in first out buffer. */
-#define NRF52_RX_FIFO_SIZE                  8                   /**< The size of the reception first in first out buffer. */
+#define NRF52_PIPE_COUNT                    9                   /**< Pipes with a PID and CRC record. */
+#define NRF52_TX_FIFO_SIZE                  8                   /**< The size of the transmission first in first out buffer, a power of two. */
+#define NRF52_RX_FIFO_SIZE                  8                   /**< The size of the reception first in first out buffer, a power of two. */
 
 #define NRF52_RADIO_USE_TIMER0            	FALSE               /**< TIMER0 will be used by the module. */
 #define NRF52_RADIO_USE_TIMER1            	TRUE                /**< TIMER1 will be used by the module. */
@@ -36,13 +37,29 @@
 #define NRF52_RADIO_USE_TIMER4            	FALSE               /**< TIMER4 will be used by the module. */
 
 #define NRF52_RADIO_IRQ_PRIORITY			3                   /**< RADIO interrupt priority. */
-#define NRF52_RADIO_INTTHD_PRIORITY         (NORMALPRIO+4)      /**< Interrupts handle thread priority. */
-#define NRF52_RADIO_EVTTHD_PRIORITY         (NORMALPRIO+3)      /**< Events handle thread priority */
+#define NRF52_RADIO_INTTHD_PRIORITY         (NORMALPRIO+4)      /**< Interrupts handle thread priority, without NRF52_RADIO_USE_ISR_HANDLER. */
+
+#ifndef NRF52_RADIO_USE_ISR_HANDLER
+#define NRF52_RADIO_USE_ISR_HANDLER         TRUE                /**< Run the state machine in the RADIO ISR instead of the interrupts handle thread. */
+#endif
+#ifndef NRF52_RADIO_MEASURE_LATENCY
+#define NRF52_RADIO_MEASURE_LATENCY         FALSE               /**< Measure the DISABLED event to reprogram latency with the DWT cycle counter. */
+#endif
+
+#define NRF52_RSSI_HIST_SIZE                8                   /**< RSSI histogram buckets. */
+#define NRF52_RSSI_HIST_BASE                48                  /**< Upper bound of the first RSSI bucket, -dBm. */
+#define NRF52_RSSI_HIST_STEP                8                   /**< RSSI bucket width, dB. */
+
+#define NRF52_RADIO_STOP_TIMEOUT            2                   /**< RX disable timeout, mS. */
 
 #define NRF52_RADIO_PPI_TIMER_START         10                  /**< The PPI channel used for timer start. */
 #define NRF52_RADIO_PPI_TIMER_STOP          11                  /**< The PPI channel used for timer stop. */
 #define NRF52_RADIO_PPI_RX_TIMEOUT          12                  /**< The PPI channel used for RX timeout. */
 #define NRF52_RADIO_PPI_TX_START            13                  /**< The PPI channel used for starting TX. */
+#define NRF52_RADIO_PPI_CCA_START           14                  /**< The PPI channel used for starting the clear channel assessment. */
+
+#define NRF52_CCA_BACKOFF_US                250                 /**< Clear channel assessment backoff slot, uS. */
+#define NRF52_CCA_BACKOFF_EXP_MAX           5                   /**< Largest backoff exponent, up to 2^n slots. */
 
 
 typedef enum {
@@ -62,8 +79,12 @@ typedef enum {
     NRF52_STATE_PTX_TX,                                   /**< Module transmitting without ack. */
     NRF52_STATE_PTX_TX_ACK,                               /**< Module transmitting with ack. */
     NRF52_STATE_PTX_RX_ACK,                               /**< Module transmitting with ack and reception of payload with the ack response. */
+    NRF52_STATE_PTX_CCA,                                  /**< Module listening for a clear channel before transmitting. */
     NRF52_STATE_PRX,                                      /**< Module receiving packets without ack. */
     NRF52_STATE_PRX_SEND_ACK,                             /**< Module transmitting ack in RX mode. */
+    NRF52_STATE_PRX_RESTART,                              /**< Module going back to RX through the DISABLED_RXEN short. */
+    NRF52_STATE_PRX_STOP,                                 /**< Module disabling RX, idle on the DISABLED event. */
+    NRF52_STATE_STOP,                                     /**< Module cancelling the transaction in progress, idle on the DISABLED event. */
 } nrf52_state_t;
 
 /**@brief Events to indicate the last transmission/receiving status. */
@@ -173,12 +194,80 @@ typedef struct
     uint8_t data[NRF52_MAX_PAYLOAD_LENGTH];      /**< The payload data. */
 } nrf52_payload_t;
 
+/**@brief Result of a frame queued with a completion callback. */
+typedef enum {
+    NRF52_SEND_OK,                               /**< Frame acknowledged, or sent if no ack was asked for. */
+    NRF52_SEND_TIMEOUT,                          /**< No ack till the deadline. */
+    NRF52_SEND_FLUSHED,                          /**< Frame dropped from the TX FIFO. */
+} nrf52_send_status_t;
+
+typedef struct {
+    nrf52_send_status_t status;                  /**< Frame result. */
+    uint16_t attempts;                           /**< Transmissions of the frame, retransmits included. */
+    int8_t  rssi;                                /**< RSSI for the ack, 0 without ack. */
+} nrf52_send_result_t;
+
+/**@brief Frame result callback.
+ *
+ * @details Called by the state machine in the system locked state, only I-class
+ *          functions may be used.
+ */
+typedef void (*nrf52_send_cb_t)(void *arg, nrf52_send_result_t const *result);
+
+/**@brief Enhanced ShockBurst FIFO frame.
+ *
+ * @details The frame keeps the payload in the on-air layout: the LENGTH/S0 and
+ *          S1 header bytes are followed by the data, so the RADIO EasyDMA can
+ *          access the FIFO slot directly through PACKETPTR.
+ */
+typedef struct
+{
+    uint8_t pipe;                                /**< Pipe used for this frame. */
+    int8_t  rssi;                                /**< RSSI for received frame. */
+    uint8_t header[2];                           /**< On-air LENGTH/S0 and S1 fields. */
+    uint8_t data[NRF52_MAX_PAYLOAD_LENGTH];      /**< The payload data, word aligned. */
+    uint8_t length;                              /**< Length of the payload data. */
+    uint8_t noack;                               /**< Flag indicating that this frame will not be acknowledged. */
+    uint8_t pid;                                 /**< PID assigned during communication. */
+    uint16_t attempts;                           /**< Transmissions of the frame so far. */
+    systime_t queued;                            /**< System time the frame was queued. */
+    systime_t deadline;                          /**< Retransmit rounds start till this system time. */
+    nrf52_send_cb_t cb;                          /**< Result callback, NULL to suspend the TX on a failure. */
+    void *  arg;                                 /**< Result callback argument. */
+} __attribute__((aligned(4))) nrf52_frame_t;
+
+/**@brief Link statistics counters.
+ *
+ * @details Counted by the state machine since radio_init() or the last
+ *          radio_take_stats() call.
+ */
+typedef struct {
+    uint32_t tx_frames;                          /**< Frames transmitted, retransmits not included. */
+    uint32_t tx_retransmits;                     /**< Hardware retransmits. */
+    uint32_t tx_failed;                          /**< Frames failed with all retransmits expended. */
+    uint32_t tx_retries;                         /**< Retransmit rounds restarted within the frame deadline. */
+    uint32_t rx_crc_errors;                      /**< Packets received with a CRC error. */
+    uint32_t rx_overflows;                       /**< Packets dropped while the RX FIFO was full. */
+    uint32_t rx_duplicates;                      /**< Retransmitted packets dropped by the PID check. */
+    uint32_t rssi_hist[NRF52_RSSI_HIST_SIZE];    /**< Received packets and ACKs by RSSI, NRF52_RSSI_HIST_STEP dB buckets from NRF52_RSSI_HIST_BASE down. */
+    uint32_t cca_busy;                           /**< Clear channel assessments found the channel busy. */
+    uint32_t cca_forced;                         /**< Frames sent on a busy channel with all backoffs expended. */
+    uint32_t cca_backoff_us;                     /**< Time spent in backoffs, uS. */
+} nrf52_stats_t;
+
 /**@brief Retransmit attempts delay and counter. */
 typedef struct {
     uint16_t              delay;                  /**< The delay between each retransmission of unacked packets. */
     uint16_t              count;                  /**< The number of retransmissions attempts before transmission fail. */
 } nrf52_retransmit_t;
 
+/**@brief Clear channel assessment before transmit. */
+typedef struct {
+    uint8_t               threshold;              /**< Channel busy above -threshold dBm, 0 to disable. */
+    uint8_t               backoffs;               /**< Backoffs before the frame is sent on a busy channel. */
+    uint16_t              window;                 /**< Listen time before the RSSI sample, uS. */
+} nrf52_cca_t;
+
 /**@brief Main nrf_esb configuration struct. */
 typedef struct {
     nrf52_protocol_t      protocol;               /**< Enhanced ShockBurst protocol. */
@@ -196,12 +285,39 @@ typedef struct {
 
     nrf52_retransmit_t    retransmit;             /**< Packet retransmit parameters */
 
+    nrf52_cca_t           cca;                    /**< Clear channel assessment parameters */
+
     uint8_t               payload_length;         /**< Enhanced ShockBurst static payload length */
 
     nrf52_address_t    	  address;                /**< Address parameters structure */
 } nrf52_config_t;
 
+/* The FIFOs are single producer, single consumer rings: the producer only advances
+ * entry_point and the consumer only advances exit_point. Both indexes are free
+ * running, their difference is the number of frames in the queue.
+ */
+typedef struct {
+    nrf52_frame_t *     p_frame[NRF52_TX_FIFO_SIZE];        /**< Pointer to the actual queue. */
+    volatile uint32_t   entry_point;                        /**< Write index, advanced by the writer thread only. */
+    volatile uint32_t   exit_point;                         /**< Read index, advanced by the radio state machine only. */
+} nrf52_payload_tx_fifo_t;
+
 typedef struct {
+    nrf52_frame_t *     p_frame[NRF52_RX_FIFO_SIZE];        /**< Pointer to the actual queue. */
+    volatile uint32_t   entry_point;                        /**< Write index, advanced by the radio state machine only. */
+    volatile uint32_t   exit_point;                         /**< Read index, advanced by the reader thread only. */
+} nrf52_payload_rx_fifo_t;
+
+/**@brief PID and CRC of the last packet of a pipe and its ack payload state. */
+typedef struct {
+    uint16_t            m_crc;
+    uint8_t             m_pid;
+    uint8_t             m_ack_payload;
+} nrf52_pipe_info_t;
+
+typedef struct RFDriver RFDriver;
+
+struct RFDriver {
   /**
    * @brief NRF52 radio peripheral.
    */
@@ -210,6 +326,18 @@ typedef struct {
    * @brief NRF52 timer peripheral.
    */
   NRF_TIMER_Type          *timer;
+  /**
+   * @brief NRF52 PPI peripheral.
+   */
+  NRF_PPI_Type            *ppi;
+  /**
+   * @brief NRF52 clock peripheral, the HFXO runs while frames are queued or sent and RX is on.
+   */
+  NRF_CLOCK_Type          *clock;
+  /**
+   * @brief NRF52 factory information, the device ID seeds the backoffs.
+   */
+  NRF_FICR_Type           *ficr;
   /**
    * @brief Driver state.
    */
@@ -230,27 +358,133 @@ typedef struct {
    * @brief TX retransmits remaining.
    */
   uint16_t                tx_remaining;
+  /**
+   * @brief Transmissions started since radio_init(), retransmits included.
+   */
+  uint32_t                tx_count;
+  /**
+   * @brief Clear channel assessment backoffs of the current frame.
+   */
+  uint8_t                 cca_backoffs;
+  /**
+   * @brief Link statistics counters.
+   */
+  nrf52_stats_t           stats;
+#if NRF52_RADIO_MEASURE_LATENCY
+  /**
+   * @brief DWT cycle count at the last DISABLED interrupt.
+   */
+  uint32_t                disabled_stamp;
+  /**
+   * @brief Last DISABLED to reprogram latency, CPU cycles.
+   */
+  uint32_t                latency_last;
+  /**
+   * @brief Worst DISABLED to reprogram latency since radio_init(), CPU cycles.
+   */
+  uint32_t                latency_max;
+#endif
   /**
    * @brief Radio events source.
    */
   event_source_t eventsrc;
-} RFDriver;
+  /**
+   * @brief PCNF setup of the configured protocol.
+   */
+  void                    (*set_rf_payload_format)(RFDriver *rfp, uint32_t payload_length);
+  /**
+   * @brief ACK wait window of the configured bitrate, uS.
+   */
+  uint16_t                wait_for_ack_timeout_us;
+  /**
+   * @brief Delay of the next TX round start, uS.
+   */
+  uint16_t                tx_start_delay_us;
+  /**
+   * @brief Clear channel assessment backoff random state.
+   */
+  uint32_t                cca_seed;
+  /**
+   * @brief Frame on air, a TX FIFO slot or a frame queued by radio_tx_queue().
+   */
+  nrf52_frame_t           *p_current_frame;
+  /**
+   * @brief TX FIFO slots and queue.
+   */
+  nrf52_frame_t           tx_fifo_frame[NRF52_TX_FIFO_SIZE];
+  nrf52_payload_tx_fifo_t tx_fifo;
+  /**
+   * @brief RX FIFO slots and queue, the RADIO receives straight into the slots.
+   */
+  nrf52_frame_t           rx_fifo_frame[NRF52_RX_FIFO_SIZE];
+  nrf52_payload_rx_fifo_t rx_fifo;
+  /**
+   * @brief Empty ACK sent in RX mode.
+   */
+  uint8_t                 tx_payload_buffer[2];
+  /**
+   * @brief RX target while the RX FIFO is full.
+   */
+  uint8_t                 rx_payload_buffer[NRF52_MAX_PAYLOAD_LENGTH + 2];
+  /**
+   * @brief Buffer the RADIO receives into.
+   */
+  uint8_t                 *p_rx_buffer;
+  /**
+   * @brief Last PID sent on each pipe.
+   */
+  uint8_t                 pids[NRF52_PIPE_COUNT];
+  /**
+   * @brief Last packet received on each pipe.
+   */
+  nrf52_pipe_info_t       rx_pipe_info[NRF52_PIPE_COUNT];
+  /**
+   * @brief Signaled on the DISABLED event of a stop.
+   */
+  binary_semaphore_t      idle_sem;
+#if !NRF52_RADIO_USE_ISR_HANDLER
+  /**
+   * @brief Signaled on the DISABLED event for the interrupts handle thread.
+   */
+  binary_semaphore_t      disable_sem;
+  /**
+   * @brief Interrupts handle thread.
+   */
+  thread_t                *int_thread;
+  THD_WORKING_AREA(wa_int_thread, 128);
+#endif
+};
 
 extern RFDriver RFD1;
 
-nrf52_error_t radio_init(nrf52_config_t const *config);
-nrf52_error_t radio_disable(void);
-nrf52_error_t radio_write_payload(nrf52_payload_t const * p_payload);
-nrf52_error_t radio_read_rx_payload(nrf52_payload_t * p_payload);
-nrf52_error_t radio_start_tx(void);
-nrf52_error_t radio_start_rx(void);
-nrf52_error_t radio_stop_rx(void);
-nrf52_error_t radio_flush_tx(void);
-nrf52_error_t radio_flush_rx(void);
-nrf52_error_t radio_pop_tx(void);
-nrf52_error_t radio_set_base_address_0(uint8_t const * p_addr);
-nrf52_error_t radio_set_base_address_1(uint8_t const * p_addr);
-nrf52_error_t radio_set_prefixes(uint8_t const * p_prefixes, uint8_t num_pipes);
-nrf52_error_t radio_set_prefix(uint8_t pipe, uint8_t prefix);
+void radio_serve_interrupt(RFDriver *rfp);
+nrf52_error_t radio_init(RFDriver *rfp, nrf52_config_t const *config);
+nrf52_error_t radio_disable(RFDriver *rfp);
+nrf52_error_t radio_write_payload(RFDriver *rfp, nrf52_payload_t const * p_payload);
+nrf52_error_t radio_send(RFDriver *rfp, nrf52_payload_t const * p_payload, systime_t deadline, nrf52_send_cb_t cb, void * arg);
+nrf52_error_t radio_tx_reserve(RFDriver *rfp, nrf52_frame_t ** pp_frame);
+nrf52_error_t radio_tx_commit(RFDriver *rfp);
+nrf52_error_t radio_tx_queue(RFDriver *rfp, nrf52_frame_t * p_frame);
+nrf52_error_t radio_read_rx_payload(RFDriver *rfp, nrf52_payload_t * p_payload);
+nrf52_error_t radio_rx_acquire(RFDriver *rfp, nrf52_frame_t ** pp_frame);
+nrf52_error_t radio_rx_release(RFDriver *rfp);
+uint32_t radio_tx_pending(RFDriver *rfp);
+void radio_take_stats(RFDriver *rfp, nrf52_stats_t *stats);
+nrf52_error_t radio_start_tx(RFDriver *rfp);
+nrf52_error_t radio_start_tx_at(RFDriver *rfp, uint16_t delay_us);
+nrf52_error_t radio_start_rx(RFDriver *rfp);
+nrf52_error_t radio_stop_rx(RFDriver *rfp);
+nrf52_error_t radio_wait_idle(RFDriver *rfp);
+void radio_hfclk_release(RFDriver *rfp);
+nrf52_error_t radio_flush_tx(RFDriver *rfp);
+nrf52_error_t radio_flush_rx(RFDriver *rfp);
+nrf52_error_t radio_pop_tx(RFDriver *rfp);
+nrf52_error_t radio_set_base_address_0(RFDriver *rfp, uint8_t const * p_addr);
+nrf52_error_t radio_set_base_address_1(RFDriver *rfp, uint8_t const * p_addr);
+nrf52_error_t radio_set_prefixes(RFDriver *rfp, uint8_t const * p_prefixes, uint8_t num_pipes);
+nrf52_error_t radio_set_prefix(RFDriver *rfp, uint8_t pipe, uint8_t prefix);
+nrf52_error_t radio_set_tx_power(RFDriver *rfp, nrf52_tx_power_t tx_power);
+nrf52_error_t radio_set_channel(RFDriver *rfp, uint8_t channel);
+nrf52_error_t radio_set_bitrate(RFDriver *rfp, nrf52_bitrate_t bitrate);
 
 #endif /* NRF52_RADIO_H_ */
@@ -16,8 +16,13 @@ typedef enum {
 	MSG_DATA,
 	MSG_ERROR,
 	MSG_CMD,
+	MSG_AGGR,		// aggregated readings, MESSAGE_AGGR_T
 } msgtype_t;
 
+// msgtype flag of the readings replayed from the flash log, sent before
+// the current ones of the wake cycle, firmware >= 114
+#define MSG_REPLAY	0x80
+
 // типы передаваемых данных
 typedef enum {
 	VAL_ch,
@@ -73,4 +78,26 @@ struct MESSAGE {
     uint8_t crc;				// radio packet CRC
 };
 
+// aggregated message length = 32 bytes, two AES blocks, ESB dynamic payload length
+#define MSGLEN_AGGR		sizeof(MESSAGE_AGGR_T)
+#define AGGR_DATALEN	26
+
+// TLV record: address, type, value[1,2,4 bytes by msgvalue_t]
+#define AGGR_TYPE_ERROR			0x80	// value is an error code
+#define AGGR_TYPE_POWER_Pos		4		// ^10 data power
+#define AGGR_TYPE_POWER_Msk		0x70
+#define AGGR_TYPE_VALUE_Msk		0x0F	// msgvalue_t
+
+// NRF aggregated readings message format, msgtype at the MESSAGE_T offset
+typedef struct MESSAGE_AGGR MESSAGE_AGGR_T;
+struct MESSAGE_AGGR {
+    uint8_t deviceid;			// (out): remote device id
+    uint8_t firmware;			// (out): remote firmware
+    uint8_t addrnum;			// (out): remote device internal address number
+    uint8_t count;				// (out): TLV records number
+    msgtype_t msgtype;			// (out): MSG_AGGR
+    uint8_t data[AGGR_DATALEN];	// (out): TLV records
+    uint8_t crc;				// radio packet CRC
+};
+
 #endif /* PACKET_H_ */
@@ -0,0 +1,117 @@
+/*
+ * profile.c
+ *
+ *  Wake cycle timeline, phase times from the DWT cycle counter & the system time
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "profile.h"
+
+#define PROF_DWT_TICKS	2		// the core may sleep in longer phases, system time is used
+
+// charge model, nRF52832 typical currents with the LDO regulator, uA
+#define PROF_I_RUN		7400	// CPU running from flash at 64 MHz
+#define PROF_I_SLEEP	3		// System ON idle, RAM retained, LFXO & RTC running
+#define PROF_I_HFXO		250		// 32 MHz crystal oscillator
+
+static uint32_t begin_cyc[PROF_PHASES];
+static systime_t begin_sys[PROF_PHASES];
+static uint32_t elapsed_us[PROF_PHASES];
+static systime_t cycle_start;
+static uint16_t cycle_no;
+static prof_record_t last;
+#if PROF_POWER
+static uint32_t cycle_cyc;
+static uint32_t wakeups;
+static uint32_t sleep_hfxo_us;
+#endif
+
+// short phases from the cycle counter, the long ones from the system time,
+// the counter stops while the core sleeps and wraps in 67 S
+static uint32_t prof_elapsed(uint32_t cyc, systime_t sys) {
+	sysinterval_t ticks = chVTTimeElapsedSinceX(sys);
+
+	if (ticks < PROF_DWT_TICKS)
+		return (DWT->CYCCNT - cyc) / PROF_CPU_MHZ;
+	return TIME_I2US(ticks);
+}
+
+// new wake cycle from the system time start, boot_us before it
+void prof_cycle(systime_t start, uint32_t boot_us) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	memset(elapsed_us, 0, sizeof(elapsed_us));
+	cycle_start = start;
+	elapsed_us[PROF_BOOT] = boot_us;
+#if PROF_POWER
+	cycle_cyc = DWT->CYCCNT;
+	wakeups = 0;
+	sleep_hfxo_us = 0;
+#endif
+}
+
+void prof_begin(prof_phase_t phase) {
+	begin_sys[phase] = chVTGetSystemTimeX();
+	begin_cyc[phase] = DWT->CYCCNT;
+}
+
+void prof_end(prof_phase_t phase) {
+	elapsed_us[phase] += prof_elapsed(begin_cyc[phase], begin_sys[phase]);
+}
+
+// idle thread wake up after a WFE sleep, the HFXO state holds for the whole sleep
+void prof_wake(sysinterval_t slept, bool hfxo) {
+#if PROF_POWER
+	wakeups++;
+	if (hfxo)
+		sleep_hfxo_us += TIME_I2US(slept);
+#else
+	(void)slept;
+	(void)hfxo;
+#endif
+}
+
+#if PROF_POWER
+// SoC charge of the wake cycle, uC: the CPU runs while the cycle counter counts,
+// the HFXO is taken as on while the CPU runs, the RADIO & sensors are left out
+static uint32_t prof_charge(uint32_t total_us) {
+	uint32_t run_us = (DWT->CYCCNT - cycle_cyc) / PROF_CPU_MHZ;
+	uint32_t sleep_us = total_us > run_us ? total_us - run_us : 0;
+	uint32_t hfxo_us = sleep_hfxo_us < sleep_us ? sleep_hfxo_us : sleep_us;
+	uint64_t pc;
+
+	pc = (uint64_t) run_us * (PROF_I_RUN + PROF_I_HFXO) +
+			(uint64_t) sleep_us * PROF_I_SLEEP + (uint64_t) hfxo_us * PROF_I_HFXO;
+	return pc / 1000000;
+}
+#endif
+
+// wake cycle over, its profile is kept for the gateway
+void prof_done(void) {
+	uint32_t total_us = TIME_I2US(chVTTimeElapsedSinceX(cycle_start));
+	uint32_t ms = total_us / 1000 + elapsed_us[PROF_BOOT] / 1000;
+
+	last.cycle = ++cycle_no;
+	last.total = ms > UINT16_MAX ? UINT16_MAX : ms;
+	for (uint8_t i=0; i < PROF_PHASES; i++) {
+		ms = elapsed_us[i] / 1000;
+		last.phase[i] = ms > UINT16_MAX ? UINT16_MAX : ms;
+	}
+
+#if PROF_POWER
+	uint32_t uc = prof_charge(total_us);
+	last.wakeups = wakeups > UINT16_MAX ? UINT16_MAX : wakeups;
+	last.charge = uc > UINT16_MAX ? UINT16_MAX : uc;
+#endif
+}
+
+// profile of the last finished wake cycle
+const prof_record_t *prof_last(void) {
+	return &last;
+}
@@ -0,0 +1,46 @@
+/*
+ * profile.h
+ *
+ *  Wake cycle timeline, phase times from the DWT cycle counter & the system time
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+// wake cycle phases
+typedef enum {
+	PROF_BOOT,			// reset or wake up to the main loop
+	PROF_FLASH,			// flash scan & config load, cold boot only
+	PROF_SI7021_PWRUP,	// SI7021 power up wait
+	PROF_SI7021_READ,	// SI7021 I2C setup & reads
+	PROF_HEATER,		// SI7021 heater
+	PROF_DHT_PWRUP,		// DHT power up wait
+	PROF_DHT_READ,		// DHT read
+	PROF_RADIO_INIT,	// radio start
+	PROF_SEND,			// send bursts
+	PROF_LISTEN,		// gateway messages wait
+	PROF_CFG_WRITE,		// config write to flash
+	PROF_PHASES,
+} prof_phase_t;
+
+// profile of a wake cycle, sent to the gateway in 4 byte chunks
+typedef struct {
+	uint16_t cycle;					// wake cycle number
+	uint16_t total;					// wake cycle time, mS
+	uint16_t phase[PROF_PHASES];	// phase times, mS, a repeated phase sums up
+	uint16_t wakeups;				// idle wake ups, PROF_POWER only
+	uint16_t charge;				// SoC charge estimate, uC, PROF_POWER only
+} prof_record_t;
+
+#define PROF_CHUNKS		((sizeof(prof_record_t) + 3) / 4)
+#define PROF_CPU_MHZ	64		// DWT cycles per uS
+#define PROF_POWER		0		// measurement mode, the idle thread counts its wake ups & sleep time
+
+void prof_cycle(systime_t start, uint32_t boot_us);
+void prof_begin(prof_phase_t phase);
+void prof_end(prof_phase_t phase);
+void prof_wake(sysinterval_t slept, bool hfxo);
+void prof_done(void);
+const prof_record_t *prof_last(void);
+
+#endif /* PROFILE_H_ */
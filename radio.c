@@ -6,6 +6,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "ch.h"
@@ -17,21 +18,364 @@
 #include "main.h"
 #include "crc8.h"
 #include "radio.h"
+#include "nrf52_flash.h"
+#include "profile.h"
 
 #define DEBUG	FALSE
 
-static MESSAGE_T nrf_read_buf[NRF_READ_BUFFERS];
-static MESSAGE_T *read_free[NRF_READ_BUFFERS];
-static MESSAGE_T *read_fill[NRF_READ_BUFFERS];
-static mailbox_t mb_read_free, mb_read_fill;
+// message objects, legacy or aggregated message in the frame data: built in place,
+// encrypted in place and transmitted by the driver straight from the object
+static nrf52_frame_t msg_frames[NRF_SEND_BUFFERS];
+static memory_pool_t msg_pool;
+static uint8_t msg_class[NRF_SEND_BUFFERS];
+static nrf52_frame_t *send_fill[SEND_CLASSES][NRF_SEND_BUFFERS];
+static mailbox_t mb_send_fill[SEND_CLASSES];
+static nrf52_frame_t *send_log[NRF_SEND_BUFFERS];
+static mailbox_t mb_send_log;		// dropped readings for the flash log
+static uint8_t log_budget;
+static bool first_tx;		// boot to first TX time not measured yet
+
+#define MSG_FRAME(msg)	((nrf52_frame_t *) ((uint8_t *) (msg) - offsetof(nrf52_frame_t, data)))
+
+// readings of the wake cycle, sent as one MSG_AGGR frame
+static nrf52_frame_t *aggr_frame;
+static uint8_t aggr_len;
+static bool aggr_mode;
+
+// downlink messages arrive in the ACK payloads, no RX window
+static bool ackpl_mode;
+
+// TX power steps, config.tx_power is the index
+static const nrf52_tx_power_t tx_power_levels[TX_POWER_LEVELS] = {
+	NRF52_TX_POWER_NEG30DBM, NRF52_TX_POWER_NEG20DBM, NRF52_TX_POWER_NEG16DBM, NRF52_TX_POWER_NEG12DBM,
+	NRF52_TX_POWER_NEG8DBM, NRF52_TX_POWER_NEG4DBM, NRF52_TX_POWER_0DBM, NRF52_TX_POWER_4DBM,
+};
+
+static link_stats_t link_stats __attribute__((section(".ram0")));
+static void send_stats_value(stats_index_t index);
+static void queue_frame(nrf52_frame_t *frame);
+static void send_profile(void);
+
+#if STATS_RSSI_BUCKETS != NRF52_RSSI_HIST_SIZE
+#error "STATS_RSSI_BUCKETS must match NRF52_RSSI_HIST_SIZE"
+#endif
+_Static_assert(STATS_SEND_CLASSES == SEND_CLASSES, "STATS_SEND_CLASSES must match SEND_CLASSES");
+static const link_policy_t link_policies[] = LINK_POLICIES;
+static const link_policy_t *link_policy = &link_policies[LINK_FAIR];
+
+// link statistics survive the sleep if RAM is retained, else start over
+static void link_stats_init(void) {
+	if (link_stats.magic != LINK_MAGIC ||
+		link_stats.crc != CRC8((uint8_t *) &link_stats, offsetof(link_stats_t, crc))) {
+		memset(&link_stats, 0, sizeof(link_stats));
+		link_stats.magic = LINK_MAGIC;
+		link_stats.attempts = LINK_ATT_ONE;
+		link_stats.failures = 0;
+		link_stats.rssi = RSSI_TARGET;
+	}
+}
+
+static void link_stats_save(void) {
+	link_stats.crc = CRC8((uint8_t *) &link_stats, offsetof(link_stats_t, crc));
+}
+
+// update the EWMAs with the burst result
+static void link_stats_update(uint32_t delivered, uint32_t dropped, uint32_t attempts) {
+	uint32_t frames = delivered + dropped;
+
+	if (frames == 0)
+		return;
+
+	if (delivered > 0) {
+		int32_t att = (int32_t) (attempts * LINK_ATT_ONE / delivered);
+		link_stats.attempts += (att - (int32_t) link_stats.attempts) >> LINK_EWMA_SHIFT;
+	}
+	int32_t fail = (int32_t) (dropped * LINK_FAIL_ONE / frames);
+	link_stats.failures += (fail - (int32_t) link_stats.failures) >> LINK_EWMA_SHIFT;
+	link_stats_save();
+}
+
+// add the driver counters to the link counters
+static void link_counters_collect(void) {
+	nrf52_stats_t stats;
+	uint32_t *cnt = link_stats.counters;
+
+	radio_take_stats(&RFD1, &stats);
+	cnt[STATS_TX_FRAMES] += stats.tx_frames;
+	cnt[STATS_TX_RETRANSMITS] += stats.tx_retransmits;
+	cnt[STATS_TX_FAILED] += stats.tx_failed;
+	cnt[STATS_SEND_RETRIES] += stats.tx_retries;
+	cnt[STATS_RX_CRC_ERRORS] += stats.rx_crc_errors;
+	cnt[STATS_RX_OVERFLOWS] += stats.rx_overflows;
+	cnt[STATS_RX_DUPLICATES] += stats.rx_duplicates;
+	for (uint8_t i=0; i < STATS_RSSI_BUCKETS; i++)
+		cnt[STATS_RSSI_HIST + i] += stats.rssi_hist[i];
+	cnt[STATS_CCA_BUSY] += stats.cca_busy;
+	cnt[STATS_CCA_FORCED] += stats.cca_forced;
+	cnt[STATS_CCA_BACKOFF] += stats.cca_backoff_us;
+	link_stats_save();
+}
+
+static link_quality_t link_quality(void) {
+	if (link_stats.failures > LINK_FAIL_ONE / 5 || link_stats.attempts > LINK_ATT_ONE * 5 / 2)
+		return LINK_POOR;
+	if (link_stats.failures < LINK_FAIL_ONE / 20 && link_stats.attempts < LINK_ATT_ONE * 5 / 4 &&
+		link_stats.rssi >= RSSI_TARGET - 2 * RSSI_MARGIN)
+		return LINK_GOOD;
+	return LINK_FAIR;
+}
+
+// hop list channels & sequence, the state is kept with the link statistics
+static uint8_t hop_chan[HOP_CHANNELS];
+static uint8_t hop_count;
+static bool hop_report;
+
+static void hop_init(void) {
+	hop_count = 0;
+	for (uint8_t i=0; i < HOP_CHANNELS; i++) {
+		uint8_t ch = (config.hop_channels >> (8 * i)) & 0xFF;
+		if (ch != HOP_UNUSED)
+			hop_chan[hop_count++] = ch;
+	}
+	hop_report = false;
+
+	if (link_stats.hop_list != config.hop_channels || link_stats.hop_index >= HOP_CHANNELS) {
+		// new list: the sequence starts at the deviceid position
+		link_stats.hop_list = config.hop_channels;
+		link_stats.hop_index = hop_count ? config.deviceid % hop_count : 0;
+		memset(link_stats.hop_fails, 0, HOP_CHANNELS);
+		memset(link_stats.hop_ttl, 0, HOP_CHANNELS);
+	} else {
+		// blacklist ages with the wake cycles
+		for (uint8_t i=0; i < HOP_CHANNELS; i++)
+			if (link_stats.hop_ttl[i] > 0)
+				link_stats.hop_ttl[i]--;
+	}
+	link_stats_save();
+}
+
+static uint8_t hop_channel(void) {
+	if (hop_count == 0)
+		return config.channel;
+	return hop_chan[link_stats.hop_index];
+}
+
+// next channel of the sequence which is not blacklisted, the
+// deviceid parity sets the direction to spread the nodes
+static void hop_next(void) {
+	uint8_t step = (config.deviceid & 1) ? hop_count - 1 : 1;
+	uint8_t idx = link_stats.hop_index;
+
+	for (uint8_t i=0; i < hop_count; i++) {
+		idx = (idx + step) % hop_count;
+		if (link_stats.hop_ttl[idx] == 0) {
+			link_stats.hop_index = idx;
+			return;
+		}
+	}
+	// all blacklisted, start over
+	memset(link_stats.hop_ttl, 0, HOP_CHANNELS);
+	link_stats.hop_index = (link_stats.hop_index + step) % hop_count;
+}
+
+// burst result on the current channel, a failure hops
+static void hop_result(bool ok) {
+	uint8_t idx = link_stats.hop_index;
+
+	if (hop_count == 0)
+		return;
+
+	if (ok) {
+		link_stats.hop_fails[idx] = 0;
+	} else {
+		if (++link_stats.hop_fails[idx] >= HOP_FAILS) {
+			link_stats.hop_fails[idx] = 0;
+			link_stats.hop_ttl[idx] = HOP_BLACKLIST;
+			hop_report = true;
+		}
+		hop_next();
+	}
+	link_stats_save();
+}
+
+static uint32_t hop_blacklist(void) {
+	uint32_t mask = 0;
+
+	for (uint8_t i=0; i < hop_count; i++)
+		if (link_stats.hop_ttl[i] > 0)
+			mask |= 1 << i;
+	return mask;
+}
+
+static const nrf52_bitrate_t bitrates[] = {
+	[RF_BITRATE_1M] = NRF52_BITRATE_1MBPS,
+	[RF_BITRATE_2M] = NRF52_BITRATE_2MBPS,
+};
+
+static void set_bitrate_choice(uint8_t rate) {
+	if (config.bitrate != rate) {
+		config.bitrate = rate;
+		write_config = true;
+	}
+}
+
+// 2 Mbps when the gateway accepts it & the link has margin for the lower sensitivity
+static void bitrate_init(void) {
+	if (!(config.rfmode & RF_MODE_2MBPS) || config.bitrate > RF_BITRATE_2M) {
+		set_bitrate_choice(RF_BITRATE_1M);
+		return;
+	}
+
+	if (link_stats.rate_holdoff > 0) {
+		link_stats.rate_holdoff--;
+		link_stats_save();
+		return;
+	}
 
-static MESSAGE_T nrf_send_buf[NRF_SEND_BUFFERS];
-static MESSAGE_T *send_free[NRF_SEND_BUFFERS];
-static MESSAGE_T *send_fill[NRF_SEND_BUFFERS];
-static mailbox_t mb_send_free, mb_send_fill;
+	if (config.bitrate == RF_BITRATE_1M && link_quality() == LINK_GOOD &&
+		link_stats.rssi >= RSSI_TARGET - RSSI_MARGIN)
+		set_bitrate_choice(RF_BITRATE_2M);
+}
+
+// burst result at 2 Mbps, repeated failures fall back to 1 Mbps
+static void bitrate_result(bool ok) {
+	if (config.bitrate != RF_BITRATE_2M)
+		return;
+
+	if (ok) {
+		link_stats.rate_fails = 0;
+	} else if (++link_stats.rate_fails >= BITRATE_FAILS) {
+		link_stats.rate_fails = 0;
+		link_stats.rate_holdoff = BITRATE_HOLDOFF;
+		set_bitrate_choice(RF_BITRATE_1M);
+	}
+	link_stats_save();
+}
+
+// TDMA slot: the slot period phase is known at slot_stamp from the gateway time
+// or, after a wake up aligned to the slot, from the reset time
+#define SLOT_PERIOD		(1000 * (config.slot >> 16))
+#define SLOT_OFFSET		(SLOT_UNIT * (config.slot & 0xFFFF))
+
+static uint32_t slot_phase;
+static systime_t slot_stamp;
+static bool slot_valid;
+static bool slot_woken;		// phase from the wake up, not yet checked with the gateway time
+static bool slot_first;
+
+static void slot_init(void) {
+	slot_valid = false;
+	slot_woken = false;
+	slot_first = false;
+
+	if (link_stats.slot != config.slot) {
+		link_stats.slot = config.slot;
+		link_stats.slot_sync = 0;
+		link_stats.slot_late = 0;
+	}
+
+	if (config.slot != SLOT_OFF && link_stats.slot_sync > 0) {
+		// woken up slot_guard mS before the slot, wake_time is slot_late mS later
+		uint32_t period = SLOT_PERIOD;
+		link_stats.slot_sync--;
+		slot_phase = (SLOT_OFFSET + 2 * period - link_stats.slot_guard + link_stats.slot_late) % period;
+		slot_stamp = wake_time;
+		slot_valid = true;
+		slot_woken = true;
+		slot_first = true;
+	}
+	link_stats_save();
+}
+
+// slot period phase now, mS
+static uint32_t slot_now(void) {
+	return (slot_phase + TIME_I2MS(chVTTimeElapsedSinceX(slot_stamp))) % SLOT_PERIOD;
+}
 
-static binary_semaphore_t nrf_send, nrf_receive;
-static volatile eventflags_t nrf_flags;
+// gateway time received, the error of an aligned wake up is the start latency
+static void slot_time(uint32_t phase) {
+	uint32_t period = SLOT_PERIOD;
+
+	if (config.slot == SLOT_OFF || phase >= period)
+		return;
+
+	if (slot_woken) {
+		int32_t err = (int32_t) ((phase + period - slot_now()) % period);
+		if (err > (int32_t) period / 2)
+			err -= period;
+		link_stats.slot_late += err / 2;
+	}
+
+	slot_phase = phase;
+	slot_stamp = chVTGetSystemTimeX();
+	slot_valid = true;
+	slot_woken = false;
+	link_stats.slot_sync = SLOT_SYNC_CYCLES;
+	link_stats_save();
+}
+
+// hold the first burst of an aligned wake cycle till the slot start,
+// returns the rest of the wait for the TX start timer, uS
+static uint16_t slot_wait(void) {
+	if (!slot_first)
+		return 0;
+	slot_first = false;
+
+	uint32_t period = SLOT_PERIOD;
+	uint32_t wait = (SLOT_OFFSET + period - slot_now()) % period;
+
+	// slot start missed, send late
+	if (wait > period / 2)
+		return 0;
+
+	systime_t now = chVTGetSystemTimeX();
+	systime_t start = chTimeAddX(now, TIME_MS2I(wait));
+	if (wait > SLOT_TIMER_MS)
+		chThdSleepUntil(chTimeAddX(now, TIME_MS2I(wait - SLOT_TIMER_MS)));
+
+	sysinterval_t left = chTimeDiffX(chVTGetSystemTimeX(), start);
+	if (left > TIME_MS2I(SLOT_TIMER_MS))
+		return 0;
+	return TIME_I2US(left);
+}
+
+// sleep time to wake up guard mS before the next slot, 0 if the slot is not known
+uint32_t slot_sleep(uint32_t guard) {
+	if (config.slot == SLOT_OFF || !slot_valid)
+		return 0;
+
+	uint32_t period = SLOT_PERIOD;
+	if (guard + SLOT_MIN_SLEEP >= period)
+		return 0;
+
+	uint32_t sleep = (SLOT_OFFSET + 2 * period - guard - slot_now()) % period;
+	if (sleep < SLOT_MIN_SLEEP)
+		sleep += period;
+
+	link_stats.slot_guard = guard;
+	link_stats_save();
+	return sleep;
+}
+
+// store the TX power level, applied with the next burst
+static void set_tx_level(uint8_t level) {
+	if (level >= TX_POWER_LEVELS)
+		level = TX_POWER_LEVELS - 1;
+	if (config.tx_power != level) {
+		config.tx_power = level;
+		write_config = true;
+	}
+}
+
+// radio task events
+#define RADIO_EVT_RF		EVENT_MASK(0)	// nRF52 driver events
+#define RADIO_EVT_SEND		EVENT_MASK(1)	// send queue flush requested
+#define RADIO_EVT_SENT		EVENT_MASK(2)	// frame result from the driver
+
+static thread_t *radio_thd;
+static binary_semaphore_t send_done;
+static event_listener_t radio_el;
+static bool rx_pending;
 
 volatile uint8_t msg_received = false;
 
@@ -41,7 +385,7 @@ static nrf52_config_t radiocfg = {
         .bitrate = NRF52_BITRATE_1MBPS,
         .crc = NRF52_CRC_8BIT,
         .tx_power = NRF52_TX_POWER_4DBM,
-        .tx_mode = NRF52_TXMODE_MANUAL,
+        .tx_mode = NRF52_TXMODE_MANUAL_START,
         .selective_auto_ack = true,
         .retransmit = { 750, 3 },
         .payload_length = MSGLEN,
@@ -56,123 +400,220 @@ static nrf52_config_t radiocfg = {
         },
 };
 
-// NRF52 events process thread
-static thread_t *radio_event_thd;
-static THD_WORKING_AREA(waNRFEventThread, 256);
-static THD_FUNCTION(NRFEventThread, arg) {
-    (void)arg;
-
-    event_listener_t el;
-    chEvtRegisterMask(&RFD1.eventsrc, &el, EVENT_MASK(0));
-
-    chRegSetThreadName("nrfEvent");
-
-    while (!chThdShouldTerminateX()) {
-    	chEvtWaitAny(EVENT_MASK(0));
-    	nrf_flags = chEvtGetAndClearFlags(&el);
-    	if (nrf_flags & NRF52_EVENT_TX_SUCCESS) {
-    		chBSemSignal(&nrf_send);
-    	}
-    	if (nrf_flags & NRF52_EVENT_TX_FAILED) {
-    		chBSemSignal(&nrf_send);
-    	}
-    	if (nrf_flags & NRF52_EVENT_RX_RECEIVED) {
-    		chBSemSignal(&nrf_receive);
-    	}
-    }
-    chThdExit((msg_t) 0);
-}
-
-static thread_t *radio_send_thd;
-static THD_WORKING_AREA(waNRFSendThread, 384);
-static THD_FUNCTION(nrfSendThread, arg) {
-	(void)arg;
-
-	chRegSetThreadName("nrfSend");
-
-	chMBObjectInit(&mb_send_free, (msg_t*) send_free, NRF_SEND_BUFFERS);
-	chMBObjectInit(&mb_send_fill, (msg_t*) send_fill, NRF_SEND_BUFFERS);
-
-	// fill free buffers mailbox
-	for (uint8_t i=0; i < NRF_SEND_BUFFERS; i++)
-		chMBPostTimeout(&mb_send_free, (msg_t) &nrf_send_buf[i], TIME_IMMEDIATE);
-
-	while (!chThdShouldTerminateX()) {
-		uint8_t buf[MSGLEN];
-		void *pbuf;
-		nrf52_payload_t tx_payload = {
-			.pipe = NRF_TX_PIPE,
-			.length = MSGLEN,
-		};
-
-		if (chMBFetchTimeout(&mb_send_fill, (msg_t *) &pbuf, TIME_INFINITE) == MSG_OK) {
-			memcpy(buf, pbuf, MSGLEN);
-			chMBPostTimeout(&mb_send_free, (msg_t) pbuf, TIME_IMMEDIATE);
-		} else {
+// frame results of the current burst, counted by send_result()
+static struct {
+	uint32_t frames;
+	uint32_t done;
+	uint32_t delivered;
+	uint32_t dropped;
+	systime_t end;
+} burst;
+
+// frame result from the driver state machine, system locked, the message
+// object goes back to the pool, a dropped reading to the flash log first
+static void send_result(void *arg, nrf52_send_result_t const *result) {
+	nrf52_frame_t *frame = (nrf52_frame_t *) arg;
+
+	if (result->status != NRF52_SEND_OK && msg_class[frame - msg_frames] == SEND_TELEMETRY)
+		chMBPostI(&mb_send_log, (msg_t) frame);
+	else
+		chPoolFreeI(&msg_pool, frame);
+
+	burst.done++;
+	if (result->status == NRF52_SEND_OK)
+		burst.delivered++;
+	else
+		burst.dropped++;
+	chEvtSignalI(radio_thd, RADIO_EVT_SENT);
+}
+
+// time of a retransmit round, uS
+static uint32_t round_time(void) {
+	uint32_t round = (radiocfg.retransmit.count + 1) * (uint32_t) radiocfg.retransmit.delay;
+
+	// the backoffs of a busy channel add up to CCA_MAX_MS per frame
+	if (config.rfmode & RF_MODE_CCA)
+		round += CCA_MAX_MS * 1000;
+	return round;
+}
+
+// rounds of a frame are started within its budget, sendmax - 1 rounds
+// as the former software retries
+static sysinterval_t frame_budget(void) {
+	uint32_t round = round_time();
+
+	return TIME_US2I(round * (link_policy->sendmax - 1) - round / 2);
+}
+
+// next queued message object, the higher class first
+static bool queue_fetch(nrf52_frame_t **frame) {
+	for (uint8_t c=0; c < SEND_CLASSES; c++) {
+		if (chMBFetchTimeout(&mb_send_fill[c], (msg_t *) frame, TIME_IMMEDIATE) == MSG_OK)
+			return true;
+	}
+	return false;
+}
+
+// Encrypt the queued message objects in place and hand them to the driver,
+// the frames queued behind others get their budget after those
+static uint8_t fill_tx_fifo(systime_t start) {
+	uint8_t cnt = 0;
+	nrf52_frame_t *frame;
+
+	while (radio_tx_pending(&RFD1) < NRF52_TX_FIFO_SIZE && queue_fetch(&frame)) {
+		if (frame->data[0] != config.deviceid) {
+			chPoolFree(&msg_pool, frame);
 			continue;
 		}
 
-		if (buf[0] != config.deviceid) continue;
-
-		uint8_t aes[MSGLEN];
-		buf[MSGLEN-1] = CRC8(buf, MSGLEN-1);
-		AES128_ECB_encrypt(buf, aes_key, aes);
-		memcpy(&tx_payload.data, aes, MSGLEN);
-
-		uint8_t sendcnt = NRF_SEND_MAX;
-		while (--sendcnt) {
-			radio_stop_rx();
-			radio_write_payload(&tx_payload);
-			radio_start_tx();
-			if (chBSemWaitTimeout(&nrf_send, TIME_MS2I(NRF_SEND_MS)) == MSG_OK) {
-				if (nrf_flags == NRF52_EVENT_TX_SUCCESS) {
-					break;
-				}
-			}
+		frame->pipe = NRF_TX_PIPE;
+		frame->noack = false;
+		frame->deadline = chTimeAddX(start, frame_budget() * (radio_tx_pending(&RFD1) + 1));
+		frame->cb = send_result;
+		frame->arg = frame;
+		frame->data[frame->length-1] = CRC8(frame->data, frame->length-1);
+		for (uint8_t i=0; i < frame->length; i += 16)
+			AES128_ECB_encrypt(&frame->data[i], aes_key, &frame->data[i]);
+		if (radio_tx_queue(&RFD1, frame) == NRF52_SUCCESS) {
+			burst.frames++;
+			burst.end = chTimeAddX(frame->deadline, TIME_US2I(round_time()) + TIME_MS2I(NRF_SEND_MS));
+			cnt++;
+		} else {
+			chPoolFree(&msg_pool, frame);
 		}
+	}
+	return cnt;
+}
+
+// store the readings dropped in the burst, decrypted back in place
+static void log_dropped(void) {
+	nrf52_frame_t *frame;
 
-		if (sendcnt == 0) {
-			// set nRF52 send error
-			nrf_flags = NRF52_EVENT_TX_FAILED;
+	while (chMBFetchTimeout(&mb_send_log, (msg_t *) &frame, TIME_IMMEDIATE) == MSG_OK) {
+		for (uint8_t i=0; i < frame->length; i += 16)
+			AES128_ECB_decrypt(&frame->data[i], aes_key, &frame->data[i]);
+		if (writeLog(frame->data, frame->length))
+			link_stats.counters[STATS_LOG_STORED]++;
+		chPoolFree(&msg_pool, frame);
+	}
+}
+
+// queue the logged readings again after a good burst, a few per burst & wake cycle,
+// only free message objects are taken
+static void log_replay(void) {
+	nrf52_frame_t *frame;
+	uint8_t length;
+
+	for (uint8_t cnt=0; cnt < LOG_REPLAY_BURST && log_budget > 0 && pendingLog() > 0; cnt++) {
+		frame = (nrf52_frame_t *) chPoolAlloc(&msg_pool);
+		if (frame == NULL)
+			break;
+		if (!readLog(frame->data, &length)) {
+			chPoolFree(&msg_pool, frame);
+			break;
 		}
-		radio_start_rx();
+		frame->length = length;
+		// the gateway tells the old readings from the fresh ones, msgtype is
+		// at the same offset in the aggregated frames
+		((MESSAGE_T *) frame->data)->msgtype |= MSG_REPLAY;
+		msg_class[frame - msg_frames] = SEND_TELEMETRY;
+		queue_frame(frame);
+		log_budget--;
+		link_stats.counters[STATS_LOG_REPLAYED]++;
 	}
-	chThdExit((msg_t) 0);
 }
 
-static thread_t *radio_receive_thd;
-static THD_WORKING_AREA(waNRFReceiveThread, 256);
-static THD_FUNCTION(nrfReceiveThread, arg) {
-  (void)arg;
+// Send stage: the whole send queue goes out in one TX burst, the driver
+// retransmits each frame till its deadline and moves to the next frame by
+// itself, the messages queued meanwhile are put behind
+static bool send_burst(void) {
+	uint32_t tx_count = RFD1.tx_count;
+	cnt_t queued;
+
+	chSysLock();
+	queued = 0;
+	for (uint8_t c=0; c < SEND_CLASSES; c++)
+		queued += chMBGetUsedCountI(&mb_send_fill[c]);
+	chSysUnlock();
+	if (queued == 0)
+		return false;
+	prof_begin(PROF_SEND);
+
+	// an aligned wake cycle holds the burst till the slot start
+	systime_t begin = chVTGetSystemTimeX();
+	uint16_t delay = slot_wait();
+	systime_t start = chTimeAddX(chVTGetSystemTimeX(), TIME_US2I(delay));
+
+	// RX window is reopened only when the burst is over, the RADIO
+	// is disabled while the queue is encrypted
+	if (!ackpl_mode)
+		radio_stop_rx(&RFD1);
+
+	memset(&burst, 0, sizeof(burst));
+	chEvtGetAndClearEvents(RADIO_EVT_SENT);
+	fill_tx_fifo(start);
+
+	// the core sleeps while the RADIO ramps down
+	radio_wait_idle(&RFD1);
+	if (burst.frames > 0) {
+		radio_set_tx_power(&RFD1, tx_power_levels[config.tx_power]);
+		radio_set_channel(&RFD1, hop_channel());
+		radio_set_bitrate(&RFD1, bitrates[config.bitrate]);
+		radio_start_tx_at(&RFD1, delay);
+
+		if (first_tx) {
+			first_tx = false;
+			link_stats.counters[warm_start ? STATS_BOOT_TX_WARM : STATS_BOOT_TX_COLD] =
+					TIME_I2MS(chVTTimeElapsedSinceX(wake_time)) + delay / 1000;
+		}
+	}
 
-  chRegSetThreadName("nrfReceive");
+	while (burst.done < burst.frames) {
+		sysinterval_t left = chTimeDiffX(chVTGetSystemTimeX(), burst.end);
+		eventmask_t evt = 0;
 
-  chMBObjectInit(&mb_read_free, (msg_t*) read_free, NRF_READ_BUFFERS);
-  chMBObjectInit(&mb_read_fill, (msg_t*) read_fill, NRF_READ_BUFFERS);
+		if (chTimeIsInRangeX(chVTGetSystemTimeX(), begin, burst.end))
+			evt = chEvtWaitAnyTimeout(RADIO_EVT_RF | RADIO_EVT_SENT, left);
+		if (evt == 0) {
+			// the driver lost track, the rest of the frames are dropped
+			radio_flush_tx(&RFD1);
+			break;
+		}
 
-  // fill free buffers mailbox
-  for (uint8_t i=0; i < NRF_READ_BUFFERS; i++)
-	  chMBPostTimeout(&mb_read_free, (msg_t) &nrf_read_buf[i], TIME_IMMEDIATE);
+		if ((evt & RADIO_EVT_RF) && (chEvtGetAndClearFlags(&radio_el) & NRF52_EVENT_RX_RECEIVED))
+			rx_pending = true;
 
-  while (!chThdShouldTerminateX()) {
-	  nrf52_payload_t rx_payload;
+		// the frames are pipelined, the TX goes on with the new ones
+		if (fill_tx_fifo(chVTGetSystemTimeX()) > 0 || radio_tx_pending(&RFD1) > 0)
+			radio_start_tx(&RFD1);
+	}
 
-	  chBSemWait(&nrf_receive);
+	hop_result(burst.dropped == 0);
+	bitrate_result(burst.dropped == 0);
 
-	  memset(rx_payload.data, 0, MSGLEN);
+	// lost link, back to the full power at once
+	if (burst.dropped > 0)
+		set_tx_level(TX_POWER_LEVELS - 1);
 
-	  if (radio_read_rx_payload(&rx_payload) != NRF52_SUCCESS) continue;
-	  if (rx_payload.pipe != NRF_RX_PIPE) continue;
+	// the flash is written while the RADIO is off, the replays go with the next burst
+	log_dropped();
+	if (burst.dropped == 0 && burst.delivered > 0)
+		log_replay();
 
-	  void *pbuf;
-	  if (chMBFetchTimeout(&mb_read_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-		  memcpy(pbuf, rx_payload.data, MSGLEN);
-		  chMBPostTimeout(&mb_read_fill, (msg_t) pbuf, TIME_IMMEDIATE);
-	  } else {
-		  continue;
-	  }
-  }
-  chThdExit((msg_t) 0);
+	link_stats.counters[STATS_SEND_DROPPED] += burst.dropped;
+	link_counters_collect();
+	link_stats_update(burst.delivered, burst.dropped, RFD1.tx_count - tx_count);
+
+	// report the new blacklisted channels upstream
+	if (hop_report) {
+		hop_report = false;
+		send_cfg_value(ADDR_INFO_HOPBL, hop_blacklist());
+	}
+
+	if (!ackpl_mode)
+		radio_start_rx(&RFD1);
+	prof_end(PROF_SEND);
+	return true;
 }
 
 // message type SENSOR_INFO
@@ -182,6 +623,18 @@ static void parseMSGInfo(MESSAGE_T *msg) {
 		return;
 
 	switch (msg->address) {
+	case ADDR_INFO_TIME:
+		slot_time((uint32_t) msg->data.i32);
+		break;
+	case ADDR_INFO_RSSI:
+		link_stats.rssi = (int8_t) msg->data.i32;
+		link_stats_save();
+		// step the TX power to keep the uplink RSSI within the margin
+		if (msg->data.i32 > RSSI_TARGET + RSSI_MARGIN && config.tx_power > 0)
+			set_tx_level(config.tx_power - 1);
+		else if (msg->data.i32 < RSSI_TARGET - RSSI_MARGIN)
+			set_tx_level(config.tx_power + 1);
+		break;
 	default:	//UNKNOWN SENSOR
 	  break;
 	}
@@ -275,218 +728,470 @@ static void parseMSGCmd(MESSAGE_T *msg) {
 		}
 		send_cfg_value(ADDR_CFG_HEATER, config.heater);
 		break;
+	case ADDR_CFG_RFMODE:
+		if (msg->command == CMD_CFGWRITE) {
+			if (msg->data.i32 & ~RF_MODE_MASK) {
+			    send_cmd_error(ADDR_CFG_RFMODE, ERR_BAD_PARAM);
+			    break;
+			}
+			config.rfmode = (uint8_t) msg->data.i32;
+			write_config = true;
+		}
+		send_cfg_value(ADDR_CFG_RFMODE, config.rfmode);
+		break;
+	case ADDR_CFG_HOP:
+		if (msg->command == CMD_CFGWRITE) {
+			bool valid = true;
+			for (uint8_t i=0; i < HOP_CHANNELS; i++) {
+				uint8_t ch = ((uint32_t) msg->data.i32 >> (8 * i)) & 0xFF;
+				if (ch != HOP_UNUSED && ch > 100)
+					valid = false;
+			}
+			if (!valid) {
+			    send_cmd_error(ADDR_CFG_HOP, ERR_BAD_PARAM);
+			    break;
+			}
+			config.hop_channels = (uint32_t) msg->data.i32;
+			write_config = true;
+		}
+		send_cfg_value(ADDR_CFG_HOP, config.hop_channels);
+		break;
+	case ADDR_CFG_SLOT:
+		if (msg->command == CMD_CFGWRITE) {
+			uint32_t slot = (uint32_t) msg->data.i32;
+			uint32_t period = slot >> 16;
+			if (slot != SLOT_OFF && (period < 2 || period > 36000 ||
+				SLOT_UNIT * (slot & 0xFFFF) >= 1000 * period)) {
+			    send_cmd_error(ADDR_CFG_SLOT, ERR_BAD_PARAM);
+			    break;
+			}
+			config.slot = slot;
+			write_config = true;
+		}
+		send_cfg_value(ADDR_CFG_SLOT, config.slot);
+		break;
+	case ADDR_INFO_STATS:
+		if (msg->data.i32 < 0 || msg->data.i32 >= STATS_COUNT) {
+		    send_cmd_error(ADDR_INFO_STATS, ERR_BAD_PARAM);
+		    break;
+		}
+		link_counters_collect();
+		if (msg->command == CMD_CFGWRITE) {
+			memset(link_stats.counters, 0, sizeof(link_stats.counters));
+			link_stats_save();
+		}
+		send_stats_value((stats_index_t) msg->data.i32);
+		break;
+	case ADDR_INFO_PROFILE:
+		send_profile();
+		break;
 	default:
       send_cmd_error(ADDR_DEVICE, ERR_BAD_ADDR);
 	  break;
 	}
 }
 
-static thread_t *radio_parse_thd;
-static THD_WORKING_AREA(waNRFParseThread, 256);
-static THD_FUNCTION(nrfParseThread, arg) {
-  (void)arg;
+// Parse stage: received frames are decrypted & parsed in place in the RX FIFO
+static void parse_messages(void) {
+  nrf52_frame_t *frame;
 
-  chRegSetThreadName("nrfParse");
+  while (radio_rx_acquire(&RFD1, &frame) == NRF52_SUCCESS) {
+	  MESSAGE_T *rcvmsg = (MESSAGE_T *) frame->data;
 
-  while (!chThdShouldTerminateX()) {
-	  void *pbuf;
-	  uint8_t buf[MSGLEN];
-	  MESSAGE_T rcvmsg;
-
-	  if (chMBFetchTimeout(&mb_read_fill, (msg_t *) &pbuf, TIME_INFINITE) == MSG_OK) {
-		  memcpy(&buf, pbuf, MSGLEN);
-		  chMBPostTimeout(&mb_read_free, (msg_t) pbuf, TIME_IMMEDIATE);
-	  } else {
+	  // ACK payloads come in on the TX pipe
+	  if (frame->pipe != (ackpl_mode ? NRF_TX_PIPE : NRF_RX_PIPE) || frame->length < MSGLEN) {
+		  radio_rx_release(&RFD1);
 		  continue;
 	  }
 
-	  AES128_ECB_decrypt(buf, aes_key, (uint8_t *) &rcvmsg);
+	  AES128_ECB_decrypt(frame->data, aes_key, frame->data);
 
-	  if (rcvmsg.crc != CRC8((uint8_t *) &rcvmsg, MSGLEN-1))
-		  continue;
-	  if (rcvmsg.deviceid != config.deviceid)
+	  if (rcvmsg->crc != CRC8((uint8_t *) rcvmsg, MSGLEN-1) ||
+		  rcvmsg->deviceid != config.deviceid) {
+		  radio_rx_release(&RFD1);
 		  continue;
+	  }
 
-	  switch (rcvmsg.msgtype) {
+	  switch (rcvmsg->msgtype) {
 	  case MSG_INFO:
-		  parseMSGInfo(&rcvmsg);
+		  parseMSGInfo(rcvmsg);
 		  break;
 	  case MSG_DATA:
-		  parseMSGData(&rcvmsg);
+		  parseMSGData(rcvmsg);
 		  break;
 	  case MSG_ERROR:
-		  parseMSGError(&rcvmsg);
+		  parseMSGError(rcvmsg);
 		  break;
 	  case MSG_CMD:
-		  parseMSGCmd(&rcvmsg);
+		  parseMSGCmd(rcvmsg);
 		  break;
 	  default:
 		  break;
 	  }
 
-  } // while
+	  radio_rx_release(&RFD1);
+  }
+}
+
+// NRF52 radio task: receive, parse & send stages driven by the events mask
+static THD_WORKING_AREA(waNRFRadioThread, 384);
+static THD_FUNCTION(nrfRadioThread, arg) {
+  (void)arg;
+
+  chRegSetThreadName("nrfRadio");
+
+  chEvtRegisterMask(&RFD1.eventsrc, &radio_el, RADIO_EVT_RF);
+
+  while (!chThdShouldTerminateX()) {
+	  eventmask_t evt = chEvtWaitAny(RADIO_EVT_RF | RADIO_EVT_SEND);
+
+	  if (evt & RADIO_EVT_RF) {
+		  if (chEvtGetAndClearFlags(&radio_el) & NRF52_EVENT_RX_RECEIVED)
+			  rx_pending = true;
+	  }
+
+	  // run the stages until there is nothing to parse or send,
+	  // parsed commands queue their replies for the send stage
+	  while (!chThdShouldTerminateX()) {
+		  if (rx_pending) {
+			  rx_pending = false;
+			  parse_messages();
+		  } else if (!send_burst()) {
+			  break;
+		  }
+	  }
+
+	  chBSemSignal(&send_done);
+  }
+
+  chEvtUnregister(&RFD1.eventsrc, &radio_el);
   chThdExit((msg_t) 0);
 }
 
 void radio_start(void) {
+  prof_begin(PROF_RADIO_INIT);
   config.clt_addr[NRF_ADDR_LEN-1] = config.deviceid;
   radiocfg.address.pipe_prefixes[NRF_RX_PIPE] = config.clt_addr[0];
   radiocfg.address.pipe_prefixes[NRF_TX_PIPE] = config.srv_addr[0];
   memcpy(radiocfg.address.base_addr_p0, &config.clt_addr[1], NRF_ADDR_LEN-1);
   memcpy(radiocfg.address.base_addr_p1, &config.srv_addr[1], NRF_ADDR_LEN-1);
-  radiocfg.address.rf_channel = config.channel;
-  radio_init(&radiocfg);
 
-  chBSemObjectInit(&nrf_receive, TRUE);
-  chBSemObjectInit(&nrf_send, TRUE);
+  // aggregated frames & ACK payloads need dynamic payload length, the gateway enables it
+  aggr_mode = (config.rfmode & RF_MODE_AGGR) != 0;
+  ackpl_mode = (config.rfmode & RF_MODE_ACKPL) != 0;
+  radiocfg.protocol = (aggr_mode || ackpl_mode) ? NRF52_PROTOCOL_ESB_DPL : NRF52_PROTOCOL_ESB;
+  radiocfg.mode = ackpl_mode ? NRF52_MODE_PTX : NRF52_MODE_PRX;
+  if (config.tx_power >= TX_POWER_LEVELS)
+	  config.tx_power = TX_POWER_LEVELS - 1;
+  radiocfg.tx_power = tx_power_levels[config.tx_power];
+
+  // retransmit tuning from the link statistics of the previous cycles
+  link_stats_init();
+  link_policy = &link_policies[link_quality()];
+  radiocfg.retransmit.delay = link_policy->delay;
+  radiocfg.retransmit.count = link_policy->count;
+
+  // listen before talk, the backoffs are counted with the link counters
+  radiocfg.cca.threshold = (config.rfmode & RF_MODE_CCA) ? CCA_THRESHOLD : 0;
+  radiocfg.cca.backoffs = CCA_BACKOFFS;
+  radiocfg.cca.window = CCA_WINDOW;
+
+  // start on the channel the last cycle ended with
+  hop_init();
+  radiocfg.address.rf_channel = hop_channel();
+
+  bitrate_init();
+  radiocfg.bitrate = bitrates[config.bitrate];
+
+  slot_init();
+
+  aggr_frame = NULL;
+  aggr_len = 0;
+  log_budget = LOG_REPLAY_WAKE;
+  first_tx = true;
+
+  radio_init(&RFD1, &radiocfg);
+
+  for (uint8_t c=0; c < SEND_CLASSES; c++)
+	  chMBObjectInit(&mb_send_fill[c], (msg_t*) send_fill[c], NRF_SEND_BUFFERS);
+  chMBObjectInit(&mb_send_log, (msg_t*) send_log, NRF_SEND_BUFFERS);
+  chPoolObjectInit(&msg_pool, sizeof(nrf52_frame_t), NULL);
+  chPoolLoadArray(&msg_pool, msg_frames, NRF_SEND_BUFFERS);
+
+  rx_pending = false;
+  chBSemObjectInit(&send_done, FALSE);
+
+  // NRF52 radio task
+  radio_thd = chThdCreateStatic(waNRFRadioThread, sizeof(waNRFRadioThread), RADIO_PRIO, nrfRadioThread, NULL);
+
+  // the RX window opens after the first burst, the gateway answers the node
+  // and the RADIO stays off while the sensors are read
+  prof_end(PROF_RADIO_INIT);
+}
 
-  // NRF52 message receive thread
-  radio_receive_thd = chThdCreateStatic(waNRFReceiveThread, sizeof(waNRFReceiveThread), RADIO_RECEIVE_PRIO, nrfReceiveThread, NULL);
+void radio_stop(void) {
+  send_flush();
+  radio_disable(&RFD1);
+
+  chThdTerminate(radio_thd);
+  chEvtSignal(radio_thd, RADIO_EVT_SEND);
+  chThdWait(radio_thd);
+  radio_thd = NULL;
+}
+
+// count the message dropped from the send queue
+static void queue_drop(send_class_t cls) {
+  link_stats.counters[STATS_QUEUE_DROPPED + cls]++;
+  link_stats_save();
+}
+
+// new zeroed message object, it is built in place and handed to the driver,
+// with the pool exhausted the oldest queued message of a lower class makes room
+static nrf52_frame_t *msg_alloc(uint8_t length, send_class_t cls) {
+  nrf52_frame_t *frame;
 
-  // NRF52 received messages parse thread
-  radio_parse_thd = chThdCreateStatic(waNRFParseThread, sizeof(waNRFParseThread), RADIO_PARSE_PRIO, nrfParseThread, NULL);
+  if (radio_thd == NULL)
+	  return NULL;
 
-  // NRF52 message send thread
-  radio_send_thd = chThdCreateStatic(waNRFSendThread, sizeof(waNRFSendThread), RADIO_SEND_PRIO, nrfSendThread, NULL);
+  frame = (nrf52_frame_t *) chPoolAlloc(&msg_pool);
+  for (uint8_t c = SEND_CLASSES - 1; frame == NULL && c > cls; c--) {
+	  if (chMBFetchTimeout(&mb_send_fill[c], (msg_t *) &frame, TIME_IMMEDIATE) == MSG_OK)
+		  queue_drop(c);
+	  else
+		  frame = NULL;
+  }
+  if (frame == NULL) {
+	  queue_drop(cls);
+	  return NULL;
+  }
+
+  memset(frame->data, 0, length);
+  frame->length = length;
+  msg_class[frame - msg_frames] = cls;
+  return frame;
+}
 
-  // NRF52 events polling thread
-  radio_event_thd = chThdCreateStatic(waNRFEventThread, sizeof(waNRFEventThread), RADIO_EVENT_PRIO, NRFEventThread, NULL);
+// queue the message object in its class, it is sent with the next send_flush() burst
+static void queue_frame(nrf52_frame_t *frame) {
+  chMBPostTimeout(&mb_send_fill[msg_class[frame - msg_frames]], (msg_t) frame, TIME_IMMEDIATE);
+}
 
-  radio_start_rx();
+static void queue_message(MESSAGE_T *msg) {
+  queue_frame(MSG_FRAME(msg));
 }
 
-void radio_stop(void) {
-  radio_disable();
+// queue the aggregated readings collected so far
+static void aggr_queue(void) {
+  if (aggr_frame == NULL)
+	  return;
 
-  MESSAGE_T msg;
-  memset((void *) &msg, 0, MSGLEN);
+  MESSAGE_AGGR_T *aggr = (MESSAGE_AGGR_T *) aggr_frame->data;
+  aggr->deviceid = config.deviceid;
+  aggr->firmware = FIRMWARE;
+  aggr->addrnum = ADDRNUM;
+  aggr->msgtype = MSG_AGGR;
+  queue_frame(aggr_frame);
 
-  chThdTerminate(radio_parse_thd);
-  void *pbuf;
-  if (chMBFetchTimeout(&mb_read_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &msg, MSGLEN);
-      chMBPostTimeout(&mb_read_fill, (msg_t) pbuf, TIME_IMMEDIATE);
+  aggr_frame = NULL;
+  aggr_len = 0;
+}
+
+// add TLV record to the aggregated message, a full message is queued first
+static void aggr_add(uint8_t addr, uint8_t type, const void *value) {
+  static const uint8_t value_len[] = { [VAL_ch] = 1, [VAL_i16] = 2, [VAL_i32] = 4, [VAL_fl] = 4 };
+  uint8_t len = value_len[type & AGGR_TYPE_VALUE_Msk];
+
+  if (aggr_len + 2 + len > AGGR_DATALEN)
+	  aggr_queue();
+  if (aggr_frame == NULL) {
+	  aggr_frame = msg_alloc(MSGLEN_AGGR, SEND_TELEMETRY);
+	  if (aggr_frame == NULL)
+		  return;
   }
-  chThdWait(radio_parse_thd);
 
-  chThdTerminate(radio_send_thd);
-  if (chMBFetchTimeout(&mb_send_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &msg, MSGLEN);
-      chMBPostTimeout(&mb_send_fill, (msg_t) pbuf, TIME_IMMEDIATE);
+  MESSAGE_AGGR_T *aggr = (MESSAGE_AGGR_T *) aggr_frame->data;
+  aggr->data[aggr_len++] = addr;
+  aggr->data[aggr_len++] = type;
+  memcpy(&aggr->data[aggr_len], value, len);
+  aggr_len += len;
+  aggr->count++;
+}
+
+static void aggr_add_value(uint8_t addr, int32_t value, int8_t power) {
+  uint8_t type = (power << AGGR_TYPE_POWER_Pos) & AGGR_TYPE_POWER_Msk;
+
+  if (value >= INT16_MIN && value <= INT16_MAX) {
+	  int16_t v16 = (int16_t) value;
+	  aggr_add(addr, type | VAL_i16, &v16);
+  } else {
+	  aggr_add(addr, type | VAL_i32, &value);
   }
-  chThdWait(radio_send_thd);
+}
 
-  chThdTerminate(radio_receive_thd);
-  chBSemSignal(&nrf_receive);
-  chThdWait(radio_receive_thd);
+static void aggr_add_error(uint8_t addr, uint8_t error) {
+  aggr_add(addr, AGGR_TYPE_ERROR | VAL_ch, &error);
+}
+
+// send all queued messages in one burst and wait for the end
+void send_flush(void) {
+  if (radio_thd == NULL)
+	  return;
+
+  aggr_queue();
 
-  chThdTerminate(radio_event_thd);
-  RFD1.flags = 0;
-  chEvtBroadcastFlags(&RFD1.eventsrc, (eventflags_t) 0);
-  chThdWait(radio_event_thd);
+  chBSemReset(&send_done, TRUE);
+  chEvtSignal(radio_thd, RADIO_EVT_SEND);
+  chBSemWait(&send_done);
 }
 
-static void msg_header(MESSAGE_T *msg) {
-  memset(msg, 0, MSGLEN);
+// new message object with the header filled in, NULL if the queue is full of the same or higher class
+static MESSAGE_T *msg_new(send_class_t cls) {
+  nrf52_frame_t *frame = msg_alloc(MSGLEN, cls);
+  MESSAGE_T *msg;
+
+  if (frame == NULL)
+	  return NULL;
+
+  msg = (MESSAGE_T *) frame->data;
   msg->firmware = FIRMWARE;
   msg->deviceid = config.deviceid;
   msg->addrnum = ADDRNUM;
   msg->cmdparam = CMD_WAIT;
+  return msg;
 }
 
 void send_vbat(address_t addr, msg_error_t error) {
-  MESSAGE_T sndmsg;
+  MESSAGE_T *sndmsg;
 
-  msg_header(&sndmsg);
-  sndmsg.address = addr;
-  sndmsg.msgtype = MSG_DATA;
-  sndmsg.datatype = VAL_i32;
-  sndmsg.data.i32 = error;
-  if (error == ERR_VBAT_LOW) {
-	  sndmsg.msgtype = MSG_ERROR;
-	  sndmsg.error = error;
+  // the low battery goes in its own message ahead of the readings
+  if (aggr_mode && error != ERR_VBAT_LOW) {
+	  uint8_t status = error;
+	  aggr_add(addr, VAL_ch, &status);
+	  return;
   }
-  void *pbuf;
-  if (chMBFetchTimeout(&mb_send_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &sndmsg, MSGLEN);
-      chMBPostTimeout(&mb_send_fill, (msg_t) pbuf, TIME_IMMEDIATE);
+
+  sndmsg = msg_new(error == ERR_VBAT_LOW ? SEND_CRITICAL : SEND_TELEMETRY);
+  if (sndmsg == NULL)
+	  return;
+  sndmsg->address = addr;
+  sndmsg->msgtype = MSG_DATA;
+  sndmsg->datatype = VAL_i32;
+  sndmsg->data.i32 = error;
+  if (error == ERR_VBAT_LOW) {
+	  sndmsg->msgtype = MSG_ERROR;
+	  sndmsg->error = error;
   }
+  queue_message(sndmsg);
 }
 
 void send_cmd_error(address_t addr, msg_error_t error) {
-  MESSAGE_T sndmsg;
-
-  msg_header(&sndmsg);
-  sndmsg.msgtype = MSG_ERROR;
-  sndmsg.address = addr;
-  sndmsg.error = error;
-  sndmsg.data.i32 = error;
-  void *pbuf;
-  if (chMBFetchTimeout(&mb_send_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &sndmsg, MSGLEN);
-      chMBPostTimeout(&mb_send_fill, (msg_t) pbuf, TIME_IMMEDIATE);
-  }
+  MESSAGE_T *sndmsg;
+
+  sndmsg = msg_new(SEND_COMMAND);
+  if (sndmsg == NULL)
+	  return;
+  sndmsg->msgtype = MSG_ERROR;
+  sndmsg->address = addr;
+  sndmsg->error = error;
+  sndmsg->data.i32 = error;
+  queue_message(sndmsg);
 }
 
 void send_cfg_value(address_t addr, uint32_t value) {
-  MESSAGE_T sndmsg;
-
-  msg_header(&sndmsg);
-  sndmsg.msgtype = MSG_INFO;
-  sndmsg.address = addr;
-  sndmsg.data.i32 = value;
-  void *pbuf;
-  if (chMBFetchTimeout(&mb_send_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &sndmsg, MSGLEN);
-      chMBPostTimeout(&mb_send_fill, (msg_t) pbuf, TIME_IMMEDIATE);
+  MESSAGE_T *sndmsg;
+
+  sndmsg = msg_new(SEND_COMMAND);
+  if (sndmsg == NULL)
+	  return;
+  sndmsg->msgtype = MSG_INFO;
+  sndmsg->address = addr;
+  sndmsg->data.i32 = value;
+  queue_message(sndmsg);
+}
+
+// link counter, the index goes back in cmdparam
+static void send_stats_value(stats_index_t index) {
+  MESSAGE_T *sndmsg;
+
+  sndmsg = msg_new(SEND_COMMAND);
+  if (sndmsg == NULL)
+	  return;
+  sndmsg->msgtype = MSG_INFO;
+  sndmsg->address = ADDR_INFO_STATS;
+  sndmsg->datatype = VAL_i32;
+  sndmsg->data.i32 = link_stats.counters[index];
+  sndmsg->cmdparam = index;
+  queue_message(sndmsg);
+}
+
+// last wake cycle profile, 4 byte chunks with the offset in cmdparam
+static void send_profile(void) {
+  const uint8_t *rec = (const uint8_t *) prof_last();
+  MESSAGE_T *sndmsg;
+
+  for (uint8_t i=0; i < PROF_CHUNKS; i++) {
+	  uint8_t len = sizeof(prof_record_t) - 4 * i;
+
+	  sndmsg = msg_new(SEND_COMMAND);
+	  if (sndmsg == NULL)
+		  return;
+	  sndmsg->msgtype = MSG_INFO;
+	  sndmsg->address = ADDR_INFO_PROFILE;
+	  memcpy(sndmsg->data.c4, &rec[4 * i], len < 4 ? len : 4);
+	  sndmsg->cmdparam = 4 * i;
+	  queue_message(sndmsg);
   }
 }
 
 void send_sensor_value(uint8_t addr, int32_t value, int8_t power) {
-  MESSAGE_T sndmsg;
-
-  msg_header(&sndmsg);
-  sndmsg.msgtype = MSG_DATA;
-  sndmsg.address = addr;
-  sndmsg.datatype = VAL_i32;
-  sndmsg.data.i32 = value;
-  sndmsg.datapower = power;
-  void *pbuf;
-  if (chMBFetchTimeout(&mb_send_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &sndmsg, MSGLEN);
-      chMBPostTimeout(&mb_send_fill, (msg_t) pbuf, TIME_IMMEDIATE);
+  MESSAGE_T *sndmsg;
+
+  if (aggr_mode) {
+	  aggr_add_value(addr, value, power);
+	  return;
   }
+
+  sndmsg = msg_new(SEND_TELEMETRY);
+  if (sndmsg == NULL)
+	  return;
+  sndmsg->msgtype = MSG_DATA;
+  sndmsg->address = addr;
+  sndmsg->datatype = VAL_i32;
+  sndmsg->data.i32 = value;
+  sndmsg->datapower = power;
+  queue_message(sndmsg);
 }
 
 void send_sensor_error(uint8_t addr, uint8_t error) {
-  MESSAGE_T sndmsg;
-
-  msg_header(&sndmsg);
-  sndmsg.msgtype = MSG_ERROR;
-  sndmsg.address = addr;
-  sndmsg.error = error;
-  sndmsg.data.i32 = error;
-  void *pbuf;
-  if (chMBFetchTimeout(&mb_send_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &sndmsg, MSGLEN);
-      chMBPostTimeout(&mb_send_fill, (msg_t) pbuf, TIME_IMMEDIATE);
+  MESSAGE_T *sndmsg;
+
+  if (aggr_mode) {
+	  aggr_add_error(addr, error);
+	  return;
   }
+
+  sndmsg = msg_new(SEND_TELEMETRY);
+  if (sndmsg == NULL)
+	  return;
+  sndmsg->msgtype = MSG_ERROR;
+  sndmsg->address = addr;
+  sndmsg->error = error;
+  sndmsg->data.i32 = error;
+  queue_message(sndmsg);
 }
 
 void send_msg_wait(void) {
-  MESSAGE_T sndmsg;
+  MESSAGE_T *sndmsg;
 
 #if DEBUG
 	chprintf((BaseSequentialStream *) &SD1, "msg: waiting..\r\n");
 #endif
-  msg_header(&sndmsg);
-  sndmsg.msgtype = MSG_CMD;
-  sndmsg.command = CMD_MSGWAIT;
-  void *pbuf;
-  if (chMBFetchTimeout(&mb_send_free, (msg_t *) &pbuf, TIME_IMMEDIATE) == MSG_OK) {
-	  memcpy(pbuf, &sndmsg, MSGLEN);
-      chMBPostTimeout(&mb_send_fill, (msg_t) pbuf, TIME_IMMEDIATE);
-  }
+  sndmsg = msg_new(SEND_COMMAND);
+  if (sndmsg == NULL)
+	  return;
+  sndmsg->msgtype = MSG_CMD;
+  sndmsg->command = CMD_MSGWAIT;
+  queue_message(sndmsg);
   msg_received = false;
 }
 
@@ -8,14 +8,66 @@
 #ifndef RADIO_H_
 #define RADIO_H_
 
-#define NRF_READ_BUFFERS	12
 #define NRF_SEND_BUFFERS	12
 
-// processes priority also check nrf52_radio.h
-#define RADIO_RECEIVE_PRIO	(NORMALPRIO + 2)
-#define RADIO_SEND_PRIO		(NORMALPRIO + 2)
-#define RADIO_EVENT_PRIO	(NORMALPRIO + 3)
-#define RADIO_PARSE_PRIO	(NORMALPRIO + 1)
+// link statistics kept in no init RAM across the wake cycles
+#define LINK_MAGIC			0x4C4E4B31
+#define LINK_EWMA_SHIFT		3		// EWMA weight 1/8
+#define LINK_ATT_ONE		16		// attempts average fixed point 1.0
+#define LINK_FAIL_ONE		256		// failure ratio fixed point 1.0
+
+typedef struct {
+	uint32_t magic;
+	uint16_t attempts;		// transmissions per delivered frame, x LINK_ATT_ONE
+	uint16_t failures;		// dropped frames ratio, x LINK_FAIL_ONE
+	int8_t rssi;			// last uplink RSSI reported by the gateway, dBm
+	uint8_t hop_index;		// current hop list entry
+	uint32_t hop_list;		// hop list the state below belongs to
+	uint8_t hop_fails[HOP_CHANNELS];	// failed bursts in a row
+	uint8_t hop_ttl[HOP_CHANNELS];		// blacklist cycles left
+	uint8_t rate_fails;		// failed bursts in a row at 2 Mbps
+	uint8_t rate_holdoff;	// wake cycles left before 2 Mbps is tried again
+	uint32_t counters[STATS_COUNT];	// link counters, ADDR_INFO_STATS
+	uint32_t slot;			// slot config the state below belongs to
+	uint16_t slot_guard;	// last wake up time before the slot, mS
+	int16_t slot_late;		// wake up to wake_time latency, mS
+	uint8_t slot_sync;		// wake cycles left aligned to the slot
+	uint8_t crc;
+} link_stats_t;
+
+// retransmit policy picked from the link statistics
+typedef enum {
+	LINK_GOOD,
+	LINK_FAIR,
+	LINK_POOR,
+} link_quality_t;
+
+typedef struct {
+	uint16_t delay;			// hardware retransmit delay, uS
+	uint16_t count;			// hardware retransmits
+	uint8_t sendmax;		// retransmit rounds of a frame + 1
+} link_policy_t;
+
+// link_policy_t table by link_quality_t, shared with the host simulation:
+// GOOD the first attempts go through, keep the radio on short
+// FAIR the former static setting
+// POOR wait out interference in hardware, software retries rarely help
+#define LINK_POLICIES {							\
+	[LINK_GOOD] = { 600, 2, 2 },				\
+	[LINK_FAIR] = { 750, 3, NRF_SEND_MAX },		\
+	[LINK_POOR] = { 1500, 6, 2 },				\
+}
+
+// send queue classes, a higher class goes first and evicts the lower ones
+typedef enum {
+	SEND_CRITICAL,			// VBAT low, power fail warning
+	SEND_COMMAND,			// command replies, config & stats values
+	SEND_TELEMETRY,			// sensor readings
+	SEND_CLASSES,
+} send_class_t;
+
+// radio task priority also check nrf52_radio.h
+#define RADIO_PRIO			(NORMALPRIO + 2)
 
 
 void radio_start(void);
@@ -27,6 +79,8 @@ void send_cfg_value(address_t addr, uint32_t value);
 void send_sensor_value(uint8_t addr, int32_t value, int8_t power);
 void send_sensor_error(uint8_t addr, uint8_t error);
 void send_msg_wait(void);
+void send_flush(void);
+uint32_t slot_sleep(uint32_t guard);
 
 extern volatile uint8_t	msg_received;
 
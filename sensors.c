@@ -0,0 +1,102 @@
+/*
+ * sensors.c
+ *
+ *  Sensors readout, SI7021 & DHT tasks run together behind LINE_PWR
+ *
+ *  Both sensors power up at once, the wake cycle takes the longest
+ *  sensor path instead of their sum. The RADIO is configured meanwhile, its
+ *  HFXO starts with the first reading queued.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "main.h"
+#include "sensors.h"
+#include "profile.h"
+
+#define SENSORS_PRIO		(NORMALPRIO + 1)	// power up waits start before the radio
+
+sensors_t sensors;
+
+static thread_t *sensors_thd;	// waits for the readout events
+static thread_t *si7021_thd;
+static thread_t *dht_thd;
+
+/*
+ * SI7021 readout task, the heater runs on a saturated RH reading.
+ */
+static THD_WORKING_AREA(waSI7021Thread, 256);
+static THD_FUNCTION(SI7021Thread, arg) {
+  (void)arg;
+  chRegSetThreadName("SI7021Thd");
+
+  sensors.si_rslt = si7021_init(SI7021_RES_RH10_T13);
+  if (sensors.si_rslt == SI7021_OK) {
+	sensors.si_rslt = si7021_read(&sensors.si_hum, &sensors.si_temp);
+	if (sensors.si_rslt == SI7021_OK && config.heater > 0 && sensors.si_hum >= 1000) {
+	  if (si7021_heater_power(SI7021_HEATER_3MA) == SI7021_OK) {
+		prof_begin(PROF_HEATER);
+		si7021_heater(1);
+		chThdSleepSeconds(config.heater);
+		si7021_heater(0);
+		prof_end(PROF_HEATER);
+	  }
+	}
+  }
+  si7021_stop();
+
+  chEvtSignal(sensors_thd, SENSORS_EVT_SI7021);
+  chThdExit((msg_t) 0);
+}
+
+/*
+ * DHT readout task, the power up wait is counted from LINE_PWR on.
+ */
+static THD_WORKING_AREA(waDHTReadThread, 256);
+static THD_FUNCTION(DHTReadThread, arg) {
+  (void)arg;
+  chRegSetThreadName("DHTReadThd");
+
+  prof_begin(PROF_DHT_PWRUP);
+  chThdSleepMilliseconds(DHT_PWRUP);
+  prof_end(PROF_DHT_PWRUP);
+
+  dht_init();
+  sensors.dht_rslt = dht_read(&sensors.dht_temp, &sensors.dht_hum);
+  dht_stop();
+
+  chEvtSignal(sensors_thd, SENSORS_EVT_DHT);
+  chThdExit((msg_t) 0);
+}
+
+// sensors power up & readout tasks start, returns the events to wait for
+eventmask_t sensors_start(void) {
+  eventmask_t pending = SENSORS_EVT_SI7021;
+
+  sensors_thd = chThdGetSelfX();
+  chEvtGetAndClearEvents(SENSORS_EVT_SI7021 | SENSORS_EVT_DHT);
+
+  palSetLineMode(LINE_PWR, PAL_MODE_OUTPUT_PUSHPULL);
+  palSetLine(LINE_PWR);
+
+  si7021_thd = chThdCreateStatic(waSI7021Thread, sizeof(waSI7021Thread), SENSORS_PRIO, SI7021Thread, NULL);
+  if (config.dht_en) {
+	dht_thd = chThdCreateStatic(waDHTReadThread, sizeof(waDHTReadThread), SENSORS_PRIO, DHTReadThread, NULL);
+	pending |= SENSORS_EVT_DHT;
+  }
+
+  return pending;
+}
+
+// readout tasks are over, sensors power down
+void sensors_stop(void) {
+  chThdWait(si7021_thd);
+  si7021_thd = NULL;
+  if (dht_thd) {
+	chThdWait(dht_thd);
+	dht_thd = NULL;
+  }
+
+  palSetLineMode(LINE_PWR, PAL_MODE_UNCONNECTED);
+}
@@ -0,0 +1,31 @@
+/*
+ * sensors.h
+ *
+ *  Sensors readout, SI7021 & DHT tasks run together behind LINE_PWR
+ */
+
+#ifndef SENSORS_H_
+#define SENSORS_H_
+
+#include "si7021.h"
+#include "dht.h"
+
+// readout done events, signalled to the thread that started the sensors
+#define SENSORS_EVT_SI7021	EVENT_MASK(0)
+#define SENSORS_EVT_DHT		EVENT_MASK(1)
+
+typedef struct {
+	si7021error_t si_rslt;
+	int16_t si_temp;		// 1/10 deg C
+	uint16_t si_hum;		// 1/10 %
+	dht_error_t dht_rslt;
+	int16_t dht_temp;		// 1/10 deg C
+	uint16_t dht_hum;		// 1/10 %
+} sensors_t;
+
+eventmask_t sensors_start(void);
+void sensors_stop(void);
+
+extern sensors_t sensors;
+
+#endif /* SENSORS_H_ */
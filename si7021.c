@@ -39,6 +39,7 @@
 
 #include "si7021.h"
 #include "main.h"
+#include "profile.h"
 
 static uint8_t convtime;
 
@@ -72,7 +73,9 @@ static uint8_t calcCRC(uint8_t *data) {
 si7021error_t si7021_init(uint8_t res) {
 	uint8_t txbuf[2], rxbuf;
 
+	prof_begin(PROF_SI7021_PWRUP);
 	chThdSleepMilliseconds(SI7021_TIME_PWRUP);
+	prof_end(PROF_SI7021_PWRUP);
 
     palSetLineMode(LINE_I2C_SCL, PAL_MODE_OUTPUT_OPENDRAIN);
     palSetLineMode(LINE_I2C_SDA, PAL_MODE_OUTPUT_OPENDRAIN);
@@ -125,9 +128,13 @@ void si7021_stop(void) {
 si7021error_t si7021_read(uint16_t *humidity, int16_t *temperature) {
 	uint8_t txbuf=0, rxbuf[3];
 	int32_t data;
+	msg_t msg;
 
 	txbuf = MEASURE_RH_HM;
-	if (i2cMasterTransmitTimeout(&I2CD1, SI7021_ADDR, &txbuf, 1, rxbuf, 3, TIME_MS2I(convtime)) != MSG_OK)
+	prof_begin(PROF_SI7021_READ);
+	msg = i2cMasterTransmitTimeout(&I2CD1, SI7021_ADDR, &txbuf, 1, rxbuf, 3, TIME_MS2I(convtime));
+	prof_end(PROF_SI7021_READ);
+	if (msg != MSG_OK)
 		return SI7021_TIMEOUT;
 
 #if USE_CRC
@@ -141,7 +148,10 @@ si7021error_t si7021_read(uint16_t *humidity, int16_t *temperature) {
     if (*humidity > 1000) *humidity = 1000;
 
 	txbuf = READ_T_PREV_RH;
-	if (i2cMasterTransmitTimeout(&I2CD1, SI7021_ADDR, &txbuf, 1, rxbuf, 2, TIME_MS2I(SI7021_I2CTIME)) != MSG_OK)
+	prof_begin(PROF_SI7021_READ);
+	msg = i2cMasterTransmitTimeout(&I2CD1, SI7021_ADDR, &txbuf, 1, rxbuf, 2, TIME_MS2I(SI7021_I2CTIME));
+	prof_end(PROF_SI7021_READ);
+	if (msg != MSG_OK)
 		return SI7021_I2CERROR;
 
 	data = (int32_t) ((uint16_t)(rxbuf[0] << 8) | rxbuf[1]);
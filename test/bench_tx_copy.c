@@ -0,0 +1,191 @@
+/*
+ * bench_tx_copy.c
+ *
+ *  CPU copies, cycles & RAM of a sensor reading on its way to the TX FIFO: the
+ *  former send buffer pipeline against the message object built in place
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "radio_test.h"
+#include "main.h"
+#include "radio.h"
+#include "aes.h"
+#include "crc8.h"
+
+#define FRAMES		20000
+
+static RFDriver txq;
+
+static const uint8_t aes_key[16] = {
+		0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C,
+};
+
+// memcpy of the pipeline, counted while measuring
+static bool counting;
+static uint32_t copied_bytes;
+static uint32_t copies;
+
+void *__real_memcpy(void *dst, const void *src, size_t n);
+
+void *__wrap_memcpy(void *dst, const void *src, size_t n) {
+	if (counting) {
+		copied_bytes += (uint32_t) n;
+		copies++;
+	}
+	return __real_memcpy(dst, src, n);
+}
+
+static inline uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// former send buffer of radio.c
+typedef struct {
+	uint8_t length;
+	union {
+		MESSAGE_T msg;
+		uint8_t raw[MSGLEN_AGGR];
+	};
+} send_buf_t;
+
+static send_buf_t nrf_send_buf[NRF_SEND_BUFFERS];
+static uint8_t tx_payload_buffer[NRF52_MAX_PAYLOAD_LENGTH + 2];
+
+// message objects of radio.c
+static nrf52_frame_t msg_frames[NRF_SEND_BUFFERS];
+static memory_pool_t msg_pool;
+
+static void msg_fill(MESSAGE_T *msg, uint32_t seq) {
+	msg->firmware = FIRMWARE;
+	msg->deviceid = DEVICEID;
+	msg->addrnum = ADDRNUM;
+	msg->cmdparam = CMD_WAIT;
+	msg->msgtype = MSG_DATA;
+	msg->address = ADDR_SI7021_TEMP;
+	msg->datatype = VAL_i32;
+	msg->data.i32 = (int32_t) seq;
+	msg->datapower = 2;
+}
+
+// send_sensor_value() into a stack message, queue_buffer(), nrfSendThread and
+// the packet buffer copy the driver made before each transmission
+static void send_before(uint32_t seq) {
+	MESSAGE_T msg;
+	send_buf_t *sbuf = &nrf_send_buf[seq % NRF_SEND_BUFFERS];
+	uint8_t buf[MSGLEN];
+	uint8_t aes[MSGLEN];
+	nrf52_payload_t tx_payload = {
+		.pipe = NRF_TX_PIPE,
+		.length = MSGLEN,
+	};
+	nrf52_frame_t *frame;
+
+	memset(&msg, 0, MSGLEN);
+	msg_fill(&msg, seq);
+	sbuf->length = MSGLEN;
+	memcpy(sbuf->raw, &msg, MSGLEN);
+
+	memcpy(buf, sbuf->raw, MSGLEN);
+	buf[MSGLEN-1] = CRC8(buf, MSGLEN-1);
+	AES128_ECB_encrypt(buf, aes_key, aes);
+	memcpy(&tx_payload.data, aes, MSGLEN);
+	CHECK(radio_write_payload(&txq, &tx_payload) == NRF52_SUCCESS);
+
+	frame = txq.tx_fifo.p_frame[txq.tx_fifo.exit_point % NRF52_TX_FIFO_SIZE];
+	memcpy(&tx_payload_buffer[2], frame->data, frame->length);
+}
+
+static void pool_free(void *arg, nrf52_send_result_t const *result) {
+	(void) result;
+	chPoolFreeI(&msg_pool, arg);
+}
+
+// msg_new() & the send stage of radio.c
+static void send_after(uint32_t seq) {
+	nrf52_frame_t *frame = chPoolAlloc(&msg_pool);
+
+	memset(frame->data, 0, MSGLEN);
+	frame->length = MSGLEN;
+	msg_fill((MESSAGE_T *) frame->data, seq);
+
+	frame->pipe = NRF_TX_PIPE;
+	frame->noack = false;
+	frame->deadline = chVTGetSystemTimeX();
+	frame->cb = pool_free;
+	frame->arg = frame;
+	frame->data[frame->length-1] = CRC8(frame->data, frame->length-1);
+	for (uint8_t i=0; i < frame->length; i += 16)
+		AES128_ECB_encrypt(&frame->data[i], aes_key, &frame->data[i]);
+	CHECK(radio_tx_queue(&txq, frame) == NRF52_SUCCESS);
+}
+
+static int cycles_cmp(const void *a, const void *b) {
+	uint32_t ca = *(const uint32_t *) a, cb = *(const uint32_t *) b;
+
+	return (ca > cb) - (ca < cb);
+}
+
+static uint32_t frame_cycles[FRAMES];
+
+// Send FRAMES readings, the FIFO is emptied outside of the measure
+static void run(void (*send)(uint32_t seq), const char *name, size_t ram_static, size_t ram_stack) {
+	copied_bytes = copies = 0;
+	for (uint32_t seq=0; seq < FRAMES; seq++) {
+		uint64_t start;
+
+		counting = true;
+		start = cycles();
+		send(seq);
+		frame_cycles[seq] = (uint32_t) (cycles() - start);
+		counting = false;
+
+		CHECK(radio_pop_tx(&txq) == NRF52_SUCCESS);
+	}
+	CHECK(radio_tx_pending(&txq) == 0);
+	qsort(frame_cycles, FRAMES, sizeof(frame_cycles[0]), cycles_cmp);
+
+	printf("bench_tx_copy: %-7s %u copies, %.1f bytes copied, %u cycles per frame (median), "
+			"%u bytes static RAM, %u bytes stack\n",
+			name, (unsigned) (copies / FRAMES), (double) copied_bytes / FRAMES, (unsigned) frame_cycles[FRAMES / 2],
+			(unsigned) ram_static, (unsigned) ram_stack);
+}
+
+int main(void) {
+	nrf52_config_t config = radio_test_config;
+	uint32_t before_bytes;
+
+	chSysInit();
+	nrf_emu_init(1, 1);
+	NRF_EMU_ATTACH(&txq, 0);
+
+	config.mode = NRF52_MODE_PTX;
+	config.tx_mode = NRF52_TXMODE_MANUAL;
+	CHECK(radio_init(&txq, &config) == NRF52_SUCCESS);
+	chPoolObjectInit(&msg_pool, sizeof(nrf52_frame_t), NULL);
+	chPoolLoadArray(&msg_pool, msg_frames, NRF_SEND_BUFFERS);
+
+	// send buffers with their free & fill mailboxes and the stack copies of a
+	// frame, against the message objects with the fill mailbox
+	run(send_before, "before:", sizeof(nrf_send_buf) + 2 * NRF_SEND_BUFFERS * sizeof(msg_t),
+			sizeof(MESSAGE_T) + 2 * MSGLEN + sizeof(nrf52_payload_t));
+	before_bytes = copied_bytes;
+	run(send_after, "after:", sizeof(msg_frames) + NRF_SEND_BUFFERS * sizeof(msg_t), 0);
+
+	_Static_assert(MSGLEN == 16, "MESSAGE_T is one AES block");
+	CHECK(copied_bytes == 0 && before_bytes == 5 * MSGLEN * FRAMES);
+	printf("bench_tx_copy: %d failures\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+/*
+ * ch.h
+ *
+ *  Host ChibiOS subset on pthreads, the system time is the emulator virtual time
+ */
+
+#ifndef CH_H_
+#define CH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef TRUE
+#define TRUE						1
+#endif
+#ifndef FALSE
+#define FALSE						0
+#endif
+
+typedef int32_t msg_t;
+typedef uint32_t eventmask_t;
+typedef uint32_t eventflags_t;
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+typedef uint32_t tprio_t;
+typedef int32_t cnt_t;
+
+#define MSG_OK						(msg_t) 0
+#define MSG_TIMEOUT					(msg_t) -1
+#define MSG_RESET					(msg_t) -2
+
+#define NORMALPRIO					128
+#define HIGHPRIO					255
+
+// 1 MHz system time
+#define CH_CFG_ST_FREQUENCY			1000000
+#define TIME_IMMEDIATE				((sysinterval_t) 0)
+#define TIME_INFINITE				((sysinterval_t) -1)
+#define TIME_S2I(secs)				((sysinterval_t) ((secs) * 1000000))
+#define TIME_MS2I(msecs)			((sysinterval_t) ((msecs) * 1000))
+#define TIME_US2I(usecs)			((sysinterval_t) (usecs))
+#define TIME_I2S(interval)			((uint32_t) ((interval) / 1000000))
+#define TIME_I2MS(interval)			((uint32_t) ((interval) / 1000))
+#define TIME_I2US(interval)			((uint32_t) (interval))
+
+#define ALL_EVENTS					((eventmask_t) -1)
+#define EVENT_MASK(eid)				((eventmask_t) 1 << (eventmask_t) (eid))
+
+typedef struct ch_thread thread_t;
+
+// threads waiting on an object, in the order they came
+typedef struct {
+	thread_t *next;
+} threads_queue_t;
+
+typedef struct {
+	cnt_t cnt;
+	threads_queue_t queue;
+} binary_semaphore_t;
+
+typedef struct event_listener event_listener_t;
+
+struct event_listener {
+	event_listener_t *next;
+	thread_t *listener;
+	eventmask_t events;
+	eventflags_t flags;
+	eventflags_t wflags;
+};
+
+typedef struct {
+	event_listener_t *next;
+} event_source_t;
+
+typedef struct {
+	size_t object_size;
+	void *next;
+} memory_pool_t;
+
+typedef void (*tfunc_t)(void *p);
+
+// the working areas are not used, the host threads have their own stacks
+#define THD_WORKING_AREA(s, n)		uint8_t s[16]
+#define THD_FUNCTION(tname, arg)	void tname(void *arg)
+
+// Kernel
+void chSysInit(void);
+void chSysLock(void);
+void chSysUnlock(void);
+void chSysLockFromISR(void);
+void chSysUnlockFromISR(void);
+
+// Time
+systime_t chVTGetSystemTimeX(void);
+#define chVTGetSystemTime()			chVTGetSystemTimeX()
+#define chVTTimeElapsedSinceX(start)	chTimeDiffX((start), chVTGetSystemTimeX())
+
+static inline systime_t chTimeAddX(systime_t systime, sysinterval_t interval) {
+	return (systime_t) (systime + interval);
+}
+
+static inline sysinterval_t chTimeDiffX(systime_t start, systime_t end) {
+	return (sysinterval_t) (end - start);
+}
+
+static inline bool chTimeIsInRangeX(systime_t time, systime_t start, systime_t end) {
+	return (systime_t) (time - start) < (systime_t) (end - start);
+}
+
+// Threads
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+thread_t *chThdGetSelfX(void);
+void chRegSetThreadName(const char *name);
+void chThdTerminate(thread_t *tp);
+bool chThdShouldTerminateX(void);
+void chThdExit(msg_t msg);
+msg_t chThdWait(thread_t *tp);
+void chThdSleep(sysinterval_t time);
+void chThdSleepUntil(systime_t time);
+#define chThdSleepSeconds(sec)		chThdSleep(TIME_S2I(sec))
+#define chThdSleepMilliseconds(ms)	chThdSleep(TIME_MS2I(ms))
+#define chThdSleepMicroseconds(us)	chThdSleep(TIME_US2I(us))
+
+// Binary semaphores
+void chBSemObjectInit(binary_semaphore_t *bsp, bool taken);
+msg_t chBSemWait(binary_semaphore_t *bsp);
+msg_t chBSemWaitTimeout(binary_semaphore_t *bsp, sysinterval_t timeout);
+msg_t chBSemWaitTimeoutS(binary_semaphore_t *bsp, sysinterval_t timeout);
+void chBSemSignal(binary_semaphore_t *bsp);
+void chBSemSignalI(binary_semaphore_t *bsp);
+void chBSemReset(binary_semaphore_t *bsp, bool taken);
+void chBSemResetI(binary_semaphore_t *bsp, bool taken);
+
+// Events
+void chEvtObjectInit(event_source_t *esp);
+void chEvtRegisterMaskWithFlags(event_source_t *esp, event_listener_t *elp, eventmask_t events, eventflags_t wflags);
+#define chEvtRegisterMask(esp, elp, events)	chEvtRegisterMaskWithFlags(esp, elp, events, (eventflags_t) -1)
+void chEvtUnregister(event_source_t *esp, event_listener_t *elp);
+void chEvtBroadcastFlags(event_source_t *esp, eventflags_t flags);
+void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags);
+eventflags_t chEvtGetAndClearFlags(event_listener_t *elp);
+void chEvtSignal(thread_t *tp, eventmask_t events);
+void chEvtSignalI(thread_t *tp, eventmask_t events);
+eventmask_t chEvtGetAndClearEvents(eventmask_t events);
+eventmask_t chEvtWaitAny(eventmask_t events);
+eventmask_t chEvtWaitAnyTimeout(eventmask_t events, sysinterval_t timeout);
+
+// Memory pools, the objects come from the loaded arrays only
+void chPoolObjectInit(memory_pool_t *mp, size_t size, void *provider);
+void chPoolLoadArray(memory_pool_t *mp, void *p, size_t n);
+void *chPoolAllocI(memory_pool_t *mp);
+void *chPoolAlloc(memory_pool_t *mp);
+void chPoolFreeI(memory_pool_t *mp, void *objp);
+void chPoolFree(memory_pool_t *mp, void *objp);
+
+// Host side
+typedef struct {
+	bool (*busy)(void);				// interrupts pending or running
+	bool (*next)(uint64_t *time);	// time of the next hardware event
+	void (*run)(uint64_t time);		// hardware events up to the time
+} sim_hw_t;
+
+void sim_set_hw(const sim_hw_t *hw);
+uint64_t sim_time(void);
+void sim_notify(void);
+void sim_thread_free(void);
+void sim_set_idle_hook(void (*hook)(void));
+
+#endif /* CH_H_ */
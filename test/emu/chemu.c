@@ -0,0 +1,491 @@
+/*
+ * chemu.c
+ *
+ *  Host ChibiOS subset on pthreads
+ *
+ *  The system lock is one recursive mutex, an ISR runs with it held as on the
+ *  MCU where no thread runs meanwhile. The virtual time only moves when every
+ *  thread but the free ones waits and no ISR is pending, the scheduler thread
+ *  then jumps to the next hardware event or thread timeout. The time a thread
+ *  or an ISR runs is not counted, a run of the state machine is an instant of
+ *  the air time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ch.h"
+#include "hal.h"
+
+typedef enum {
+	TH_READY,
+	TH_QUEUE,			// on a semaphore queue
+	TH_EVENTS,			// waiting for events
+	TH_SLEEP,			// waiting for the time
+	TH_JOIN,			// waiting for a thread to exit
+	TH_EXITED,
+} th_state_t;
+
+struct ch_thread {
+	pthread_t tid;
+	pthread_cond_t cond;
+	const char *name;
+	tfunc_t func;
+	void *arg;
+	th_state_t state;
+	bool timed;
+	uint64_t wake_at;
+	msg_t rdymsg;
+	threads_queue_t *queue;
+	thread_t *qnext;
+	eventmask_t epending;
+	eventmask_t ewmask;
+	bool terminate;
+	bool free;			// runs beside the virtual time, see sim_thread_free()
+	msg_t exitcode;
+	thread_t *joiner;
+	thread_t *next;		// all threads
+};
+
+static pthread_mutex_t sys_mtx;
+static pthread_cond_t sched_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t sched_tid;
+static thread_t main_thread;
+static thread_t *threads;
+static uint32_t threads_ready;
+static const sim_hw_t *sim_hw;
+static void (*sim_idle_hook)(void);
+static volatile uint64_t sim_now;
+static __thread thread_t *self;
+
+void osal_assert_failed(const char *remark, const char *file, int line) {
+	fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, remark);
+	abort();
+}
+
+uint64_t sim_time(void) {
+	return __atomic_load_n(&sim_now, __ATOMIC_ACQUIRE);
+}
+
+systime_t chVTGetSystemTimeX(void) {
+	return (systime_t) sim_time();
+}
+
+void chSysLock(void) {
+	pthread_mutex_lock(&sys_mtx);
+}
+
+void chSysUnlock(void) {
+	pthread_mutex_unlock(&sys_mtx);
+}
+
+void chSysLockFromISR(void) {
+	pthread_mutex_lock(&sys_mtx);
+}
+
+void chSysUnlockFromISR(void) {
+	pthread_mutex_unlock(&sys_mtx);
+}
+
+// Wake the scheduler to check if the time can move, system locked.
+void sim_notify(void) {
+	pthread_cond_signal(&sched_cond);
+}
+
+// Run the hook each time every thread waits, as the idle thread enter hook
+void sim_set_idle_hook(void (*hook)(void)) {
+	chSysLock();
+	sim_idle_hook = hook;
+	chSysUnlock();
+}
+
+void sim_set_hw(const sim_hw_t *hw) {
+	chSysLock();
+	sim_hw = hw;
+	sim_notify();
+	chSysUnlock();
+}
+
+static void queue_insert(threads_queue_t *qp, thread_t *tp) {
+	thread_t **pp = &qp->next;
+
+	while (*pp != NULL)
+		pp = &(*pp)->qnext;
+	tp->qnext = NULL;
+	*pp = tp;
+	tp->queue = qp;
+}
+
+static void queue_remove(thread_t *tp) {
+	thread_t **pp = &tp->queue->next;
+
+	while (*pp != tp)
+		pp = &(*pp)->qnext;
+	*pp = tp->qnext;
+	tp->queue = NULL;
+}
+
+// Put the current thread to sleep in the state, system locked.
+static msg_t sim_sleep_s(th_state_t state, sysinterval_t timeout) {
+	thread_t *tp = self;
+
+	osalDbgAssert(tp != NULL, "no thread context");
+	osalDbgAssert(!tp->free, "free thread waits");
+	tp->state = state;
+	tp->timed = timeout != TIME_INFINITE;
+	tp->wake_at = sim_time() + timeout;
+	threads_ready--;
+	sim_notify();
+	while (tp->state != TH_READY)
+		pthread_cond_wait(&tp->cond, &sys_mtx);
+	return tp->rdymsg;
+}
+
+static void sim_wakeup_s(thread_t *tp, msg_t msg) {
+	if (tp->state == TH_QUEUE)
+		queue_remove(tp);
+	tp->rdymsg = msg;
+	tp->state = TH_READY;
+	threads_ready++;
+	pthread_cond_signal(&tp->cond);
+}
+
+// Move the virtual time to the next event, the ready threads and the ISRs
+// run at the current time before.
+static void *sched_thread(void *arg) {
+	(void) arg;
+
+	chSysLock();
+	for (;;) {
+		uint64_t next = UINT64_MAX;
+		uint64_t t;
+
+		if (threads_ready > 0 || sim_hw == NULL || sim_hw->busy()) {
+			pthread_cond_wait(&sched_cond, &sys_mtx);
+			continue;
+		}
+		if (sim_idle_hook != NULL)
+			sim_idle_hook();
+
+		for (thread_t *tp = threads; tp != NULL; tp = tp->next) {
+			if (tp->state != TH_READY && tp->state != TH_EXITED && tp->timed && tp->wake_at < next)
+				next = tp->wake_at;
+		}
+		if (sim_hw->next(&t) && t < next)
+			next = t;
+		if (next == UINT64_MAX) {
+			fprintf(stderr, "sim: all threads wait forever at %llu uS\n", (unsigned long long) sim_time());
+			abort();
+		}
+
+		if (next > sim_time())
+			__atomic_store_n(&sim_now, next, __ATOMIC_RELEASE);
+		for (thread_t *tp = threads; tp != NULL; tp = tp->next) {
+			if (tp->state != TH_READY && tp->state != TH_EXITED && tp->timed && tp->wake_at <= next)
+				sim_wakeup_s(tp, MSG_TIMEOUT);
+		}
+		sim_hw->run(next);
+	}
+	return NULL;
+}
+
+void chSysInit(void) {
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&sys_mtx, &attr);
+
+	main_thread.tid = pthread_self();
+	pthread_cond_init(&main_thread.cond, NULL);
+	main_thread.name = "main";
+	main_thread.state = TH_READY;
+	threads = &main_thread;
+	threads_ready = 1;
+	self = &main_thread;
+
+	pthread_create(&sched_tid, NULL, sched_thread, NULL);
+}
+
+static void *thread_start(void *arg) {
+	thread_t *tp = arg;
+
+	self = tp;
+	tp->func(tp->arg);
+	chThdExit(MSG_OK);
+	return NULL;
+}
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg) {
+	thread_t *tp = calloc(1, sizeof(thread_t));
+
+	(void) wsp;
+	(void) size;
+	(void) prio;
+	pthread_cond_init(&tp->cond, NULL);
+	tp->func = pf;
+	tp->arg = arg;
+	tp->state = TH_READY;
+
+	chSysLock();
+	tp->next = threads;
+	threads = tp;
+	threads_ready++;
+	pthread_create(&tp->tid, NULL, thread_start, tp);
+	pthread_detach(tp->tid);
+	chSysUnlock();
+	return tp;
+}
+
+// The calling thread runs beside the virtual time as on another core, the
+// hardware and the ISRs go on while it runs. It may not wait from now on.
+void sim_thread_free(void) {
+	chSysLock();
+	self->free = true;
+	threads_ready--;
+	sim_notify();
+	chSysUnlock();
+}
+
+thread_t *chThdGetSelfX(void) {
+	return self;
+}
+
+void chRegSetThreadName(const char *name) {
+	self->name = name;
+}
+
+void chThdTerminate(thread_t *tp) {
+	chSysLock();
+	tp->terminate = true;
+	chSysUnlock();
+}
+
+bool chThdShouldTerminateX(void) {
+	return self->terminate;
+}
+
+void chThdExit(msg_t msg) {
+	thread_t *tp = self;
+
+	chSysLock();
+	tp->exitcode = msg;
+	tp->state = TH_EXITED;
+	if (!tp->free)
+		threads_ready--;
+	if (tp->joiner != NULL)
+		sim_wakeup_s(tp->joiner, MSG_OK);
+	sim_notify();
+	chSysUnlock();
+	pthread_exit(NULL);
+}
+
+msg_t chThdWait(thread_t *tp) {
+	chSysLock();
+	if (tp->state != TH_EXITED) {
+		tp->joiner = self;
+		sim_sleep_s(TH_JOIN, TIME_INFINITE);
+	}
+	chSysUnlock();
+	return tp->exitcode;
+}
+
+void chThdSleep(sysinterval_t time) {
+	chSysLock();
+	if (time != TIME_IMMEDIATE)
+		sim_sleep_s(TH_SLEEP, time);
+	chSysUnlock();
+}
+
+void chThdSleepUntil(systime_t time) {
+	chThdSleep(chTimeDiffX(chVTGetSystemTimeX(), time));
+}
+
+void chBSemObjectInit(binary_semaphore_t *bsp, bool taken) {
+	bsp->cnt = taken ? 0 : 1;
+	bsp->queue.next = NULL;
+}
+
+msg_t chBSemWaitTimeoutS(binary_semaphore_t *bsp, sysinterval_t timeout) {
+	if (bsp->cnt > 0) {
+		bsp->cnt = 0;
+		return MSG_OK;
+	}
+	if (timeout == TIME_IMMEDIATE)
+		return MSG_TIMEOUT;
+	queue_insert(&bsp->queue, self);
+	return sim_sleep_s(TH_QUEUE, timeout);
+}
+
+msg_t chBSemWaitTimeout(binary_semaphore_t *bsp, sysinterval_t timeout) {
+	msg_t msg;
+
+	chSysLock();
+	msg = chBSemWaitTimeoutS(bsp, timeout);
+	chSysUnlock();
+	return msg;
+}
+
+msg_t chBSemWait(binary_semaphore_t *bsp) {
+	return chBSemWaitTimeout(bsp, TIME_INFINITE);
+}
+
+void chBSemSignalI(binary_semaphore_t *bsp) {
+	if (bsp->queue.next != NULL)
+		sim_wakeup_s(bsp->queue.next, MSG_OK);
+	else
+		bsp->cnt = 1;
+}
+
+void chBSemSignal(binary_semaphore_t *bsp) {
+	chSysLock();
+	chBSemSignalI(bsp);
+	chSysUnlock();
+}
+
+void chBSemResetI(binary_semaphore_t *bsp, bool taken) {
+	while (bsp->queue.next != NULL)
+		sim_wakeup_s(bsp->queue.next, MSG_RESET);
+	bsp->cnt = taken ? 0 : 1;
+}
+
+void chBSemReset(binary_semaphore_t *bsp, bool taken) {
+	chSysLock();
+	chBSemResetI(bsp, taken);
+	chSysUnlock();
+}
+
+void chEvtObjectInit(event_source_t *esp) {
+	esp->next = NULL;
+}
+
+void chEvtRegisterMaskWithFlags(event_source_t *esp, event_listener_t *elp, eventmask_t events, eventflags_t wflags) {
+	chSysLock();
+	elp->next = esp->next;
+	esp->next = elp;
+	elp->listener = self;
+	elp->events = events;
+	elp->flags = 0;
+	elp->wflags = wflags;
+	chSysUnlock();
+}
+
+void chEvtUnregister(event_source_t *esp, event_listener_t *elp) {
+	event_listener_t **pp = &esp->next;
+
+	chSysLock();
+	while (*pp != NULL) {
+		if (*pp == elp) {
+			*pp = elp->next;
+			break;
+		}
+		pp = &(*pp)->next;
+	}
+	chSysUnlock();
+}
+
+void chEvtSignalI(thread_t *tp, eventmask_t events) {
+	tp->epending |= events;
+	if (tp->state == TH_EVENTS && (tp->epending & tp->ewmask) != 0)
+		sim_wakeup_s(tp, MSG_OK);
+}
+
+void chEvtSignal(thread_t *tp, eventmask_t events) {
+	chSysLock();
+	chEvtSignalI(tp, events);
+	chSysUnlock();
+}
+
+void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags) {
+	for (event_listener_t *elp = esp->next; elp != NULL; elp = elp->next) {
+		elp->flags |= flags;
+		if (flags == 0 || (elp->flags & elp->wflags) != 0)
+			chEvtSignalI(elp->listener, elp->events);
+	}
+}
+
+void chEvtBroadcastFlags(event_source_t *esp, eventflags_t flags) {
+	chSysLock();
+	chEvtBroadcastFlagsI(esp, flags);
+	chSysUnlock();
+}
+
+eventflags_t chEvtGetAndClearFlags(event_listener_t *elp) {
+	eventflags_t flags;
+
+	chSysLock();
+	flags = elp->flags;
+	elp->flags = 0;
+	chSysUnlock();
+	return flags;
+}
+
+eventmask_t chEvtGetAndClearEvents(eventmask_t events) {
+	eventmask_t m;
+
+	chSysLock();
+	m = self->epending & events;
+	self->epending &= ~events;
+	chSysUnlock();
+	return m;
+}
+
+eventmask_t chEvtWaitAnyTimeout(eventmask_t events, sysinterval_t timeout) {
+	eventmask_t m;
+
+	chSysLock();
+	m = self->epending & events;
+	if (m == 0 && timeout != TIME_IMMEDIATE) {
+		self->ewmask = events;
+		sim_sleep_s(TH_EVENTS, timeout);
+		m = self->epending & events;
+	}
+	self->epending &= ~m;
+	chSysUnlock();
+	return m;
+}
+
+eventmask_t chEvtWaitAny(eventmask_t events) {
+	return chEvtWaitAnyTimeout(events, TIME_INFINITE);
+}
+
+void chPoolObjectInit(memory_pool_t *mp, size_t size, void *provider) {
+	(void) provider;
+	mp->object_size = size;
+	mp->next = NULL;
+}
+
+void chPoolFreeI(memory_pool_t *mp, void *objp) {
+	*(void **) objp = mp->next;
+	mp->next = objp;
+}
+
+void chPoolFree(memory_pool_t *mp, void *objp) {
+	chSysLock();
+	chPoolFreeI(mp, objp);
+	chSysUnlock();
+}
+
+void chPoolLoadArray(memory_pool_t *mp, void *p, size_t n) {
+	for (size_t i=0; i < n; i++)
+		chPoolFree(mp, (uint8_t *) p + i * mp->object_size);
+}
+
+void *chPoolAllocI(memory_pool_t *mp) {
+	void *objp = mp->next;
+
+	if (objp != NULL)
+		mp->next = *(void **) objp;
+	return objp;
+}
+
+void *chPoolAlloc(memory_pool_t *mp) {
+	void *objp;
+
+	chSysLock();
+	objp = chPoolAllocI(mp);
+	chSysUnlock();
+	return objp;
+}
@@ -0,0 +1,40 @@
+/*
+ * hal.h
+ *
+ *  Host HAL subset, the NRF52 peripherals come from the register emulator
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include "ch.h"
+#include "nrf52.h"
+
+// CMSIS
+#define __DMB()						__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __REV(x)					__builtin_bswap32(x)
+
+static inline uint32_t __RBIT(uint32_t value) {
+	uint32_t result = 0;
+
+	for (uint8_t i=0; i < 32; i++) {
+		result = (result << 1) | (value & 1);
+		value >>= 1;
+	}
+	return result;
+}
+
+// OSAL
+#define osalDbgAssert(c, remark)	do { if (!(c)) osal_assert_failed(remark, __FILE__, __LINE__); } while (0)
+void osal_assert_failed(const char *remark, const char *file, int line);
+
+// the emulator calls the ISRs of the nodes, the vectors are not used
+#define OSAL_IRQ_HANDLER(id)		void id(void)
+#define OSAL_IRQ_PROLOGUE()
+#define OSAL_IRQ_EPILOGUE()
+
+#define nvicEnableVector(n, prio)	do { (void) (n); (void) (prio); } while (0)
+#define nvicDisableVector(n)		do { (void) (n); } while (0)
+#define nvicClearPending(n)			do { (void) (n); } while (0)
+
+#endif /* HAL_H_ */
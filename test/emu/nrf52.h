@@ -0,0 +1,264 @@
+/*
+ * nrf52.h
+ *
+ *  nRF52832 RADIO, TIMER, PPI, CLOCK & FICR register layouts for the register emulator
+ */
+
+#ifndef NRF52_H_
+#define NRF52_H_
+
+#include <stdint.h>
+
+#define __I							volatile const
+#define __O							volatile
+#define __IO						volatile
+
+typedef enum {
+	POWER_CLOCK_IRQn = 0,
+	RADIO_IRQn = 1,
+	TIMER1_IRQn = 9,
+} IRQn_Type;
+
+typedef struct {
+	__O  uint32_t TASKS_TXEN;					// 0x000
+	__O  uint32_t TASKS_RXEN;
+	__O  uint32_t TASKS_START;
+	__O  uint32_t TASKS_STOP;
+	__O  uint32_t TASKS_DISABLE;
+	__O  uint32_t TASKS_RSSISTART;
+	__O  uint32_t TASKS_RSSISTOP;
+	__O  uint32_t TASKS_BCSTART;
+	__O  uint32_t TASKS_BCSTOP;
+	__I  uint32_t RESERVED0[55];
+	__IO uint32_t EVENTS_READY;					// 0x100
+	__IO uint32_t EVENTS_ADDRESS;
+	__IO uint32_t EVENTS_PAYLOAD;
+	__IO uint32_t EVENTS_END;
+	__IO uint32_t EVENTS_DISABLED;
+	__IO uint32_t EVENTS_DEVMATCH;
+	__IO uint32_t EVENTS_DEVMISS;
+	__IO uint32_t EVENTS_RSSIEND;
+	__I  uint32_t RESERVED1[2];
+	__IO uint32_t EVENTS_BCMATCH;
+	__I  uint32_t RESERVED2;
+	__IO uint32_t EVENTS_CRCOK;
+	__IO uint32_t EVENTS_CRCERROR;
+	__I  uint32_t RESERVED3[50];
+	__IO uint32_t SHORTS;						// 0x200
+	__I  uint32_t RESERVED4[64];
+	__IO uint32_t INTENSET;						// 0x304
+	__IO uint32_t INTENCLR;
+	__I  uint32_t RESERVED5[61];
+	__I  uint32_t CRCSTATUS;					// 0x400
+	__I  uint32_t RESERVED6;
+	__I  uint32_t RXMATCH;
+	__I  uint32_t RXCRC;
+	__I  uint32_t DAI;
+	__I  uint32_t RESERVED7[60];
+	__IO uint32_t PACKETPTR;					// 0x504
+	__IO uint32_t FREQUENCY;
+	__IO uint32_t TXPOWER;
+	__IO uint32_t MODE;
+	__IO uint32_t PCNF0;
+	__IO uint32_t PCNF1;
+	__IO uint32_t BASE0;
+	__IO uint32_t BASE1;
+	__IO uint32_t PREFIX0;
+	__IO uint32_t PREFIX1;
+	__IO uint32_t TXADDRESS;
+	__IO uint32_t RXADDRESSES;
+	__IO uint32_t CRCCNF;
+	__IO uint32_t CRCPOLY;
+	__IO uint32_t CRCINIT;
+	__I  uint32_t RESERVED8;
+	__IO uint32_t TIFS;
+	__I  uint32_t RSSISAMPLE;					// 0x548
+	__I  uint32_t RESERVED9;
+	__I  uint32_t STATE;						// 0x550
+	__IO uint32_t DATAWHITEIV;
+	__I  uint32_t RESERVED10[2];
+	__IO uint32_t BCC;
+	__I  uint32_t RESERVED11[39];
+	__IO uint32_t DAB[8];						// 0x600
+	__IO uint32_t DAP[8];
+	__IO uint32_t DACNF;
+	__I  uint32_t RESERVED12[3];
+	__IO uint32_t MODECNF0;
+	__I  uint32_t RESERVED13[618];
+	__IO uint32_t POWER;						// 0xFFC
+} NRF_RADIO_Type;
+
+typedef struct {
+	__O  uint32_t TASKS_START;					// 0x000
+	__O  uint32_t TASKS_STOP;
+	__O  uint32_t TASKS_COUNT;
+	__O  uint32_t TASKS_CLEAR;
+	__O  uint32_t TASKS_SHUTDOWN;
+	__I  uint32_t RESERVED0[11];
+	__O  uint32_t TASKS_CAPTURE[6];				// 0x040
+	__I  uint32_t RESERVED1[58];
+	__IO uint32_t EVENTS_COMPARE[6];			// 0x140
+	__I  uint32_t RESERVED2[42];
+	__IO uint32_t SHORTS;						// 0x200
+	__I  uint32_t RESERVED3[64];
+	__IO uint32_t INTENSET;						// 0x304
+	__IO uint32_t INTENCLR;
+	__I  uint32_t RESERVED4[126];
+	__IO uint32_t MODE;							// 0x504
+	__IO uint32_t BITMODE;
+	__I  uint32_t RESERVED5;
+	__IO uint32_t PRESCALER;					// 0x510
+	__I  uint32_t RESERVED6[11];
+	__IO uint32_t CC[6];						// 0x540
+} NRF_TIMER_Type;
+
+typedef struct {
+	__O  uint32_t EN;
+	__O  uint32_t DIS;
+} PPI_TASKS_CHG_Type;
+
+typedef struct {
+	__IO uint32_t EEP;
+	__IO uint32_t TEP;
+} PPI_CH_Type;
+
+typedef struct {
+	PPI_TASKS_CHG_Type TASKS_CHG[6];			// 0x000
+	__I  uint32_t RESERVED0[308];
+	__IO uint32_t CHEN;							// 0x500
+	__IO uint32_t CHENSET;
+	__IO uint32_t CHENCLR;
+	__I  uint32_t RESERVED1;
+	PPI_CH_Type CH[20];							// 0x510
+	__I  uint32_t RESERVED2[148];
+	__IO uint32_t CHG[6];						// 0x800
+} NRF_PPI_Type;
+
+typedef struct {
+	__O  uint32_t TASKS_HFCLKSTART;				// 0x000
+	__O  uint32_t TASKS_HFCLKSTOP;
+	__O  uint32_t TASKS_LFCLKSTART;
+	__O  uint32_t TASKS_LFCLKSTOP;
+	__O  uint32_t TASKS_CAL;
+	__O  uint32_t TASKS_CTSTART;
+	__O  uint32_t TASKS_CTSTOP;
+	__I  uint32_t RESERVED0[57];
+	__IO uint32_t EVENTS_HFCLKSTARTED;			// 0x100
+	__IO uint32_t EVENTS_LFCLKSTARTED;
+	__I  uint32_t RESERVED1;
+	__IO uint32_t EVENTS_DONE;
+	__IO uint32_t EVENTS_CTTO;
+	__I  uint32_t RESERVED2[124];
+	__IO uint32_t INTENSET;						// 0x304
+	__IO uint32_t INTENCLR;
+	__I  uint32_t RESERVED3[63];
+	__I  uint32_t HFCLKRUN;						// 0x408
+	__I  uint32_t HFCLKSTAT;
+	__I  uint32_t RESERVED4;
+	__I  uint32_t LFCLKRUN;
+	__I  uint32_t LFCLKSTAT;
+	__I  uint32_t LFCLKSRCCOPY;
+} NRF_CLOCK_Type;
+
+typedef struct {
+	__I  uint32_t RESERVED0[4];
+	__I  uint32_t CODEPAGESIZE;					// 0x010
+	__I  uint32_t CODESIZE;
+	__I  uint32_t RESERVED1[18];
+	__I  uint32_t DEVICEID[2];					// 0x060
+} NRF_FICR_Type;
+
+// Node 0 peripherals, the RFD1 defaults
+NRF_RADIO_Type *nrf_emu_radio(int node);
+NRF_TIMER_Type *nrf_emu_timer(int node);
+NRF_PPI_Type *nrf_emu_ppi(int node);
+NRF_CLOCK_Type *nrf_emu_clock(int node);
+NRF_FICR_Type *nrf_emu_ficr(int node);
+
+#define NRF_RADIO					nrf_emu_radio(0)
+#define NRF_TIMER1					nrf_emu_timer(0)
+#define NRF_PPI						nrf_emu_ppi(0)
+#define NRF_CLOCK					nrf_emu_clock(0)
+#define NRF_FICR					nrf_emu_ficr(0)
+
+// Bit fields
+#define RADIO_SHORTS_READY_START_Msk		(1UL << 0)
+#define RADIO_SHORTS_END_DISABLE_Msk		(1UL << 1)
+#define RADIO_SHORTS_DISABLED_TXEN_Msk		(1UL << 2)
+#define RADIO_SHORTS_DISABLED_RXEN_Msk		(1UL << 3)
+#define RADIO_SHORTS_ADDRESS_RSSISTART_Msk	(1UL << 4)
+#define RADIO_SHORTS_END_START_Msk			(1UL << 5)
+#define RADIO_SHORTS_ADDRESS_BCSTART_Msk	(1UL << 6)
+#define RADIO_SHORTS_DISABLED_RSSISTOP_Msk	(1UL << 8)
+
+#define RADIO_INTENSET_READY_Msk			(1UL << 0)
+#define RADIO_INTENSET_ADDRESS_Msk			(1UL << 1)
+#define RADIO_INTENSET_PAYLOAD_Msk			(1UL << 2)
+#define RADIO_INTENSET_END_Msk				(1UL << 3)
+#define RADIO_INTENSET_DISABLED_Msk			(1UL << 4)
+#define RADIO_INTENCLR_READY_Msk			(1UL << 0)
+#define RADIO_INTENCLR_DISABLED_Msk			(1UL << 4)
+
+#define RADIO_PCNF0_LFLEN_Pos				0
+#define RADIO_PCNF0_LFLEN_Msk				(0xFUL << RADIO_PCNF0_LFLEN_Pos)
+#define RADIO_PCNF0_S0LEN_Pos				8
+#define RADIO_PCNF0_S0LEN_Msk				(0x1UL << RADIO_PCNF0_S0LEN_Pos)
+#define RADIO_PCNF0_S1LEN_Pos				16
+#define RADIO_PCNF0_S1LEN_Msk				(0xFUL << RADIO_PCNF0_S1LEN_Pos)
+
+#define RADIO_PCNF1_MAXLEN_Pos				0
+#define RADIO_PCNF1_MAXLEN_Msk				(0xFFUL << RADIO_PCNF1_MAXLEN_Pos)
+#define RADIO_PCNF1_STATLEN_Pos				8
+#define RADIO_PCNF1_STATLEN_Msk				(0xFFUL << RADIO_PCNF1_STATLEN_Pos)
+#define RADIO_PCNF1_BALEN_Pos				16
+#define RADIO_PCNF1_BALEN_Msk				(0x7UL << RADIO_PCNF1_BALEN_Pos)
+#define RADIO_PCNF1_ENDIAN_Pos				24
+#define RADIO_PCNF1_ENDIAN_Big				1UL
+#define RADIO_PCNF1_WHITEEN_Pos				25
+#define RADIO_PCNF1_WHITEEN_Disabled		0UL
+
+#define RADIO_MODE_MODE_Pos					0
+#define RADIO_MODE_MODE_Nrf_1Mbit			0UL
+#define RADIO_MODE_MODE_Nrf_2Mbit			1UL
+
+#define RADIO_CRCCNF_LEN_Pos				0
+#define RADIO_CRCCNF_LEN_Msk				(0x3UL << RADIO_CRCCNF_LEN_Pos)
+#define RADIO_CRCCNF_LEN_Disabled			0UL
+#define RADIO_CRCCNF_LEN_One				1UL
+#define RADIO_CRCCNF_LEN_Two				2UL
+
+#define RADIO_TXPOWER_TXPOWER_Pos			0
+#define RADIO_TXPOWER_TXPOWER_Pos4dBm		0x04UL
+#define RADIO_TXPOWER_TXPOWER_0dBm			0x00UL
+#define RADIO_TXPOWER_TXPOWER_Neg4dBm		0xFCUL
+#define RADIO_TXPOWER_TXPOWER_Neg8dBm		0xF8UL
+#define RADIO_TXPOWER_TXPOWER_Neg12dBm		0xF4UL
+#define RADIO_TXPOWER_TXPOWER_Neg16dBm		0xF0UL
+#define RADIO_TXPOWER_TXPOWER_Neg20dBm		0xECUL
+#define RADIO_TXPOWER_TXPOWER_Neg30dBm		0xD8UL
+
+#define RADIO_STATE_STATE_Disabled			0UL
+#define RADIO_STATE_STATE_RxRu				1UL
+#define RADIO_STATE_STATE_RxIdle			2UL
+#define RADIO_STATE_STATE_Rx				3UL
+#define RADIO_STATE_STATE_RxDisable			4UL
+#define RADIO_STATE_STATE_TxRu				9UL
+#define RADIO_STATE_STATE_TxIdle			10UL
+#define RADIO_STATE_STATE_Tx				11UL
+#define RADIO_STATE_STATE_TxDisable			12UL
+
+#define TIMER_MODE_MODE_Timer				0UL
+#define TIMER_BITMODE_BITMODE_16Bit			0UL
+#define TIMER_BITMODE_BITMODE_08Bit			1UL
+#define TIMER_BITMODE_BITMODE_24Bit			2UL
+#define TIMER_BITMODE_BITMODE_32Bit			3UL
+#define TIMER_SHORTS_COMPARE0_CLEAR_Msk		(1UL << 0)
+#define TIMER_SHORTS_COMPARE1_CLEAR_Msk		(1UL << 1)
+#define TIMER_SHORTS_COMPARE0_STOP_Msk		(1UL << 8)
+#define TIMER_SHORTS_COMPARE1_STOP_Msk		(1UL << 9)
+
+#define CLOCK_HFCLKRUN_STATUS_Msk			(1UL << 0)
+#define CLOCK_HFCLKSTAT_SRC_Msk				(1UL << 0)
+#define CLOCK_HFCLKSTAT_STATE_Msk			(1UL << 16)
+
+#endif /* NRF52_H_ */
@@ -0,0 +1,1205 @@
+/*
+ * nrf_emu.c
+ *
+ *  nRF52832 RADIO, TIMER1, PPI & CLOCK register emulator
+ *
+ *  The driver gets a read only view of the peripheral pages, every store to a
+ *  register faults and the SIGSEGV handler decodes the x86 store, runs the
+ *  register semantics and steps over the instruction. The emulator itself
+ *  works on a writable alias of the same pages. Tasks start on write, events
+ *  run the PPI channels and the SHORTS, the RADIO interrupt is served by a
+ *  thread per node with the system locked.
+ *
+ *  Packets are put on a virtual air with the nRF52832 ramp up, disable and
+ *  bit times, a receiver syncs on a packet when it listens before the end of
+ *  the preamble on the same frequency and address. Packets overlapping on a
+ *  frequency give CRC errors to the receivers of both.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "nrf_emu.h"
+
+#define PAGE_SIZE_EMU		4096
+#define T_NONE				UINT64_MAX
+
+_Static_assert(offsetof(NRF_RADIO_Type, EVENTS_READY) == 0x100, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, SHORTS) == 0x200, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, INTENSET) == 0x304, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, CRCSTATUS) == 0x400, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, PACKETPTR) == 0x504, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, RSSISAMPLE) == 0x548, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, STATE) == 0x550, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, DAB) == 0x600, "RADIO layout");
+_Static_assert(offsetof(NRF_RADIO_Type, POWER) == 0xFFC, "RADIO layout");
+_Static_assert(offsetof(NRF_TIMER_Type, TASKS_CAPTURE) == 0x040, "TIMER layout");
+_Static_assert(offsetof(NRF_TIMER_Type, EVENTS_COMPARE) == 0x140, "TIMER layout");
+_Static_assert(offsetof(NRF_TIMER_Type, SHORTS) == 0x200, "TIMER layout");
+_Static_assert(offsetof(NRF_TIMER_Type, INTENSET) == 0x304, "TIMER layout");
+_Static_assert(offsetof(NRF_TIMER_Type, MODE) == 0x504, "TIMER layout");
+_Static_assert(offsetof(NRF_TIMER_Type, PRESCALER) == 0x510, "TIMER layout");
+_Static_assert(offsetof(NRF_TIMER_Type, CC) == 0x540, "TIMER layout");
+_Static_assert(offsetof(NRF_PPI_Type, CHEN) == 0x500, "PPI layout");
+_Static_assert(offsetof(NRF_PPI_Type, CH) == 0x510, "PPI layout");
+_Static_assert(offsetof(NRF_PPI_Type, CHG) == 0x800, "PPI layout");
+_Static_assert(offsetof(NRF_CLOCK_Type, EVENTS_HFCLKSTARTED) == 0x100, "CLOCK layout");
+_Static_assert(offsetof(NRF_CLOCK_Type, INTENSET) == 0x304, "CLOCK layout");
+_Static_assert(offsetof(NRF_CLOCK_Type, HFCLKRUN) == 0x408, "CLOCK layout");
+_Static_assert(offsetof(NRF_FICR_Type, DEVICEID) == 0x060, "FICR layout");
+_Static_assert(sizeof(NRF_RADIO_Type) <= PAGE_SIZE_EMU && sizeof(NRF_PPI_Type) <= PAGE_SIZE_EMU, "page size");
+
+// Peripheral pages of a node
+enum { P_RADIO, P_TIMER, P_PPI, P_CLOCK, P_COUNT };
+
+#define REG(n, p, type, reg)	nodes[n].regs[p][offsetof(type, reg) / 4]
+#define RADIO(n, reg)			REG(n, P_RADIO, NRF_RADIO_Type, reg)
+#define TIMER(n, reg)			REG(n, P_TIMER, NRF_TIMER_Type, reg)
+#define PPI(n, reg)				REG(n, P_PPI, NRF_PPI_Type, reg)
+#define CLOCK(n, reg)			REG(n, P_CLOCK, NRF_CLOCK_Type, reg)
+
+#define OFF(type, reg)			((uint32_t) offsetof(type, reg))
+#define TIMER_CC_COUNT			4		// TIMER1 of the nRF52832
+
+typedef struct packet packet_t;
+
+struct packet {
+	packet_t *next;
+	int src;
+	uint32_t freq;
+	uint32_t mode;
+	uint8_t prefix;
+	uint32_t base;
+	uint32_t balen;
+	uint32_t pcnf0;
+	uint32_t size;				// header & payload bytes
+	uint32_t payload;
+	uint8_t data[2 + 256];
+	uint16_t crc;
+	uint64_t t_start;
+	uint64_t t_sync;			// end of the preamble
+	uint64_t t_addr;
+	uint64_t t_payload;
+	uint64_t t_end;
+	int phase;					// 0 before ADDRESS, 1 before PAYLOAD, 2 before END
+};
+
+typedef struct {
+	uint32_t *regs[P_COUNT];	// writable alias
+	uint8_t *view[P_COUNT];		// read only, the driver addresses
+	NRF_FICR_Type ficr;
+
+	// RADIO
+	uint32_t state;
+	uint64_t t_state;			// ramp up or disable end
+	uint64_t t_stats;			// last state change counted in the stats
+	uint64_t rx_since;
+	packet_t *tx_packet;
+	packet_t *rx_packet;		// packet the receiver is synced on
+	bool rx_corrupt;
+
+	// TIMER, the counter is count at t_count while running
+	bool running;
+	uint32_t count;
+	uint64_t t_count;
+
+	// CLOCK
+	bool hfxo;
+
+	// RADIO interrupt
+	void (*isr)(void *arg);
+	void *isr_arg;
+	pthread_t irq_tid;
+	pthread_cond_t irq_cond;
+	bool irq_pending;
+
+	nrf_emu_stats_t stats;
+} node_t;
+
+typedef struct {
+	nrf_emu_link_t cfg;
+	bool bad;
+} link_t;
+
+static pthread_mutex_t hw_mtx = PTHREAD_MUTEX_INITIALIZER;
+static node_t *nodes;
+static int node_count;
+static link_t links[NRF_EMU_NODES_MAX][NRF_EMU_NODES_MAX];
+static packet_t *air;
+static uint32_t irq_busy;
+static uint64_t rand_state;
+static uint8_t *view_base;
+static size_t view_size;
+
+static void event(int n, int p, uint32_t off);
+static void task(int n, int p, uint32_t off);
+
+static uint32_t rand32(void) {
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return (uint32_t) (rand_state >> 32);
+}
+
+static bool chance(float p) {
+	return p > 0 && (float) rand32() / 4294967296.0f < p;
+}
+
+static uint64_t now(void) {
+	return sim_time();
+}
+
+static bool is_tx_state(uint32_t state) {
+	return state >= RADIO_STATE_STATE_TxRu && state <= RADIO_STATE_STATE_TxDisable;
+}
+
+static bool is_rx_state(uint32_t state) {
+	return state >= RADIO_STATE_STATE_RxRu && state <= RADIO_STATE_STATE_RxDisable;
+}
+
+static void count_state(node_t *np) {
+	uint64_t t = now();
+
+	if (is_tx_state(np->state))
+		np->stats.tx_us += t - np->t_stats;
+	else if (is_rx_state(np->state))
+		np->stats.rx_us += t - np->t_stats;
+	if (np->hfxo)
+		np->stats.hfxo_us += t - np->t_stats;
+	np->t_stats = t;
+}
+
+static void set_state(int n, uint32_t state) {
+	count_state(&nodes[n]);
+	nodes[n].state = state;
+	RADIO(n, STATE) = state;
+}
+
+/*
+ * Interrupts
+ */
+
+static bool irq_level(int n) {
+	uint32_t inten = RADIO(n, INTENSET);
+
+	for (int b=0; inten != 0; b++, inten >>= 1) {
+		if ((inten & 1) && nodes[n].regs[P_RADIO][OFF(NRF_RADIO_Type, EVENTS_READY) / 4 + b])
+			return true;
+	}
+	return false;
+}
+
+static void irq_update(int n) {
+	node_t *np = &nodes[n];
+
+	if (np->isr != NULL && !np->irq_pending && irq_level(n)) {
+		np->irq_pending = true;
+		irq_busy++;
+		pthread_cond_signal(&np->irq_cond);
+	}
+}
+
+// The ISR runs with the system locked, the lock order is system then hardware.
+static void *irq_thread(void *arg) {
+	node_t *np = arg;
+	int n = (int) (np - nodes);
+
+	pthread_mutex_lock(&hw_mtx);
+	for (;;) {
+		while (!np->irq_pending)
+			pthread_cond_wait(&np->irq_cond, &hw_mtx);
+		pthread_mutex_unlock(&hw_mtx);
+
+		chSysLockFromISR();
+		np->isr(np->isr_arg);
+		pthread_mutex_lock(&hw_mtx);
+		if (!irq_level(n)) {
+			np->irq_pending = false;
+			irq_busy--;
+		}
+		sim_notify();
+		chSysUnlockFromISR();
+	}
+	return NULL;
+}
+
+/*
+ * PPI
+ */
+
+static bool view_decode(uint32_t addr, int *n, int *p, uint32_t *off) {
+	uintptr_t a = (uintptr_t) addr;
+
+	if (a < (uintptr_t) view_base || a >= (uintptr_t) view_base + view_size)
+		return false;
+	a -= (uintptr_t) view_base;
+	*n = (int) (a / PAGE_SIZE_EMU / P_COUNT);
+	*p = (int) (a / PAGE_SIZE_EMU % P_COUNT);
+	*off = (uint32_t) (a % PAGE_SIZE_EMU);
+	return true;
+}
+
+static void ppi_run(int n, int p, uint32_t off) {
+	uint32_t eep = (uint32_t) (uintptr_t) (nodes[n].view[p] + off);
+	uint32_t chen = PPI(n, CHEN);
+
+	for (int ch=0; ch < 20; ch++) {
+		uint32_t *regs = &PPI(n, CH[0].EEP) + ch * 2;
+		int tn, tp;
+		uint32_t toff;
+
+		if ((chen & (1UL << ch)) && regs[0] == eep && view_decode(regs[1], &tn, &tp, &toff))
+			task(tn, tp, toff);
+	}
+}
+
+/*
+ * RADIO
+ */
+
+static uint32_t bit_us_x2(uint32_t mode) {
+	return mode == RADIO_MODE_MODE_Nrf_2Mbit ? 1 : 2;
+}
+
+// uS of the bits, rounded up
+static uint64_t bits_us(uint32_t mode, uint32_t bits) {
+	return (bits * bit_us_x2(mode) + 1) / 2;
+}
+
+static uint32_t addr_prefix(int n, uint32_t logical) {
+	uint32_t prefix = logical < 4 ? RADIO(n, PREFIX0) : RADIO(n, PREFIX1);
+
+	return (prefix >> ((logical & 3) * 8)) & 0xFF;
+}
+
+static uint32_t addr_base(int n, uint32_t logical, uint32_t balen) {
+	uint32_t base = logical == 0 ? RADIO(n, BASE0) : RADIO(n, BASE1);
+
+	return balen >= 4 ? base : base & (0xFFFFFFFFUL << ((4 - balen) * 8));
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t *data, uint32_t size) {
+	for (uint32_t i=0; i < size; i++) {
+		crc ^= (uint16_t) data[i] << 8;
+		for (int b=0; b < 8; b++)
+			crc = crc & 0x8000 ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+	}
+	return crc;
+}
+
+static uint32_t header_size(uint32_t pcnf0) {
+	return ((pcnf0 & RADIO_PCNF0_S0LEN_Msk) ? 1 : 0) +
+			((pcnf0 & RADIO_PCNF0_LFLEN_Msk) ? 1 : 0) +
+			((pcnf0 & RADIO_PCNF0_S1LEN_Msk) ? 1 : 0);
+}
+
+// Payload bytes of the packet by the header in RAM and the node format
+static uint32_t payload_size(int n, const uint8_t *header, bool *truncated) {
+	uint32_t pcnf0 = RADIO(n, PCNF0), pcnf1 = RADIO(n, PCNF1);
+	uint32_t lflen = (pcnf0 & RADIO_PCNF0_LFLEN_Msk) >> RADIO_PCNF0_LFLEN_Pos;
+	uint32_t maxlen = (pcnf1 & RADIO_PCNF1_MAXLEN_Msk) >> RADIO_PCNF1_MAXLEN_Pos;
+	uint32_t payload = (pcnf1 & RADIO_PCNF1_STATLEN_Msk) >> RADIO_PCNF1_STATLEN_Pos;
+
+	if (lflen > 0)
+		payload += header[(pcnf0 & RADIO_PCNF0_S0LEN_Msk) ? 1 : 0] & ((1UL << lflen) - 1);
+	*truncated = payload > maxlen;
+	return *truncated ? maxlen : payload;
+}
+
+static bool link_carrier(int from, int to, uint32_t freq) {
+	return links[from][to].cfg.connected && RADIO(to, FREQUENCY) == freq;
+}
+
+// RSSI of the strongest carrier on the node frequency
+static uint32_t rssi_sample(int n) {
+	uint32_t rssi = NRF_EMU_RSSI_NOISE;
+
+	for (packet_t *pp = air; pp != NULL; pp = pp->next) {
+		if (pp->src != n && link_carrier(pp->src, n, pp->freq) && links[pp->src][n].cfg.rssi < rssi)
+			rssi = links[pp->src][n].cfg.rssi;
+	}
+	return rssi;
+}
+
+// EasyDMA transfer, a byte loop so the memcpy counts of the tests see the CPU copies only
+static void dma_copy(volatile uint8_t *dst, const volatile uint8_t *src, uint32_t size) {
+	while (size-- > 0)
+		*dst++ = *src++;
+}
+
+static bool overlap(const packet_t *a, const packet_t *b) {
+	return a->t_start < b->t_end && b->t_start < a->t_end;
+}
+
+// Loss draw of the link, the state of the two state model moves first
+static bool link_lost(int from, int to) {
+	link_t *lp = &links[from][to];
+
+	if (lp->bad) {
+		if (chance(lp->cfg.p_good))
+			lp->bad = false;
+	}
+	else if (chance(lp->cfg.p_bad)) {
+		lp->bad = true;
+	}
+	return chance(lp->bad ? lp->cfg.loss_bad : lp->cfg.loss);
+}
+
+static void air_remove(packet_t *pp) {
+	packet_t **pprev = &air;
+
+	while (*pprev != pp)
+		pprev = &(*pprev)->next;
+	*pprev = pp->next;
+
+	for (int n=0; n < node_count; n++) {
+		if (nodes[n].rx_packet == pp)
+			nodes[n].rx_packet = NULL;
+	}
+	if (nodes[pp->src].tx_packet == pp)
+		nodes[pp->src].tx_packet = NULL;
+	free(pp);
+}
+
+static void tx_start(int n) {
+	node_t *np = &nodes[n];
+	packet_t *pp = calloc(1, sizeof(packet_t));
+	const uint8_t *ram = (const uint8_t *) (uintptr_t) RADIO(n, PACKETPTR);
+	uint32_t logical = RADIO(n, TXADDRESS) & 7;
+	uint32_t pcnf0 = RADIO(n, PCNF0);
+	uint32_t lflen = (pcnf0 & RADIO_PCNF0_LFLEN_Msk) >> RADIO_PCNF0_LFLEN_Pos;
+	uint32_t s1len = (pcnf0 & RADIO_PCNF0_S1LEN_Msk) >> RADIO_PCNF0_S1LEN_Pos;
+	uint32_t crclen = RADIO(n, CRCCNF) & RADIO_CRCCNF_LEN_Msk;
+	uint32_t preamble = RADIO(n, MODE) == RADIO_MODE_MODE_Nrf_2Mbit ? 16 : 8;
+	uint32_t header_bits;
+	bool truncated;
+
+	pp->src = n;
+	pp->freq = RADIO(n, FREQUENCY);
+	pp->mode = RADIO(n, MODE);
+	pp->balen = (RADIO(n, PCNF1) & RADIO_PCNF1_BALEN_Msk) >> RADIO_PCNF1_BALEN_Pos;
+	pp->prefix = (uint8_t) addr_prefix(n, logical);
+	pp->base = addr_base(n, logical, pp->balen);
+	pp->pcnf0 = pcnf0;
+	pp->payload = payload_size(n, ram, &truncated);
+	pp->size = header_size(pcnf0) + pp->payload;
+	dma_copy(pp->data, ram, pp->size);
+
+	pp->crc = crc16(0xFFFF, &pp->prefix, 1);
+	for (uint32_t i=0; i < pp->balen; i++) {
+		uint8_t b = (uint8_t) (pp->base >> (24 - i * 8));
+		pp->crc = crc16(pp->crc, &b, 1);
+	}
+	pp->crc = crc16(pp->crc, pp->data, pp->size);
+
+	header_bits = ((pcnf0 & RADIO_PCNF0_S0LEN_Msk) ? 8 : 0) + lflen + s1len;
+	pp->t_start = now();
+	pp->t_sync = pp->t_start + bits_us(pp->mode, preamble);
+	pp->t_addr = pp->t_start + bits_us(pp->mode, preamble + (pp->balen + 1) * 8);
+	pp->t_payload = pp->t_addr + bits_us(pp->mode, header_bits + pp->payload * 8);
+	pp->t_end = pp->t_payload + bits_us(pp->mode, crclen * 8);
+
+	// The new carrier corrupts the packets being received on the frequency
+	for (int r=0; r < node_count; r++) {
+		if (r != n && nodes[r].rx_packet != NULL && link_carrier(n, r, pp->freq))
+			nodes[r].rx_corrupt = true;
+	}
+
+	pp->next = air;
+	air = pp;
+	np->tx_packet = pp;
+	np->stats.packets++;
+	set_state(n, RADIO_STATE_STATE_Tx);
+}
+
+// The sender stops, the packet ends on air
+static void tx_abort(int n) {
+	node_t *np = &nodes[n];
+
+	if (np->tx_packet != NULL) {
+		np->stats.air_us += now() - np->tx_packet->t_start;
+		air_remove(np->tx_packet);
+	}
+}
+
+static void rx_sync(int r, packet_t *pp) {
+	node_t *rp = &nodes[r];
+	uint32_t rxaddresses = RADIO(r, RXADDRESSES);
+	uint32_t balen = (RADIO(r, PCNF1) & RADIO_PCNF1_BALEN_Msk) >> RADIO_PCNF1_BALEN_Pos;
+	int match = -1;
+
+	if (rp->state != RADIO_STATE_STATE_Rx || rp->rx_packet != NULL || rp->rx_since > pp->t_sync ||
+			!link_carrier(pp->src, r, pp->freq) || RADIO(r, MODE) != pp->mode || balen != pp->balen)
+		return;
+
+	for (uint32_t i=0; i < 8 && match < 0; i++) {
+		if ((rxaddresses & (1UL << i)) && addr_prefix(r, i) == pp->prefix && addr_base(r, i, balen) == pp->base)
+			match = (int) i;
+	}
+	if (match < 0)
+		return;
+
+	if (link_lost(pp->src, r)) {
+		rp->stats.lost++;
+		return;
+	}
+
+	rp->rx_packet = pp;
+	rp->rx_corrupt = false;
+	for (packet_t *op = air; op != NULL; op = op->next) {
+		if (op != pp && op->src != r && link_carrier(op->src, r, pp->freq) && overlap(op, pp))
+			rp->rx_corrupt = true;
+	}
+	RADIO(r, RXMATCH) = (uint32_t) match;
+	event(r, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_ADDRESS));
+}
+
+static void rx_end(int r, packet_t *pp) {
+	node_t *rp = &nodes[r];
+	uint8_t *ram = (uint8_t *) (uintptr_t) RADIO(r, PACKETPTR);
+	bool truncated;
+	uint32_t payload;
+	bool ok = !rp->rx_corrupt;
+
+	if (header_size(RADIO(r, PCNF0)) != header_size(pp->pcnf0) || RADIO(r, PCNF0) != pp->pcnf0)
+		ok = false;
+	payload = payload_size(r, pp->data, &truncated);
+	if (truncated || payload != pp->payload)
+		ok = false;
+	if (payload > pp->payload)
+		payload = pp->payload;
+	dma_copy(ram, pp->data, header_size(pp->pcnf0) + payload);
+
+	rp->rx_packet = NULL;
+	if (ok)
+		rp->stats.received++;
+	else
+		rp->stats.crc_errors++;
+
+	RADIO(r, CRCSTATUS) = ok ? 1 : 0;
+	RADIO(r, RXCRC) = ok ? pp->crc : (uint32_t) (pp->crc ^ 0x5A5A);
+	RADIO(r, RSSISAMPLE) = links[pp->src][r].cfg.rssi;
+	set_state(r, RADIO_STATE_STATE_RxIdle);
+	event(r, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_PAYLOAD));
+	event(r, P_RADIO, ok ? OFF(NRF_RADIO_Type, EVENTS_CRCOK) : OFF(NRF_RADIO_Type, EVENTS_CRCERROR));
+	event(r, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_END));
+}
+
+static void packet_step(packet_t *pp) {
+	int n = pp->src;
+
+	switch (pp->phase++) {
+	case 0:
+		event(n, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_ADDRESS));
+		for (int r=0; r < node_count; r++) {
+			if (r != n && nodes[n].tx_packet == pp)
+				rx_sync(r, pp);
+		}
+		break;
+	case 1:
+		event(n, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_PAYLOAD));
+		break;
+	default:
+		nodes[n].stats.air_us += pp->t_end - pp->t_start;
+		nodes[n].tx_packet = NULL;
+		set_state(n, RADIO_STATE_STATE_TxIdle);
+		for (int r=0; r < node_count; r++) {
+			if (nodes[r].rx_packet == pp)
+				rx_end(r, pp);
+		}
+		air_remove(pp);
+		event(n, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_END));
+		break;
+	}
+}
+
+static uint64_t packet_next(const packet_t *pp) {
+	return pp->phase == 0 ? pp->t_addr : pp->phase == 1 ? pp->t_payload : pp->t_end;
+}
+
+static void radio_disable(int n) {
+	node_t *np = &nodes[n];
+	uint32_t mode = RADIO(n, MODE);
+
+	if (is_tx_state(np->state) && np->state != RADIO_STATE_STATE_TxDisable) {
+		tx_abort(n);
+		set_state(n, RADIO_STATE_STATE_TxDisable);
+		np->t_state = now() + (mode == RADIO_MODE_MODE_Nrf_2Mbit ? NRF_EMU_TX_DISABLE_2M_US : NRF_EMU_TX_DISABLE_1M_US);
+	}
+	else if (is_rx_state(np->state) && np->state != RADIO_STATE_STATE_RxDisable) {
+		np->rx_packet = NULL;
+		set_state(n, RADIO_STATE_STATE_RxDisable);
+		np->t_state = now() + NRF_EMU_RX_DISABLE_US;
+	}
+}
+
+static void radio_task(int n, uint32_t off) {
+	node_t *np = &nodes[n];
+
+	switch (off) {
+	case OFF(NRF_RADIO_Type, TASKS_TXEN):
+		if (np->state == RADIO_STATE_STATE_Disabled) {
+			set_state(n, RADIO_STATE_STATE_TxRu);
+			np->t_state = now() + NRF_EMU_RAMP_UP_US;
+		}
+		break;
+	case OFF(NRF_RADIO_Type, TASKS_RXEN):
+		if (np->state == RADIO_STATE_STATE_Disabled) {
+			set_state(n, RADIO_STATE_STATE_RxRu);
+			np->t_state = now() + NRF_EMU_RAMP_UP_US;
+		}
+		break;
+	case OFF(NRF_RADIO_Type, TASKS_START):
+		if (np->state == RADIO_STATE_STATE_TxIdle) {
+			tx_start(n);
+		}
+		else if (np->state == RADIO_STATE_STATE_RxIdle) {
+			np->rx_since = now();
+			set_state(n, RADIO_STATE_STATE_Rx);
+		}
+		break;
+	case OFF(NRF_RADIO_Type, TASKS_STOP):
+		if (np->state == RADIO_STATE_STATE_Tx) {
+			tx_abort(n);
+			set_state(n, RADIO_STATE_STATE_TxIdle);
+		}
+		else if (np->state == RADIO_STATE_STATE_Rx) {
+			np->rx_packet = NULL;
+			set_state(n, RADIO_STATE_STATE_RxIdle);
+		}
+		break;
+	case OFF(NRF_RADIO_Type, TASKS_DISABLE):
+		radio_disable(n);
+		break;
+	case OFF(NRF_RADIO_Type, TASKS_RSSISTART):
+		RADIO(n, RSSISAMPLE) = rssi_sample(n);
+		event(n, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_RSSIEND));
+		break;
+	default:
+		break;
+	}
+}
+
+static void radio_shorts(int n, uint32_t off) {
+	uint32_t shorts = RADIO(n, SHORTS);
+
+	switch (off) {
+	case OFF(NRF_RADIO_Type, EVENTS_READY):
+		if (shorts & RADIO_SHORTS_READY_START_Msk)
+			radio_task(n, OFF(NRF_RADIO_Type, TASKS_START));
+		break;
+	case OFF(NRF_RADIO_Type, EVENTS_ADDRESS):
+		if (shorts & RADIO_SHORTS_ADDRESS_RSSISTART_Msk)
+			radio_task(n, OFF(NRF_RADIO_Type, TASKS_RSSISTART));
+		break;
+	case OFF(NRF_RADIO_Type, EVENTS_END):
+		if (shorts & RADIO_SHORTS_END_DISABLE_Msk)
+			radio_task(n, OFF(NRF_RADIO_Type, TASKS_DISABLE));
+		if (shorts & RADIO_SHORTS_END_START_Msk)
+			radio_task(n, OFF(NRF_RADIO_Type, TASKS_START));
+		break;
+	case OFF(NRF_RADIO_Type, EVENTS_DISABLED):
+		if (shorts & RADIO_SHORTS_DISABLED_TXEN_Msk)
+			radio_task(n, OFF(NRF_RADIO_Type, TASKS_TXEN));
+		if (shorts & RADIO_SHORTS_DISABLED_RXEN_Msk)
+			radio_task(n, OFF(NRF_RADIO_Type, TASKS_RXEN));
+		break;
+	default:
+		break;
+	}
+}
+
+// Ramp up or disable done
+static void radio_step(int n) {
+	node_t *np = &nodes[n];
+
+	np->t_state = T_NONE;
+	switch (np->state) {
+	case RADIO_STATE_STATE_TxRu:
+		set_state(n, RADIO_STATE_STATE_TxIdle);
+		event(n, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_READY));
+		break;
+	case RADIO_STATE_STATE_RxRu:
+		set_state(n, RADIO_STATE_STATE_RxIdle);
+		event(n, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_READY));
+		break;
+	case RADIO_STATE_STATE_TxDisable:
+	case RADIO_STATE_STATE_RxDisable:
+		set_state(n, RADIO_STATE_STATE_Disabled);
+		event(n, P_RADIO, OFF(NRF_RADIO_Type, EVENTS_DISABLED));
+		break;
+	default:
+		break;
+	}
+}
+
+// POWER off resets the RADIO, no DISABLED event
+static void radio_power_off(int n) {
+	node_t *np = &nodes[n];
+
+	tx_abort(n);
+	np->rx_packet = NULL;
+	np->t_state = T_NONE;
+	set_state(n, RADIO_STATE_STATE_Disabled);
+	memset(&np->regs[P_RADIO][OFF(NRF_RADIO_Type, EVENTS_READY) / 4], 0, 0x80);
+	RADIO(n, SHORTS) = 0;
+	RADIO(n, INTENSET) = RADIO(n, INTENCLR) = 0;
+}
+
+/*
+ * TIMER
+ */
+
+static uint32_t timer_mask(int n) {
+	switch (TIMER(n, BITMODE) & 3) {
+	case TIMER_BITMODE_BITMODE_08Bit:
+		return 0xFF;
+	case TIMER_BITMODE_BITMODE_24Bit:
+		return 0xFFFFFF;
+	case TIMER_BITMODE_BITMODE_32Bit:
+		return 0xFFFFFFFF;
+	default:
+		return 0xFFFF;
+	}
+}
+
+// Move the counter reference to the time, a compare fires after it only
+static void timer_sync(int n, uint64_t t) {
+	node_t *np = &nodes[n];
+
+	if (np->running)
+		np->count = (uint32_t) (np->count + (t - np->t_count)) & timer_mask(n);
+	np->t_count = t;
+}
+
+static uint64_t timer_next(int n, int cc) {
+	node_t *np = &nodes[n];
+	uint32_t mask = timer_mask(n);
+	uint32_t ticks;
+
+	if (!np->running)
+		return T_NONE;
+	ticks = (TIMER(n, CC[cc]) - np->count) & mask;
+	return np->t_count + (ticks == 0 ? (uint64_t) mask + 1 : ticks);
+}
+
+static void timer_task(int n, uint32_t off) {
+	node_t *np = &nodes[n];
+
+	switch (off) {
+	case OFF(NRF_TIMER_Type, TASKS_START):
+		if (TIMER(n, PRESCALER) != 4) {
+			fprintf(stderr, "nrf_emu: the TIMER runs at 1 MHz only\n");
+			abort();
+		}
+		np->running = true;
+		break;
+	case OFF(NRF_TIMER_Type, TASKS_STOP):
+		np->running = false;
+		break;
+	case OFF(NRF_TIMER_Type, TASKS_CLEAR):
+		np->count = 0;
+		break;
+	case OFF(NRF_TIMER_Type, TASKS_SHUTDOWN):
+		np->running = false;
+		np->count = 0;
+		break;
+	default:
+		if (off >= OFF(NRF_TIMER_Type, TASKS_CAPTURE) && off < OFF(NRF_TIMER_Type, TASKS_CAPTURE) + TIMER_CC_COUNT * 4)
+			TIMER(n, CC[(off - OFF(NRF_TIMER_Type, TASKS_CAPTURE)) / 4]) = np->count;
+		break;
+	}
+}
+
+static void timer_compare(int n, int cc) {
+	uint32_t shorts = TIMER(n, SHORTS);
+
+	timer_sync(n, now());
+	event(n, P_TIMER, OFF(NRF_TIMER_Type, EVENTS_COMPARE[cc]));
+	if (shorts & (1UL << cc))
+		timer_task(n, OFF(NRF_TIMER_Type, TASKS_CLEAR));
+	if (shorts & (1UL << (8 + cc)))
+		timer_task(n, OFF(NRF_TIMER_Type, TASKS_STOP));
+}
+
+/*
+ * Registers
+ */
+
+static void event(int n, int p, uint32_t off) {
+	nodes[n].regs[p][off / 4] = 1;
+	ppi_run(n, p, off);
+	if (p == P_RADIO) {
+		radio_shorts(n, off);
+		irq_update(n);
+	}
+}
+
+static void task(int n, int p, uint32_t off) {
+	switch (p) {
+	case P_RADIO:
+		radio_task(n, off);
+		break;
+	case P_TIMER:
+		timer_sync(n, now());
+		timer_task(n, off);
+		break;
+	case P_CLOCK:
+		if (off == OFF(NRF_CLOCK_Type, TASKS_HFCLKSTART)) {
+			// The HFXO is taken as started at once
+			CLOCK(n, HFCLKSTAT) = CLOCK_HFCLKSTAT_SRC_Msk | CLOCK_HFCLKSTAT_STATE_Msk;
+			CLOCK(n, HFCLKRUN) = 1;
+			count_state(&nodes[n]);
+			nodes[n].hfxo = true;
+			event(n, P_CLOCK, OFF(NRF_CLOCK_Type, EVENTS_HFCLKSTARTED));
+		}
+		else if (off == OFF(NRF_CLOCK_Type, TASKS_HFCLKSTOP)) {
+			CLOCK(n, HFCLKSTAT) = CLOCK_HFCLKSTAT_STATE_Msk;
+			CLOCK(n, HFCLKRUN) = 0;
+			count_state(&nodes[n]);
+			nodes[n].hfxo = false;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void reg_write(int n, int p, uint32_t off, uint32_t value) {
+	uint32_t *regs = nodes[n].regs[p];
+
+	// Tasks start on write and read 0
+	if (off < 0x100) {
+		if (value != 0 && p != P_PPI)
+			task(n, p, off);
+		return;
+	}
+
+	switch (p) {
+	case P_RADIO:
+		if (off == OFF(NRF_RADIO_Type, INTENSET) || off == OFF(NRF_RADIO_Type, INTENCLR)) {
+			uint32_t inten = RADIO(n, INTENSET);
+			inten = off == OFF(NRF_RADIO_Type, INTENSET) ? inten | value : inten & ~value;
+			RADIO(n, INTENSET) = RADIO(n, INTENCLR) = inten;
+		}
+		else if (off == OFF(NRF_RADIO_Type, POWER)) {
+			if (value == 0)
+				radio_power_off(n);
+			regs[off / 4] = value & 1;
+		}
+		else if (off == OFF(NRF_RADIO_Type, STATE) || off == OFF(NRF_RADIO_Type, RSSISAMPLE)) {
+			// read only
+		}
+		else {
+			regs[off / 4] = value;
+		}
+		irq_update(n);
+		break;
+	case P_TIMER:
+		timer_sync(n, now());
+		if (off == OFF(NRF_TIMER_Type, INTENSET) || off == OFF(NRF_TIMER_Type, INTENCLR)) {
+			uint32_t inten = TIMER(n, INTENSET);
+			inten = off == OFF(NRF_TIMER_Type, INTENSET) ? inten | value : inten & ~value;
+			TIMER(n, INTENSET) = TIMER(n, INTENCLR) = inten;
+		}
+		else {
+			regs[off / 4] = value;
+		}
+		break;
+	case P_PPI:
+		if (off == OFF(NRF_PPI_Type, CHEN) || off == OFF(NRF_PPI_Type, CHENSET) || off == OFF(NRF_PPI_Type, CHENCLR)) {
+			uint32_t chen = PPI(n, CHEN);
+			chen = off == OFF(NRF_PPI_Type, CHEN) ? value :
+					off == OFF(NRF_PPI_Type, CHENSET) ? chen | value : chen & ~value;
+			PPI(n, CHEN) = PPI(n, CHENSET) = PPI(n, CHENCLR) = chen;
+		}
+		else {
+			regs[off / 4] = value;
+		}
+		break;
+	case P_CLOCK:
+		if (off != OFF(NRF_CLOCK_Type, HFCLKRUN) && off != OFF(NRF_CLOCK_Type, HFCLKSTAT))
+			regs[off / 4] = value;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Store trap
+ */
+
+static const int gregs_map[16] = {
+	REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+	REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+};
+
+static uint32_t greg(const ucontext_t *uc, int reg, int size, bool rex) {
+	// AH, CH, DH & BH without a REX prefix
+	if (size == 1 && !rex && reg >= 4 && reg < 8)
+		return (uint32_t) (uc->uc_mcontext.gregs[gregs_map[reg - 4]] >> 8) & 0xFF;
+	return (uint32_t) uc->uc_mcontext.gregs[gregs_map[reg]];
+}
+
+static void trap_unknown(const uint8_t *ip) {
+	fprintf(stderr, "nrf_emu: unknown register store at %p:", (const void *) ip);
+	for (int i=0; i < 8; i++)
+		fprintf(stderr, " %02x", ip[i]);
+	fprintf(stderr, "\n");
+	abort();
+}
+
+/*
+ * Decode the store at ip, mov and the add, or, and, sub & xor read modify
+ * writes. Returns the instruction length, the value and its size.
+ */
+static int decode_store(const uint8_t *ip, const ucontext_t *uc, const uint8_t *old, uint32_t *value, int *size) {
+	const uint8_t *p = ip;
+	bool opsize16 = false;
+	uint8_t rex = 0;
+	uint8_t op, modrm;
+	int mod, reg, rm, alu = -1;
+	uint32_t src, dst = 0;
+
+	for (;; p++) {
+		if (*p == 0x66)
+			opsize16 = true;
+		else if (*p != 0xF0 && *p != 0x67 && *p != 0x2E && *p != 0x3E && *p != 0x26 &&
+				*p != 0x36 && *p != 0x64 && *p != 0x65)
+			break;
+	}
+	if ((*p & 0xF0) == 0x40)
+		rex = *p++;
+	if (rex & 0x08)
+		return 0;
+
+	op = *p++;
+	modrm = *p++;
+	mod = modrm >> 6;
+	reg = ((modrm >> 3) & 7) | ((rex & 0x04) ? 8 : 0);
+	rm = modrm & 7;
+	if (mod == 3)
+		return 0;
+	if (rm == 4) {
+		uint8_t sib = *p++;
+		if (mod == 0 && (sib & 7) == 5)
+			p += 4;
+	}
+	else if (mod == 0 && rm == 5) {
+		p += 4;
+	}
+	if (mod == 1)
+		p += 1;
+	else if (mod == 2)
+		p += 4;
+
+	*size = opsize16 ? 2 : 4;
+	switch (op) {
+	case 0x88:
+		*size = 1;
+		src = greg(uc, reg, 1, rex != 0);
+		break;
+	case 0x89:
+		src = greg(uc, reg, *size, rex != 0);
+		break;
+	case 0xC6:
+		*size = 1;
+		src = *p++;
+		break;
+	case 0xC7:
+		if (opsize16) {
+			src = (uint32_t) p[0] | (uint32_t) p[1] << 8;
+			p += 2;
+		}
+		else {
+			memcpy(&src, p, 4);
+			p += 4;
+		}
+		break;
+	case 0x00: case 0x08: case 0x20: case 0x28: case 0x30:
+		*size = 1;
+		/* fall through */
+	case 0x01: case 0x09: case 0x21: case 0x29: case 0x31:
+		alu = op >> 3;
+		src = greg(uc, reg, *size, rex != 0);
+		break;
+	case 0x80:
+		*size = 1;
+		alu = reg & 7;
+		src = *p++;
+		break;
+	case 0x81:
+		alu = reg & 7;
+		if (opsize16) {
+			src = (uint32_t) p[0] | (uint32_t) p[1] << 8;
+			p += 2;
+		}
+		else {
+			memcpy(&src, p, 4);
+			p += 4;
+		}
+		break;
+	case 0x83:
+		alu = reg & 7;
+		src = (uint32_t) (int32_t) (int8_t) *p++;
+		break;
+	default:
+		return 0;
+	}
+
+	if (alu >= 0) {
+		memcpy(&dst, old, (size_t) *size);
+		switch (alu) {
+		case 0: src = dst + src; break;
+		case 1: src = dst | src; break;
+		case 4: src = dst & src; break;
+		case 5: src = dst - src; break;
+		case 6: src = dst ^ src; break;
+		default: return 0;
+		}
+	}
+	*value = *size == 4 ? src : src & ((1UL << (*size * 8)) - 1);
+	return (int) (p - ip);
+}
+
+static void trap(int sig, siginfo_t *si, void *ctx) {
+	ucontext_t *uc = ctx;
+	uint8_t *addr = si->si_addr;
+	const uint8_t *ip = (const uint8_t *) uc->uc_mcontext.gregs[REG_RIP];
+	int n, p, len, size;
+	uint32_t off, value, word;
+	uint8_t *alias;
+
+	(void) sig;
+	if (!view_decode((uint32_t) (uintptr_t) addr, &n, &p, &off) || (uintptr_t) addr >> 32 != 0) {
+		// Not a register, fault again with the default action
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	pthread_mutex_lock(&hw_mtx);
+	alias = (uint8_t *) nodes[n].regs[p] + off;
+	len = decode_store(ip, uc, alias, &value, &size);
+	if (len == 0)
+		trap_unknown(ip);
+
+	// Sub word stores merge into the register
+	word = nodes[n].regs[p][off / 4];
+	if (size < 4 || (off & 3) != 0) {
+		uint32_t shift = (off & 3) * 8;
+		uint32_t mask = (size == 4 ? 0xFFFFFFFFUL : (1UL << (size * 8)) - 1) << shift;
+		value = (word & ~mask) | ((value << shift) & mask);
+	}
+	reg_write(n, p, off & ~3U, value);
+	pthread_mutex_unlock(&hw_mtx);
+
+	uc->uc_mcontext.gregs[REG_RIP] += len;
+}
+
+/*
+ * Scheduler hooks
+ */
+
+static bool hw_busy(void) {
+	bool busy;
+
+	pthread_mutex_lock(&hw_mtx);
+	busy = irq_busy > 0;
+	pthread_mutex_unlock(&hw_mtx);
+	return busy;
+}
+
+typedef enum { HW_RADIO, HW_PACKET, HW_TIMER } hw_item_t;
+
+// Earliest hardware event, hardware locked
+static bool hw_next_item(uint64_t *time, hw_item_t *item, int *n, int *cc, packet_t **pp) {
+	uint64_t next = T_NONE;
+
+	for (int i=0; i < node_count; i++) {
+		if (nodes[i].t_state < next) {
+			next = nodes[i].t_state;
+			*item = HW_RADIO;
+			*n = i;
+		}
+		for (int c=0; c < TIMER_CC_COUNT; c++) {
+			uint64_t t = timer_next(i, c);
+			if (t < next) {
+				next = t;
+				*item = HW_TIMER;
+				*n = i;
+				*cc = c;
+			}
+		}
+	}
+	for (packet_t *p = air; p != NULL; p = p->next) {
+		if (packet_next(p) < next) {
+			next = packet_next(p);
+			*item = HW_PACKET;
+			*pp = p;
+		}
+	}
+	*time = next;
+	return next != T_NONE;
+}
+
+static bool hw_next(uint64_t *time) {
+	hw_item_t item;
+	int n = 0, cc = 0;
+	packet_t *pp = NULL;
+	bool found;
+
+	pthread_mutex_lock(&hw_mtx);
+	found = hw_next_item(time, &item, &n, &cc, &pp);
+	pthread_mutex_unlock(&hw_mtx);
+	return found;
+}
+
+static void hw_run(uint64_t time) {
+	uint64_t t;
+	hw_item_t item;
+	int n = 0, cc = 0;
+	packet_t *pp = NULL;
+
+	pthread_mutex_lock(&hw_mtx);
+	while (hw_next_item(&t, &item, &n, &cc, &pp) && t <= time) {
+		switch (item) {
+		case HW_RADIO:
+			radio_step(n);
+			break;
+		case HW_PACKET:
+			packet_step(pp);
+			break;
+		case HW_TIMER:
+			timer_compare(n, cc);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hw_mtx);
+}
+
+static const sim_hw_t hw_ops = {
+	.busy = hw_busy,
+	.next = hw_next,
+	.run = hw_run,
+};
+
+/*
+ * API
+ */
+
+void nrf_emu_init(int count, uint32_t seed) {
+	struct sigaction sa;
+	uint8_t *rw;
+	int fd;
+
+	osalDbgAssert(nodes == NULL && count > 0 && count <= NRF_EMU_NODES_MAX, "wrong node count");
+
+	node_count = count;
+	nodes = calloc((size_t) count, sizeof(node_t));
+	rand_state = ((uint64_t) seed << 32) | 0x9E3779B9UL;
+
+	view_size = (size_t) count * P_COUNT * PAGE_SIZE_EMU;
+	fd = memfd_create("nrf_emu", 0);
+	if (fd < 0 || ftruncate(fd, (off_t) view_size) != 0) {
+		perror("nrf_emu");
+		abort();
+	}
+	rw = mmap(NULL, view_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	view_base = mmap(NULL, view_size, PROT_READ, MAP_SHARED | MAP_32BIT, fd, 0);
+	if (rw == MAP_FAILED || view_base == MAP_FAILED) {
+		perror("nrf_emu");
+		abort();
+	}
+	close(fd);
+
+	for (int n=0; n < count; n++) {
+		node_t *np = &nodes[n];
+
+		for (int p=0; p < P_COUNT; p++) {
+			np->regs[p] = (uint32_t *) (rw + ((size_t) n * P_COUNT + (size_t) p) * PAGE_SIZE_EMU);
+			np->view[p] = view_base + ((size_t) n * P_COUNT + (size_t) p) * PAGE_SIZE_EMU;
+		}
+		((uint32_t *) np->ficr.DEVICEID)[0] = 0x5EED0000UL + (uint32_t) n * 0x9E3779B1UL;
+		((uint32_t *) np->ficr.DEVICEID)[1] = (uint32_t) n;
+		np->t_state = T_NONE;
+		np->state = RADIO_STATE_STATE_Disabled;
+		TIMER(n, PRESCALER) = 4;
+		CLOCK(n, HFCLKSTAT) = CLOCK_HFCLKSTAT_STATE_Msk;
+		RADIO(n, POWER) = 1;
+		pthread_cond_init(&np->irq_cond, NULL);
+
+		for (int r=0; r < count; r++) {
+			links[n][r].cfg.connected = true;
+			links[n][r].cfg.rssi = 50;
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = trap;
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGSEGV, &sa, NULL);
+
+	sim_set_hw(&hw_ops);
+}
+
+void nrf_emu_set_link(int from, int to, const nrf_emu_link_t *link) {
+	pthread_mutex_lock(&hw_mtx);
+	links[from][to].cfg = *link;
+	links[from][to].bad = false;
+	pthread_mutex_unlock(&hw_mtx);
+}
+
+void nrf_emu_set_isr(int n, void (*isr)(void *arg), void *arg) {
+	node_t *np = &nodes[n];
+
+	pthread_mutex_lock(&hw_mtx);
+	np->isr = isr;
+	np->isr_arg = arg;
+	pthread_mutex_unlock(&hw_mtx);
+	pthread_create(&np->irq_tid, NULL, irq_thread, np);
+	pthread_detach(np->irq_tid);
+}
+
+void nrf_emu_get_stats(int n, nrf_emu_stats_t *stats) {
+	pthread_mutex_lock(&hw_mtx);
+	count_state(&nodes[n]);
+	*stats = nodes[n].stats;
+	pthread_mutex_unlock(&hw_mtx);
+}
+
+static void *node_view(int n, int p) {
+	osalDbgAssert(nodes != NULL && n >= 0 && n < node_count, "nrf_emu_init() first");
+	return nodes[n].view[p];
+}
+
+NRF_RADIO_Type *nrf_emu_radio(int n) {
+	return node_view(n, P_RADIO);
+}
+
+NRF_TIMER_Type *nrf_emu_timer(int n) {
+	return node_view(n, P_TIMER);
+}
+
+NRF_PPI_Type *nrf_emu_ppi(int n) {
+	return node_view(n, P_PPI);
+}
+
+NRF_CLOCK_Type *nrf_emu_clock(int n) {
+	return node_view(n, P_CLOCK);
+}
+
+NRF_FICR_Type *nrf_emu_ficr(int n) {
+	osalDbgAssert(nodes != NULL && n >= 0 && n < node_count, "nrf_emu_init() first");
+	return &nodes[n].ficr;
+}
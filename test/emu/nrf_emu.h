@@ -0,0 +1,64 @@
+/*
+ * nrf_emu.h
+ *
+ *  nRF52832 RADIO, TIMER1, PPI & CLOCK register emulator with a virtual air
+ *  between the nodes, each node runs its own driver instance
+ */
+
+#ifndef NRF_EMU_H_
+#define NRF_EMU_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf52.h"
+
+#define NRF_EMU_NODES_MAX		32
+
+// nRF52832 radio timing, uS
+#define NRF_EMU_RAMP_UP_US			140
+#define NRF_EMU_TX_DISABLE_1M_US	6
+#define NRF_EMU_TX_DISABLE_2M_US	4
+#define NRF_EMU_RX_DISABLE_US		0
+
+#define NRF_EMU_RSSI_NOISE		100		// RSSI sample without a carrier, -dBm
+
+// Link from one node to another, a two state loss model: packets are lost with
+// the loss probability of the state, the state changes before each packet
+typedef struct {
+	bool connected;
+	uint8_t rssi;			// at the receiver, -dBm
+	float loss;				// loss probability in the good state
+	float loss_bad;			// loss probability in the bad state
+	float p_bad;			// good to bad state probability
+	float p_good;			// bad to good state probability
+} nrf_emu_link_t;
+
+typedef struct {
+	uint64_t tx_us;			// RADIO in a TX state, ramp up & disable included
+	uint64_t rx_us;			// RADIO in a RX state, ramp up & disable included
+	uint64_t air_us;		// packets on air
+	uint64_t hfxo_us;		// HFXO running
+	uint32_t packets;		// packets sent
+	uint32_t received;		// packets received with a good CRC
+	uint32_t crc_errors;	// packets received with a bad CRC, collisions included
+	uint32_t lost;			// packets lost by the loss model
+} nrf_emu_stats_t;
+
+void nrf_emu_init(int nodes, uint32_t seed);
+void nrf_emu_set_link(int from, int to, const nrf_emu_link_t *link);
+void nrf_emu_set_isr(int node, void (*isr)(void *arg), void *arg);
+void nrf_emu_get_stats(int node, nrf_emu_stats_t *stats);
+
+// Point a driver at the node peripherals and serve its RADIO interrupt
+#define NRF_EMU_ATTACH(rfp, node)												\
+	do {																		\
+		(rfp)->radio = nrf_emu_radio(node);										\
+		(rfp)->timer = nrf_emu_timer(node);										\
+		(rfp)->ppi = nrf_emu_ppi(node);											\
+		(rfp)->clock = nrf_emu_clock(node);										\
+		(rfp)->ficr = nrf_emu_ficr(node);										\
+		nrf_emu_set_isr(node, (void (*)(void *)) radio_serve_interrupt, (rfp));	\
+	} while (0)
+
+#endif /* NRF_EMU_H_ */
@@ -0,0 +1,65 @@
+/*
+ * radio_test.h
+ *
+ *  Checks and the link setup of the radio driver host tests
+ */
+
+#ifndef RADIO_TEST_H_
+#define RADIO_TEST_H_
+
+#include <stdio.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "nrf52_radio.h"
+#include "nrf_emu.h"
+
+#define CHECK(c)	do { if (!(c)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); failures++; } } while (0)
+
+static int failures;
+
+// ESB with dynamic payloads at 2 Mbps, pipes 0 & 1
+static const nrf52_config_t radio_test_config = {
+		.protocol = NRF52_PROTOCOL_ESB_DPL,
+		.bitrate = NRF52_BITRATE_2MBPS,
+		.crc = NRF52_CRC_16BIT,
+		.tx_power = NRF52_TX_POWER_0DBM,
+		.tx_mode = NRF52_TXMODE_AUTO,
+		.selective_auto_ack = false,
+		.retransmit = { 600, 3 },
+		.payload_length = NRF52_MAX_PAYLOAD_LENGTH,
+		.address = {
+				.base_addr_p0 = { 0xE7, 0xE7, 0xE7, 0xE7 },
+				.base_addr_p1 = { 0xC2, 0xC2, 0xC2, 0xC2 },
+				.pipe_prefixes = { 0xE7, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8 },
+				.num_pipes = 2,
+				.addr_length = 5,
+				.rx_pipes = 0x03,
+				.rf_channel = 10,
+		},
+};
+
+// Test payload of the sequence number, the length and data follow from it
+static inline void radio_test_fill(nrf52_payload_t *payload, uint32_t seq) {
+	payload->pipe = 0;
+	payload->noack = 0;
+	payload->length = (uint8_t) (4 + seq % 20);
+	payload->data[0] = (uint8_t) seq;
+	for (uint32_t i=1; i < payload->length; i++)
+		payload->data[i] = (uint8_t) (seq * 7 + i);
+}
+
+static inline bool radio_test_valid(const uint8_t *data, uint8_t length) {
+	nrf52_payload_t expected;
+
+	radio_test_fill(&expected, data[0]);
+	if (length != expected.length)
+		return false;
+	for (uint32_t i=0; i < length; i++) {
+		if (data[i] != expected.data[i])
+			return false;
+	}
+	return true;
+}
+
+#endif /* RADIO_TEST_H_ */
@@ -0,0 +1,137 @@
+/*
+ * sim_link_policy.c
+ *
+ *  The retransmit policies of radio.c over the loss models of the emulator:
+ *  delivery, airtime & PTX energy per delivered frame
+ */
+
+#include <string.h>
+
+#include "radio_test.h"
+#include "main.h"
+#include "radio.h"
+
+#define FRAMES			500
+#define FRAME_LENGTH	16		// one AES block
+#define FRAME_GAP_MS	2
+
+// nRF52832 with the DC/DC at 3 V, 0 dBm TX & 2 Mbps RX, mA
+#define SUPPLY_V		3.0
+#define TX_MA			7.1
+#define RX_MA			5.8
+
+static const link_policy_t link_policies[] = LINK_POLICIES;
+static const char * const policy_names[] = { "GOOD", "FAIR", "POOR" };
+
+typedef struct {
+	const char *name;
+	nrf_emu_link_t link;
+} loss_model_t;
+
+// the same model both ways, the ACKs get lost too
+static const loss_model_t loss_models[] = {
+	{ "none",          { true, 50, 0.0f, 0.0f, 0.0f, 0.0f } },
+	{ "bernoulli 10%", { true, 50, 0.1f, 0.0f, 0.0f, 0.0f } },
+	{ "bernoulli 30%", { true, 50, 0.3f, 0.0f, 0.0f, 0.0f } },
+	{ "gilbert 1/80%", { true, 50, 0.01f, 0.8f, 0.02f, 0.1f } },
+};
+
+#define MODELS		(sizeof(loss_models) / sizeof(loss_models[0]))
+#define POLICIES	(sizeof(link_policies) / sizeof(link_policies[0]))
+
+static RFDriver ptx, prx;
+
+static volatile bool sent;
+static nrf52_send_result_t last_result;
+
+static void send_cb(void *arg, nrf52_send_result_t const *result) {
+	(void) arg;
+	last_result = *result;
+	sent = true;
+}
+
+// frame_budget() of radio.c without CCA
+static sysinterval_t frame_budget(const link_policy_t *policy) {
+	uint32_t round = (policy->count + 1) * (uint32_t) policy->delay;
+
+	return TIME_US2I(round * (policy->sendmax - 1) - round / 2);
+}
+
+// Send FRAMES frames one by one with the policy, returns the delivered ones
+static uint32_t run(const link_policy_t *policy, const char *model, const char *name) {
+	nrf52_config_t config = radio_test_config;
+	nrf_emu_stats_t before, after;
+	nrf52_payload_t payload;
+	nrf52_frame_t *frame;
+	uint32_t delivered = 0, attempts = 0;
+
+	config.mode = NRF52_MODE_PTX;
+	config.retransmit.delay = policy->delay;
+	config.retransmit.count = policy->count;
+	CHECK(radio_init(&ptx, &config) == NRF52_SUCCESS);
+	nrf_emu_get_stats(0, &before);
+
+	for (uint32_t seq=0; seq < FRAMES; seq++) {
+		radio_test_fill(&payload, seq);
+		payload.length = FRAME_LENGTH;
+		sent = false;
+		CHECK(radio_send(&ptx, &payload, chTimeAddX(chVTGetSystemTimeX(), frame_budget(policy)),
+				send_cb, NULL) == NRF52_SUCCESS);
+		while (!sent)
+			chThdSleepMicroseconds(100);
+		if (last_result.status == NRF52_SEND_OK)
+			delivered++;
+		attempts += last_result.attempts;
+
+		while (radio_rx_acquire(&prx, &frame) == NRF52_SUCCESS)
+			radio_rx_release(&prx);
+		chThdSleepMilliseconds(FRAME_GAP_MS);
+	}
+
+	nrf_emu_get_stats(0, &after);
+	CHECK(radio_disable(&ptx) == NRF52_SUCCESS);
+
+	uint64_t tx_us = after.tx_us - before.tx_us;
+	uint64_t rx_us = after.rx_us - before.rx_us;
+	uint64_t air_us = after.air_us - before.air_us;
+	double energy_uj = SUPPLY_V * (TX_MA * tx_us + RX_MA * rx_us) / 1000.0;
+
+	printf("sim_link_policy: %-13s %s delivered %5.1f%%, %4.2f attempts/frame, "
+			"per delivered frame %6.1f uS airtime, %5.1f uJ\n",
+			model, name, 100.0 * delivered / FRAMES, (double) attempts / FRAMES,
+			delivered ? (double) air_us / delivered : 0.0, delivered ? energy_uj / delivered : 0.0);
+	return delivered;
+}
+
+int main(void) {
+	nrf52_config_t config = radio_test_config;
+	uint32_t delivered[MODELS][POLICIES];
+
+	chSysInit();
+	nrf_emu_init(2, 1);
+	NRF_EMU_ATTACH(&ptx, 0);
+	NRF_EMU_ATTACH(&prx, 1);
+
+	config.mode = NRF52_MODE_PRX;
+	CHECK(radio_init(&prx, &config) == NRF52_SUCCESS);
+	CHECK(radio_start_rx(&prx) == NRF52_SUCCESS);
+
+	for (uint32_t m=0; m < MODELS; m++) {
+		nrf_emu_set_link(0, 1, &loss_models[m].link);
+		nrf_emu_set_link(1, 0, &loss_models[m].link);
+		for (uint32_t p=0; p < POLICIES; p++)
+			delivered[m][p] = run(&link_policies[p], loss_models[m].name, policy_names[p]);
+	}
+
+	// a clean link delivers everything, the more attempts of a frame the more
+	// of the lossy link gets through
+	for (uint32_t p=0; p < POLICIES; p++)
+		CHECK(delivered[0][p] == FRAMES);
+	for (uint32_t m=1; m < MODELS; m++) {
+		CHECK(delivered[m][LINK_POOR] >= delivered[m][LINK_GOOD]);
+		CHECK(delivered[m][LINK_FAIR] >= delivered[m][LINK_GOOD]);
+	}
+
+	printf("sim_link_policy: %d failures\n", failures);
+	return failures == 0 ? 0 : 1;
+}
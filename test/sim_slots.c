@@ -0,0 +1,149 @@
+/*
+ * sim_slots.c
+ *
+ *  Burst collision rate versus node count, nodes waking at random phases
+ *  from the watchdog reset and nodes aligned to the TDMA slots of the gateway
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "main.h"
+
+#define PERIOD_MS		60000.0		// config.sleep, one burst per wake cycle
+#define BURST_MS		NRF_SEND_MS	// burst on air, the ACKs included
+#define READOUT_MS		30.0		// sensors readout time spread of the random wake
+#define DRIFT_PPM		50.0		// LFCLK drift left after the slot_late correction
+#define TIME_ERR_MS		1.0			// gateway time error, mS resolution & ACK latency
+#define TIME_RATE		0.5			// bursts delivered that get the gateway time back
+#define CYCLES			400
+#define WARMUP			20			// cycles not counted, the slotted nodes join
+#define NODES_MAX		5000
+
+#define CHECK(c)	do { if (!(c)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); failures++; } } while (0)
+
+static int failures;
+
+static const int node_counts[] = { 10, 50, 100, 200, 500, 1000, 2000, 5000 };
+
+typedef struct {
+	double offset;			// slot offset, mS
+	double drift;			// phase drift per cycle, mS
+	double free;			// phase of the wake cycle not aligned, mS
+	double err;				// slot start error, mS
+	int sync;				// cycles left aligned to the slot
+	double phase;			// burst start in this cycle, mS
+	int collided;
+} node_t;
+
+static node_t nodes[NODES_MAX];
+static int order[NODES_MAX];
+static uint64_t rand_state;
+
+static double rand_unit(void) {
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return (double) (rand_state >> 11) / (double) (1ULL << 53);
+}
+
+static double rand_range(double lo, double hi) {
+	return lo + (hi - lo) * rand_unit();
+}
+
+static int phase_cmp(const void *a, const void *b) {
+	double pa = nodes[*(const int *) a].phase, pb = nodes[*(const int *) b].phase;
+
+	return (pa > pb) - (pa < pb);
+}
+
+static double wrap(double ms) {
+	while (ms < 0)
+		ms += PERIOD_MS;
+	while (ms >= PERIOD_MS)
+		ms -= PERIOD_MS;
+	return ms;
+}
+
+// Bursts overlapping a neighbour on the cycle circle
+static void collide(int count) {
+	for (int i=0; i < count; i++) {
+		order[i] = i;
+		nodes[i].collided = 0;
+	}
+	qsort(order, count, sizeof(order[0]), phase_cmp);
+
+	for (int i=0; count > 1 && i < count; i++) {
+		node_t *np = &nodes[order[i]], *next = &nodes[order[(i + 1) % count]];
+
+		if (wrap(next->phase - np->phase) < BURST_MS)
+			np->collided = next->collided = 1;
+	}
+}
+
+// Collided bursts per burst sent over the cycles
+static double run(int count, int slotted) {
+	uint32_t bursts = 0, collided = 0;
+	int slots = (int) (PERIOD_MS / SLOT_UNIT);
+
+	rand_state = 0x9E3779B97F4A7C15ULL + (uint64_t) count;
+	for (int i=0; i < count; i++) {
+		nodes[i].offset = SLOT_UNIT * (double) ((int64_t) i * slots / count);
+		nodes[i].drift = PERIOD_MS * rand_range(-DRIFT_PPM, DRIFT_PPM) / 1e6;
+		nodes[i].free = rand_range(0, PERIOD_MS);
+		nodes[i].sync = 0;
+	}
+
+	for (int k=0; k < CYCLES; k++) {
+		for (int i=0; i < count; i++) {
+			node_t *np = &nodes[i];
+
+			if (np->sync > 0) {
+				np->phase = wrap(np->offset + np->err);
+				np->err += np->drift;
+			} else {
+				np->phase = wrap(np->free + rand_range(0, READOUT_MS));
+			}
+			np->free = wrap(np->free + np->drift);
+		}
+		collide(count);
+
+		for (int i=0; i < count; i++) {
+			node_t *np = &nodes[i];
+
+			if (k >= WARMUP) {
+				bursts++;
+				collided += np->collided;
+			}
+			if (!slotted)
+				continue;
+			if (!np->collided && rand_unit() < TIME_RATE) {
+				np->sync = SLOT_SYNC_CYCLES;
+				np->err = rand_range(-TIME_ERR_MS, TIME_ERR_MS);
+			} else if (np->sync > 0 && --np->sync == 0) {
+				// back to the watchdog period from the last aligned wake up
+				np->free = np->phase;
+			}
+		}
+	}
+	return (double) collided / bursts;
+}
+
+int main(void) {
+	printf("sim_slots: %.0f S period, %d mS bursts, %d mS slot unit, %.0f ppm drift\n",
+			PERIOD_MS / 1000, BURST_MS, SLOT_UNIT, DRIFT_PPM);
+
+	for (size_t n=0; n < sizeof(node_counts) / sizeof(node_counts[0]); n++) {
+		double random = run(node_counts[n], 0);
+		double slotted = run(node_counts[n], 1);
+
+		printf("sim_slots: %4d nodes, collided bursts random %6.3f%%, slotted %6.3f%%\n",
+				node_counts[n], 100.0 * random, 100.0 * slotted);
+		CHECK(slotted <= random);
+		if (node_counts[n] >= 100)
+			CHECK(slotted < random);
+	}
+
+	printf("sim_slots: %d failures\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/*
+ * test_fifo_stress.c
+ *
+ *  The TX and RX FIFOs between a thread and the RADIO state machine running at
+ *  once: frames have to come out in order and intact, with no lock on the
+ *  writer side of the TX FIFO and on the reader side of the RX FIFO
+ */
+
+#include <string.h>
+#include <sched.h>
+
+#include "radio_test.h"
+
+#define TX_FRAMES		50000
+#define RX_FRAMES		2000
+#define TX_CHANNEL		40
+
+static RFDriver txq, sink, ptx, prx;
+
+static THD_WORKING_AREA(wa_producer, 512);
+static THD_WORKING_AREA(wa_sink, 512);
+static THD_WORKING_AREA(wa_reader, 512);
+
+// PRX reader, the frames come in order
+typedef struct {
+	RFDriver *rfp;
+	int32_t last;
+	uint32_t frames;
+} reader_t;
+
+static reader_t sink_reader = { &sink, -1, 0 };
+static reader_t prx_reader = { &prx, -1, 0 };
+
+static uint32_t tx_expected;
+static uint32_t tx_full;		// reserves the state machine had to make room for
+static uint32_t rx_results;
+
+static void frame_fill(nrf52_frame_t *frame, uint32_t seq) {
+	frame->pipe = 0;
+	frame->noack = 0;
+	frame->length = (uint8_t) (4 + seq % (NRF52_MAX_PAYLOAD_LENGTH - 3));
+	memcpy(frame->data, &seq, 4);
+	for (uint32_t i=4; i < frame->length; i++)
+		frame->data[i] = (uint8_t) (seq * 13 + i);
+}
+
+static bool frame_check(const nrf52_frame_t *frame, uint32_t seq) {
+	if (frame->length != 4 + seq % (NRF52_MAX_PAYLOAD_LENGTH - 3) || memcmp(frame->data, &seq, 4) != 0)
+		return false;
+	for (uint32_t i=4; i < frame->length; i++) {
+		if (frame->data[i] != (uint8_t) (seq * 13 + i))
+			return false;
+	}
+	return true;
+}
+
+static THD_FUNCTION(reader, arg) {
+	reader_t *rp = arg;
+	event_listener_t el;
+	nrf52_frame_t *frame;
+
+	chEvtRegisterMask(&rp->rfp->eventsrc, &el, EVENT_MASK(0));
+	while (!chThdShouldTerminateX()) {
+		chEvtWaitAnyTimeout(EVENT_MASK(0), TIME_MS2I(10));
+		chEvtGetAndClearFlags(&el);
+
+		while (radio_rx_acquire(rp->rfp, &frame) == NRF52_SUCCESS) {
+			uint32_t seq;
+
+			memcpy(&seq, frame->data, 4);
+			CHECK((int32_t) seq == rp->last + 1);
+			CHECK(frame_check(frame, seq));
+			rp->last = (int32_t) seq;
+			rp->frames++;
+			radio_rx_release(rp->rfp);
+		}
+	}
+	chEvtUnregister(&rp->rfp->eventsrc, &el);
+}
+
+// Result of the frame sent by the state machine, system locked, the slot is
+// passed back to the producer after it
+static void tx_cb(void *arg, nrf52_send_result_t const *result) {
+	const nrf52_frame_t *frame = arg;
+
+	CHECK(result->status == NRF52_SEND_OK);
+	CHECK(frame_check(frame, tx_expected));
+	tx_expected++;
+}
+
+// The writer side takes no lock, it runs beside the virtual time so the RADIO
+// state machine empties the FIFO while a frame is being built
+static THD_FUNCTION(producer, arg) {
+	nrf52_frame_t *frame;
+
+	(void) arg;
+	sim_thread_free();
+	for (uint32_t seq=0; seq < TX_FRAMES; seq++) {
+		// the FIFO is let run down to a few frames or empty now and then, the
+		// commit races the state machine taking the last frame or going idle
+		while (radio_tx_pending(&txq) > seq % (NRF52_TX_FIFO_SIZE + 2))
+			sched_yield();
+		while (radio_tx_reserve(&txq, &frame) == NRF52_ERROR_INVALID_LENGTH) {
+			tx_full++;
+			sched_yield();
+		}
+		frame_fill(frame, seq);
+		frame->deadline = chTimeAddX(chVTGetSystemTimeX(), TIME_MS2I(100));
+		frame->cb = tx_cb;
+		frame->arg = frame;
+		CHECK(radio_tx_commit(&txq) == NRF52_SUCCESS);
+	}
+}
+
+// The TX FIFO of a PTX written by one thread and emptied by its state machine
+static void test_tx_fifo(void) {
+	nrf52_config_t config = radio_test_config;
+	thread_t *tp_producer, *tp_sink;
+
+	config.address.rf_channel = TX_CHANNEL;
+	config.mode = NRF52_MODE_PTX;
+	CHECK(radio_init(&txq, &config) == NRF52_SUCCESS);
+	config.mode = NRF52_MODE_PRX;
+	CHECK(radio_init(&sink, &config) == NRF52_SUCCESS);
+
+	tp_sink = chThdCreateStatic(wa_sink, sizeof(wa_sink), NORMALPRIO, reader, &sink_reader);
+	chThdSleepMilliseconds(1);
+	CHECK(radio_start_rx(&sink) == NRF52_SUCCESS);
+
+	tp_producer = chThdCreateStatic(wa_producer, sizeof(wa_producer), NORMALPRIO, producer, NULL);
+	chThdWait(tp_producer);
+	for (uint32_t ms=0; ms < 1000 && tx_expected < TX_FRAMES; ms++)
+		chThdSleepMilliseconds(1);
+	chThdSleepMilliseconds(20);
+
+	chThdTerminate(tp_sink);
+	chThdWait(tp_sink);
+	CHECK(tx_expected == TX_FRAMES);
+	CHECK(sink_reader.frames == TX_FRAMES);
+	CHECK(radio_tx_pending(&txq) == 0);
+	CHECK(tx_full > 0);
+	CHECK(radio_stop_rx(&sink) == NRF52_SUCCESS);
+	CHECK(radio_wait_idle(&sink) == NRF52_SUCCESS);
+	CHECK(radio_disable(&sink) == NRF52_SUCCESS);
+	CHECK(radio_disable(&txq) == NRF52_SUCCESS);
+	printf("test_fifo_stress: TX FIFO %u frames, %u reserves on a full FIFO\n",
+			(unsigned) tx_expected, (unsigned) tx_full);
+}
+
+static void send_cb(void *arg, nrf52_send_result_t const *result) {
+	(void) arg;
+	CHECK(result->status == NRF52_SEND_OK);
+	rx_results++;
+}
+
+// The RX FIFO filled by the state machine while the reader empties it
+static void test_rx_fifo(void) {
+	nrf52_config_t config = radio_test_config;
+	nrf52_stats_t stats;
+	nrf52_frame_t *frame;
+	thread_t *tp;
+
+	config.mode = NRF52_MODE_PTX;
+	CHECK(radio_init(&ptx, &config) == NRF52_SUCCESS);
+	config.mode = NRF52_MODE_PRX;
+	CHECK(radio_init(&prx, &config) == NRF52_SUCCESS);
+
+	tp = chThdCreateStatic(wa_reader, sizeof(wa_reader), NORMALPRIO, reader, &prx_reader);
+	chThdSleepMilliseconds(1);
+	CHECK(radio_start_rx(&prx) == NRF52_SUCCESS);
+
+	for (uint32_t seq=0; seq < RX_FRAMES; seq++) {
+		while (radio_tx_reserve(&ptx, &frame) == NRF52_ERROR_INVALID_LENGTH)
+			chThdSleepMicroseconds(100);
+		frame_fill(frame, seq);
+		frame->deadline = chTimeAddX(chVTGetSystemTimeX(), TIME_MS2I(100));
+		frame->cb = send_cb;
+		frame->arg = NULL;
+		CHECK(radio_tx_commit(&ptx) == NRF52_SUCCESS);
+	}
+	for (uint32_t ms=0; ms < 2000 && rx_results < RX_FRAMES; ms++)
+		chThdSleepMilliseconds(1);
+	chThdSleepMilliseconds(20);
+
+	chThdTerminate(tp);
+	chThdWait(tp);
+	radio_take_stats(&prx, &stats);
+	CHECK(rx_results == RX_FRAMES);
+	CHECK(prx_reader.frames == RX_FRAMES);
+	CHECK(stats.rx_overflows == 0);
+	printf("test_fifo_stress: RX FIFO %u frames\n", (unsigned) prx_reader.frames);
+}
+
+int main(void) {
+	chSysInit();
+	nrf_emu_init(4, 1);
+	NRF_EMU_ATTACH(&txq, 0);
+	NRF_EMU_ATTACH(&sink, 1);
+	NRF_EMU_ATTACH(&ptx, 2);
+	NRF_EMU_ATTACH(&prx, 3);
+
+	test_tx_fifo();
+	test_rx_fifo();
+
+	printf("test_fifo_stress: %d failures\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+/*
+ * test_radio_link.c
+ *
+ *  PTX and PRX driver instances on the register emulator: delivery in order,
+ *  ACK payload, duplicates on a lossy ACK direction, the TX flush results and
+ *  the HFXO released by the idle hook
+ */
+
+#include <string.h>
+
+#include "radio_test.h"
+
+#define FRAMES_MAX	64
+#define SENSOR_WAIT_MS	800		// DHT power up wait of a wake cycle
+#define HFXO_UA			250		// PROF_I_HFXO of profile.c
+
+static RFDriver ptx, prx;
+
+// results by frame, counted by the callback
+static uint32_t results[FRAMES_MAX];
+static nrf52_send_status_t status[FRAMES_MAX];
+static uint32_t results_total;
+
+// PRX reader
+static THD_WORKING_AREA(wa_reader, 512);
+static uint32_t rx_frames;
+static int32_t rx_last = -1;
+
+static void send_cb(void *arg, nrf52_send_result_t const *result) {
+	uint32_t seq = (uint32_t) (uintptr_t) arg;
+
+	results[seq]++;
+	status[seq] = result->status;
+	results_total++;
+}
+
+static THD_FUNCTION(reader, arg) {
+	event_listener_t el;
+	nrf52_frame_t *frame;
+
+	(void) arg;
+	chRegSetThreadName("reader");
+	chEvtRegisterMask(&prx.eventsrc, &el, EVENT_MASK(0));
+
+	while (!chThdShouldTerminateX()) {
+		chEvtWaitAnyTimeout(EVENT_MASK(0), TIME_MS2I(10));
+		chEvtGetAndClearFlags(&el);
+
+		while (radio_rx_acquire(&prx, &frame) == NRF52_SUCCESS) {
+			// in order, once and intact
+			CHECK((int32_t) frame->data[0] > rx_last);
+			CHECK(radio_test_valid(frame->data, frame->length));
+			CHECK(frame->pipe == 0);
+			rx_last = frame->data[0];
+			rx_frames++;
+			radio_rx_release(&prx);
+		}
+	}
+	chEvtUnregister(&prx.eventsrc, &el);
+}
+
+// idle thread enter hook of the firmware
+static void idle_hook(void) {
+	radio_hfclk_release(&ptx);
+	radio_hfclk_release(&prx);
+}
+
+static void send_frames(uint32_t first, uint32_t count, uint32_t deadline_ms) {
+	nrf52_payload_t payload;
+
+	for (uint32_t seq=first; seq < first + count; seq++) {
+		radio_test_fill(&payload, seq);
+		while (radio_send(&ptx, &payload, chTimeAddX(chVTGetSystemTimeX(), TIME_MS2I(deadline_ms)),
+				send_cb, (void *) (uintptr_t) seq) == NRF52_ERROR_INVALID_LENGTH)
+			chThdSleepMilliseconds(1);
+	}
+}
+
+static bool wait_results(uint32_t total, uint32_t timeout_ms) {
+	for (uint32_t ms=0; ms < timeout_ms && results_total < total; ms++)
+		chThdSleepMilliseconds(1);
+	return results_total == total;
+}
+
+static void test_delivery(void) {
+	send_frames(0, 20, 50);
+	CHECK(wait_results(20, 200));
+	chThdSleepMilliseconds(20);
+
+	for (uint32_t seq=0; seq < 20; seq++)
+		CHECK(results[seq] == 1 && status[seq] == NRF52_SEND_OK);
+	CHECK(rx_frames == 20);
+	CHECK(rx_last == 19);
+}
+
+static void test_ack_payload(void) {
+	nrf52_payload_t ack = { .pipe = 0, .length = 4, .data = { 'A', 'C', 'K', '1' } };
+	nrf52_frame_t *frame;
+
+	CHECK(radio_write_payload(&prx, &ack) == NRF52_SUCCESS);
+	send_frames(20, 1, 50);
+	CHECK(wait_results(21, 100));
+	chThdSleepMilliseconds(20);
+
+	CHECK(status[20] == NRF52_SEND_OK);
+	CHECK(radio_rx_acquire(&ptx, &frame) == NRF52_SUCCESS);
+	CHECK(frame->length == 4 && memcmp(frame->data, "ACK1", 4) == 0);
+	radio_rx_release(&ptx);
+	CHECK(rx_frames == 21);
+}
+
+static void test_lossy_ack(void) {
+	nrf_emu_link_t lossy = { .connected = true, .rssi = 60, .loss = 0.5f };
+	nrf_emu_link_t clean = { .connected = true, .rssi = 50 };
+	nrf52_stats_t ptx_stats, prx_stats;
+	nrf_emu_stats_t emu_stats;
+
+	radio_take_stats(&ptx, &ptx_stats);
+	radio_take_stats(&prx, &prx_stats);
+	nrf_emu_set_link(1, 0, &lossy);
+
+	send_frames(21, 20, 200);
+	CHECK(wait_results(41, 2000));
+	chThdSleepMilliseconds(20);
+	nrf_emu_set_link(1, 0, &clean);
+
+	radio_take_stats(&ptx, &ptx_stats);
+	radio_take_stats(&prx, &prx_stats);
+	for (uint32_t seq=21; seq < 41; seq++)
+		CHECK(results[seq] == 1 && status[seq] == NRF52_SEND_OK);
+	CHECK(rx_frames == 41);
+	CHECK(ptx_stats.tx_retransmits > 0);
+	CHECK(prx_stats.rx_duplicates > 0);
+	nrf_emu_get_stats(0, &emu_stats);
+	CHECK(emu_stats.lost > 0);
+	// each instance counts its own side
+	CHECK(ptx_stats.rx_duplicates == 0 && prx_stats.tx_retransmits == 0);
+}
+
+// Flush the TX FIFO, the cancel of a transaction in progress takes the RADIO
+// disable time, not the stop timeout
+static sysinterval_t flush_time(void) {
+	systime_t start = chVTGetSystemTimeX();
+
+	CHECK(radio_flush_tx(&ptx) == NRF52_SUCCESS);
+	return chVTTimeElapsedSinceX(start);
+}
+
+static void test_flush(void) {
+	nrf_emu_link_t off = { .connected = false };
+	nrf_emu_link_t clean = { .connected = true, .rssi = 50 };
+	uint32_t active = 0;
+
+	nrf_emu_set_link(0, 1, &off);
+	send_frames(41, 6, 1000);
+	chThdSleepMilliseconds(3);
+
+	CHECK(flush_time() < TIME_MS2I(NRF52_RADIO_STOP_TIMEOUT) / 10);
+	CHECK(radio_tx_pending(&ptx) == 0);
+	CHECK(results_total == 47);
+	chThdSleepMilliseconds(50);
+
+	// exactly one result per frame, none after the flush
+	CHECK(results_total == 47);
+	for (uint32_t seq=41; seq < 47; seq++)
+		CHECK(results[seq] == 1 && status[seq] == NRF52_SEND_FLUSHED);
+
+	// flushes all over the retransmit cycle, the RADIO on air or between attempts
+	for (uint32_t seq=47; seq < 57; seq++) {
+		send_frames(seq, 1, 1000);
+		chThdSleepMicroseconds(2000 + 73 * (seq - 47));
+		if (ptx.radio->STATE != RADIO_STATE_STATE_Disabled)
+			active++;
+		CHECK(flush_time() < TIME_MS2I(NRF52_RADIO_STOP_TIMEOUT) / 10);
+		CHECK(results[seq] == 1 && status[seq] == NRF52_SEND_FLUSHED);
+	}
+	CHECK(active > 0);
+	nrf_emu_set_link(0, 1, &clean);
+
+	// the link goes on after the flush
+	send_frames(57, 3, 50);
+	CHECK(wait_results(60, 100));
+	for (uint32_t seq=57; seq < 60; seq++)
+		CHECK(results[seq] == 1 && status[seq] == NRF52_SEND_OK);
+}
+
+// The PTX HFXO is off while the driver waits with an empty TX FIFO, and runs
+// from the frames queued till the burst is over
+static void test_hfxo_release(void) {
+	nrf_emu_stats_t before, after;
+	systime_t start;
+
+	chThdSleepMilliseconds(1);
+	nrf_emu_get_stats(0, &before);
+	chThdSleepMilliseconds(SENSOR_WAIT_MS);
+	nrf_emu_get_stats(0, &after);
+	CHECK(after.hfxo_us == before.hfxo_us);
+
+	start = chVTGetSystemTimeX();
+	before = after;
+	send_frames(60, 4, 50);
+	CHECK(wait_results(64, 100));
+	nrf_emu_get_stats(0, &after);
+	CHECK(after.hfxo_us - before.hfxo_us >= after.tx_us - before.tx_us + after.rx_us - before.rx_us);
+	CHECK(after.hfxo_us - before.hfxo_us < chVTTimeElapsedSinceX(start));
+	for (uint32_t seq=60; seq < 64; seq++)
+		CHECK(results[seq] == 1 && status[seq] == NRF52_SEND_OK);
+
+	printf("test_radio_link: HFXO %u of %u uS from the burst start, %u uC of the sensor wait saved\n",
+			(unsigned) (after.hfxo_us - before.hfxo_us), (unsigned) chVTTimeElapsedSinceX(start),
+			(unsigned) (SENSOR_WAIT_MS * HFXO_UA / 1000));
+}
+
+int main(void) {
+	nrf52_config_t config = radio_test_config;
+	thread_t *tp;
+
+	chSysInit();
+	nrf_emu_init(2, 1);
+	NRF_EMU_ATTACH(&ptx, 0);
+	NRF_EMU_ATTACH(&prx, 1);
+
+	config.mode = NRF52_MODE_PTX;
+	CHECK(radio_init(&ptx, &config) == NRF52_SUCCESS);
+	config.mode = NRF52_MODE_PRX;
+	CHECK(radio_init(&prx, &config) == NRF52_SUCCESS);
+
+	tp = chThdCreateStatic(wa_reader, sizeof(wa_reader), NORMALPRIO, reader, NULL);
+	chThdSleepMilliseconds(1);
+	CHECK(radio_start_rx(&prx) == NRF52_SUCCESS);
+	sim_set_idle_hook(idle_hook);
+
+	test_delivery();
+	test_ack_payload();
+	test_lossy_ack();
+	test_flush();
+	test_hfxo_release();
+
+	sim_set_idle_hook(NULL);
+	chThdTerminate(tp);
+	chThdWait(tp);
+	CHECK(radio_stop_rx(&prx) == NRF52_SUCCESS);
+	CHECK(radio_wait_idle(&prx) == NRF52_SUCCESS);
+	CHECK(radio_disable(&prx) == NRF52_SUCCESS);
+	CHECK(radio_disable(&ptx) == NRF52_SUCCESS);
+
+	printf("test_radio_link: %u frames at %u uS, %d failures\n",
+			(unsigned) rx_frames, (unsigned) chVTGetSystemTimeX(), failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * test_rx_copy.c
+ *
+ *  CPU copies of the received frames: none when a frame is parsed in place in
+ *  its RX FIFO slot, one payload copy with radio_read_rx_payload()
+ */
+
+#include <string.h>
+
+#include "radio_test.h"
+
+#define FRAMES		40
+
+static RFDriver ptx, prx;
+
+// memcpy out of the PRX driver, the RADIO DMA into the slots is not a CPU copy
+static uint32_t copied_bytes;
+static uint32_t copies;
+
+// PRX reader
+static THD_WORKING_AREA(wa_reader, 512);
+static bool read_copy;
+static uint32_t rx_frames;
+static uint32_t rx_bytes;
+
+static uint32_t results_total;
+
+void *__real_memcpy(void *dst, const void *src, size_t n);
+
+void *__wrap_memcpy(void *dst, const void *src, size_t n) {
+	if ((const uint8_t *) src >= (const uint8_t *) &prx && (const uint8_t *) src < (const uint8_t *) (&prx + 1)) {
+		__atomic_add_fetch(&copied_bytes, (uint32_t) n, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&copies, 1, __ATOMIC_RELAXED);
+	}
+	return __real_memcpy(dst, src, n);
+}
+
+static void send_cb(void *arg, nrf52_send_result_t const *result) {
+	(void) arg;
+	(void) result;
+	results_total++;
+}
+
+static THD_FUNCTION(reader, arg) {
+	event_listener_t el;
+	nrf52_frame_t *frame;
+	nrf52_payload_t payload;
+
+	(void) arg;
+	chRegSetThreadName("reader");
+	chEvtRegisterMask(&prx.eventsrc, &el, EVENT_MASK(0));
+
+	while (!chThdShouldTerminateX()) {
+		chEvtWaitAnyTimeout(EVENT_MASK(0), TIME_MS2I(10));
+		chEvtGetAndClearFlags(&el);
+
+		if (read_copy) {
+			while (radio_read_rx_payload(&prx, &payload) == NRF52_SUCCESS) {
+				CHECK(radio_test_valid(payload.data, payload.length));
+				rx_frames++;
+				rx_bytes += payload.length;
+			}
+		}
+		else {
+			while (radio_rx_acquire(&prx, &frame) == NRF52_SUCCESS) {
+				CHECK(radio_test_valid(frame->data, frame->length));
+				rx_frames++;
+				rx_bytes += frame->length;
+				radio_rx_release(&prx);
+			}
+		}
+	}
+	chEvtUnregister(&prx.eventsrc, &el);
+}
+
+// Send a burst and count the copies of the reader
+static void run(bool copy, const char *name) {
+	nrf52_payload_t payload;
+
+	chSysLock();
+	read_copy = copy;
+	rx_frames = rx_bytes = results_total = 0;
+	__atomic_store_n(&copied_bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&copies, 0, __ATOMIC_RELAXED);
+	chSysUnlock();
+
+	for (uint32_t seq=0; seq < FRAMES; seq++) {
+		radio_test_fill(&payload, seq);
+		while (radio_send(&ptx, &payload, chTimeAddX(chVTGetSystemTimeX(), TIME_MS2I(50)),
+				send_cb, NULL) == NRF52_ERROR_INVALID_LENGTH)
+			chThdSleepMilliseconds(1);
+	}
+	for (uint32_t ms=0; ms < 200 && results_total < FRAMES; ms++)
+		chThdSleepMilliseconds(1);
+	chThdSleepMilliseconds(20);
+
+	CHECK(rx_frames == FRAMES);
+	if (copy)
+		CHECK(copies == FRAMES && copied_bytes == rx_bytes);
+	else
+		CHECK(copies == 0 && copied_bytes == 0);
+
+	printf("test_rx_copy: %-14s %u frames, %u payload bytes, %u copies, %u bytes copied, %.1f bytes/frame\n",
+			name, (unsigned) rx_frames, (unsigned) rx_bytes, (unsigned) copies, (unsigned) copied_bytes,
+			rx_frames ? (double) copied_bytes / rx_frames : 0.0);
+}
+
+int main(void) {
+	nrf52_config_t config = radio_test_config;
+	thread_t *tp;
+
+	chSysInit();
+	nrf_emu_init(2, 1);
+	NRF_EMU_ATTACH(&ptx, 0);
+	NRF_EMU_ATTACH(&prx, 1);
+
+	config.mode = NRF52_MODE_PTX;
+	CHECK(radio_init(&ptx, &config) == NRF52_SUCCESS);
+	config.mode = NRF52_MODE_PRX;
+	CHECK(radio_init(&prx, &config) == NRF52_SUCCESS);
+
+	tp = chThdCreateStatic(wa_reader, sizeof(wa_reader), NORMALPRIO, reader, NULL);
+	chThdSleepMilliseconds(1);
+	CHECK(radio_start_rx(&prx) == NRF52_SUCCESS);
+
+	run(false, "in place:");
+	run(true, "read payload:");
+
+	chThdTerminate(tp);
+	chThdWait(tp);
+
+	printf("test_rx_copy: %d failures\n", failures);
+	return failures == 0 ? 0 : 1;
+}